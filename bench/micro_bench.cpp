@@ -0,0 +1,318 @@
+#include "renderer.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "mesh.h"
+// after mesh.h, point lights are mesh entities
+#include "light.h"
+#include "spatial.h"
+#include "utilities.h"
+
+// times the cpu kernels of the geometry and the math on synthetic meshes, without a gl context
+//
+//   micro_bench [--max-tris N] [--min-time ms] [--out path] [--baseline path] [--threshold percent]
+//
+// with a baseline written by an earlier run, every kernel that got slower by more than the threshold is reported and the exit code is 1
+
+const std::string MICRO_BENCH_PATH = "../data/micro_bench.json";
+
+// parsing builds the whole file as text first, which takes about 40 bytes a triangle
+const size_t MAX_OFF_TRIS = 1000000;
+
+struct MicroResult {
+    std::string name;
+    // triangles of the mesh, 0 for kernels that don't work on one
+    size_t tris = 0;
+    double ns_per_op = 0.0;
+    // 0 for kernels that don't work on a mesh
+    double tris_per_s = 0.0;
+};
+
+// the compiler can't drop a kernel whose result is stored here
+static volatile float sink;
+
+// runs op until min_time has passed, at least 3 times, and returns the fastest batch in nanoseconds per op.
+// the fastest rather than the mean, since the noise of a shared machine only ever adds time
+static double time_op(const std::function<void()>& op, std::chrono::milliseconds min_time) {
+    // the batch is grown until it takes a tenth of min_time, so that the clock's resolution doesn't matter for fast ops
+    size_t batch = 1;
+    auto batch_time = std::chrono::duration_cast<std::chrono::nanoseconds>(min_time) / 10;
+    while (true) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < batch; i++) {
+            op();
+        }
+        auto duration = std::chrono::steady_clock::now() - start;
+        if (duration >= batch_time || batch >= (size_t(1) << 30)) {
+            break;
+        }
+        batch *= 2;
+    }
+
+    double best = std::numeric_limits<double>::infinity();
+    auto end = std::chrono::steady_clock::now() + min_time;
+    for (int runs = 0; runs < 3 || std::chrono::steady_clock::now() < end; runs++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < batch; i++) {
+            op();
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, ns / batch);
+    }
+    return best;
+}
+
+// a uv sphere of about tris triangles, every vertex shared by its neighboring faces like a loaded model
+static Mesh make_sphere(size_t tris) {
+    size_t rings = std::max<size_t>(2, static_cast<size_t>(std::sqrt(tris / 4.0)));
+    size_t segments = std::max<size_t>(3, tris / (2 * rings));
+
+    std::vector<glm::vec3> verts;
+    std::vector<Indexer> faces;
+    verts.reserve((rings + 1) * segments);
+    faces.reserve(2 * rings * segments);
+    for (size_t r = 0; r <= rings; r++) {
+        float phi = glm::pi<float>() * r / rings;
+        for (size_t s = 0; s < segments; s++) {
+            float theta = glm::two_pi<float>() * s / segments;
+            verts.push_back(glm::vec3(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta)));
+        }
+    }
+    for (size_t r = 0; r < rings; r++) {
+        for (size_t s = 0; s < segments; s++) {
+            uint32_t a = r * segments + s;
+            uint32_t b = r * segments + (s + 1) % segments;
+            uint32_t c = a + segments;
+            uint32_t d = b + segments;
+            faces.push_back({ a, c, b });
+            faces.push_back({ b, c, d });
+        }
+    }
+    return Mesh(std::move(verts), std::move(faces));
+}
+
+static std::string write_off(const Mesh& mesh) {
+    std::ostringstream ss;
+    ss << "OFF\n" << mesh.get_verts().size() << ' ' << mesh.get_faces().size() << " 0\n";
+    for (const glm::vec3& vert : mesh.get_verts()) {
+        ss << vert.x << ' ' << vert.y << ' ' << vert.z << '\n';
+    }
+    for (const Indexer& face : mesh.get_faces()) {
+        ss << TRI << ' ' << face[0] << ' ' << face[1] << ' ' << face[2] << '\n';
+    }
+    return ss.str();
+}
+
+static std::vector<MicroResult> run(size_t max_tris, std::chrono::milliseconds min_time) {
+    std::vector<MicroResult> results;
+    auto add = [&](const std::string& name, size_t tris, double ns_per_op) {
+        MicroResult result{ name, tris, ns_per_op, tris == 0 ? 0.0 : tris / (ns_per_op * 1e-9) };
+        std::cout << "  " << std::left << std::setw(28) << name << std::right << std::setw(10) << tris << std::fixed << std::setprecision(1)
+            << std::setw(16) << ns_per_op << " ns/op";
+        if (tris != 0) {
+            std::cout << std::setw(12) << std::setprecision(2) << result.tris_per_s / 1e6 << " Mtris/s";
+        }
+        std::cout << std::defaultfloat << std::endl;
+        results.push_back(result);
+    };
+
+    for (size_t tris = 1000; tris <= max_tris; tris *= 10) {
+        Mesh mesh = make_sphere(tris);
+        size_t actual = mesh.get_faces().size();
+
+        add("calc_normals", actual, time_op([&] {
+            sink = mesh.calc_normals()[0].x;
+        }, min_time));
+        add("calc_centroid", actual, time_op([&] {
+            sink = mesh.calc_centroid().x;
+        }, min_time));
+        add("calc_scale", actual, time_op([&] {
+            sink = mesh.calc_scale().x;
+        }, min_time));
+        // through the center, so that it crosses the sphere twice and every face is tested
+        add("intersected_triangles", actual, time_op([&] {
+            sink = mesh.intersected_triangles(glm::vec3(0.1f, 0.2f, 5.f), glm::vec3(0.f, 0.f, -1.f));
+        }, min_time));
+
+        if (actual <= MAX_OFF_TRIS) {
+            std::string off = write_off(mesh);
+            Mesh parsed({}, {});
+            add("read_off", actual, time_op([&] {
+                std::istringstream ss(off);
+                parsed.read_off(ss);
+                sink = parsed.get_verts().back().x;
+            }, min_time));
+        }
+    }
+
+    Spatial spatial;
+    spatial.translate(glm::mat4{ 1.f }, glm::vec3(1.f, 2.f, 3.f));
+    spatial.rotate(glm::mat4{ 1.f }, 30.f, glm::vec3(0.f, 1.f, 0.f));
+    add("Spatial::get_position", 0, time_op([&] {
+        sink = spatial.get_position().x;
+    }, min_time));
+
+    TrackballCamera camera(16.f / 9.f);
+    add("Camera::get_ray_world", 0, time_op([&] {
+        sink = camera.get_ray_world(glm::vec2(0.25f, -0.5f), 1920.f, 1080.f).x;
+    }, min_time));
+
+    // the names PointLights::buffer builds every draw for a full scene of lights, without the point lights' own fields,
+    // which can't be constructed without a context
+    std::vector<std::shared_ptr<Light>> lights;
+    for (int i = 0; i < LIGHT_CLASS_SIZES[LightClass::MANY_POINT_LIGHTS]; i++) {
+        lights.push_back(std::make_shared<Light>("point_light", LightTraits(glm::vec3(1.f), 0.1, 1.0, 1.0, 7)));
+    }
+    add("set_array_uniform_names", 0, time_op([&] {
+        set_array_uniform_names(lights);
+        sink = static_cast<float>(lights.back()->u_shininess_.name_.size());
+    }, min_time));
+
+    return results;
+}
+
+static bool write_results(const std::string& path, const std::vector<MicroResult>& results) {
+    std::error_code error;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, error);
+    }
+
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream f(tmp_path, std::ios::trunc);
+        if (!f) {
+            return false;
+        }
+        // a result per line, which is what read_baseline expects
+        f << std::fixed << std::setprecision(3) << "[";
+        for (size_t i = 0; i < results.size(); i++) {
+            const MicroResult& result = results[i];
+            f << (i == 0 ? "" : ",") << "\n{\"name\":\"" << result.name << "\",\"tris\":" << result.tris
+                << ",\"ns_per_op\":" << result.ns_per_op << ",\"tris_per_s\":" << result.tris_per_s << "}";
+        }
+        f << "\n]\n";
+        if (!f) {
+            return false;
+        }
+    }
+    return replace_file(tmp_path, path);
+}
+
+// ns per op of every kernel of a file written by write_results, keyed by name and triangles
+static std::map<std::pair<std::string, size_t>, double> read_baseline(const std::string& path) {
+    std::ifstream f(path);
+    if (!f) {
+        throw std::runtime_error("Error opening baseline " + path);
+    }
+    std::map<std::pair<std::string, size_t>, double> baseline;
+    std::string line;
+    while (std::getline(f, line)) {
+        char name[128];
+        unsigned long long tris;
+        double ns_per_op;
+        if (std::sscanf(line.c_str(), "{\"name\":\"%127[^\"]\",\"tris\":%llu,\"ns_per_op\":%lf", name, &tris, &ns_per_op) == 3) {
+            baseline[{ name, static_cast<size_t>(tris) }] = ns_per_op;
+        }
+    }
+    return baseline;
+}
+
+int main(int argc, char** argv)
+{
+    size_t max_tris = 10000000;
+    std::chrono::milliseconds min_time(200);
+    std::string out_path = MICRO_BENCH_PATH;
+    std::string baseline_path;
+    double threshold = 10.0;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing the value of " + arg);
+            }
+            std::string value = argv[++i];
+            if (arg == "--max-tris") {
+                max_tris = std::stoull(value);
+            }
+            else if (arg == "--min-time") {
+                min_time = std::chrono::milliseconds(std::stoi(value));
+            }
+            else if (arg == "--out") {
+                out_path = value;
+            }
+            else if (arg == "--baseline") {
+                baseline_path = value;
+            }
+            else if (arg == "--threshold") {
+                threshold = std::stod(value);
+            }
+            else {
+                throw std::runtime_error("Unknown argument " + arg);
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        std::cout << "usage: " << argv[0] << " [--max-tris N] [--min-time ms] [--out path] [--baseline path] [--threshold percent]" << std::endl;
+        return -1;
+    }
+
+    // read before running, so that a missing baseline fails early and the baseline may be the output file
+    std::map<std::pair<std::string, size_t>, double> baseline;
+    if (!baseline_path.empty()) {
+        try {
+            baseline = read_baseline(baseline_path);
+        }
+        catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+    }
+
+    std::vector<MicroResult> results = run(max_tris, min_time);
+    if (!write_results(out_path, results)) {
+        std::cout << "Results could not be written to " << out_path << std::endl;
+        return -1;
+    }
+    std::cout << "Results written to " << out_path << std::endl;
+
+    if (baseline_path.empty()) {
+        return 0;
+    }
+    int regressions = 0;
+    std::cout << std::fixed << std::setprecision(1);
+    for (auto& result : results) {
+        auto itr = baseline.find({ result.name, result.tris });
+        if (itr == baseline.end()) {
+            continue;
+        }
+        double change = (result.ns_per_op / itr->second - 1.0) * 100.0;
+        if (change > threshold) {
+            std::cout << "  regression: " << result.name << " (" << result.tris << " tris) " << itr->second << " -> " << result.ns_per_op
+                << " ns/op, +" << change << "%" << std::endl;
+            regressions++;
+        }
+    }
+    std::cout << regressions << " of " << results.size() << " kernels regressed by more than " << threshold << "% against " << baseline_path << std::endl;
+    return regressions == 0 ? 0 : 1;
+}
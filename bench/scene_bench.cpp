@@ -0,0 +1,584 @@
+#include "renderer.h"
+
+// GLFW is necessary to handle the OpenGL context
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+#include "context.h"
+#include "cpu_profiler.h"
+#include "mesh_data.h"
+#include "utilities.h"
+
+// renders synthetic scenes built from the editor's prototypes for a fixed number of frames along a scripted camera path, and writes
+// the cpu and gpu time of every pass, the draw counts and the memory of each scene as json
+//
+//   scene_bench [--frames N] [--warmup N] [--width W] [--height H] [--out path] [--only name] [--scene key=value,...]
+//
+// runs in a hidden window, so a machine without a display needs xvfb-run, and one without a gpu mesa's llvmpipe (LIBGL_ALWAYS_SOFTWARE=1)
+
+const std::string SCENE_BENCH_PATH = "../data/scene_bench.json";
+
+enum BenchCamera {
+    // orbits the scene once over the measured frames
+    TRACKBALL,
+    // strafes around the scene while looking at its center
+    FREE,
+
+    NUM_BENCH_CAMERAS = 2,
+};
+
+const char* const BENCH_CAMERA_NAMES[BenchCamera::NUM_BENCH_CAMERAS] = { "trackball", "free" };
+
+struct BenchScene {
+    std::string name = "custom";
+    // a MeshList prototype, laid out in a grid
+    int mesh = MeshList::BUNNY;
+    int count = 64;
+    // on a ring above the grid
+    int lights = 4;
+    // spheres with dynamic env maps, captured every frame
+    int reflectors = 0;
+    bool msaa = false;
+    bool fxaa = true;
+    bool shadows = true;
+    BenchCamera camera = BenchCamera::TRACKBALL;
+};
+
+// the default suite, each scene varies one parameter of "base"
+static std::vector<BenchScene> get_suite() {
+    return {
+        { "base", MeshList::BUNNY, 64, 4, 0, false, true, true, BenchCamera::TRACKBALL },
+        { "bunnies_1024", MeshList::BUNNY, 1024, 4, 0, false, true, true, BenchCamera::TRACKBALL },
+        { "monkeys_1024", MeshList::MONKEY, 1024, 4, 0, false, true, true, BenchCamera::TRACKBALL },
+        { "lights_30", MeshList::BUNNY, 64, 30, 0, false, true, true, BenchCamera::TRACKBALL },
+        { "reflectors_4", MeshList::BUNNY, 64, 4, 4, false, true, true, BenchCamera::TRACKBALL },
+        { "msaa", MeshList::BUNNY, 64, 4, 0, true, false, true, BenchCamera::TRACKBALL },
+        { "no_shadows", MeshList::BUNNY, 64, 4, 0, false, true, false, BenchCamera::TRACKBALL },
+        { "no_aa", MeshList::BUNNY, 64, 4, 0, false, false, true, BenchCamera::TRACKBALL },
+        { "free_camera", MeshList::BUNNY, 64, 4, 0, false, true, true, BenchCamera::FREE },
+    };
+}
+
+static const char* get_mesh_name(int mesh) {
+    switch (mesh) {
+    case MeshList::BUMPY:
+        return "bumpy";
+    case MeshList::BUNNY:
+        return "bunny";
+    case MeshList::MONKEY:
+        return "monkey";
+    default:
+        return "unknown";
+    }
+}
+
+static bool parse_bool(const std::string& value) {
+    if (value == "1" || value == "on" || value == "true") {
+        return true;
+    }
+    if (value == "0" || value == "off" || value == "false") {
+        return false;
+    }
+    throw std::runtime_error("Expected on or off, got " + value);
+}
+
+// a comma separated list of key=value pairs, the keys are the fields of BenchScene
+static BenchScene parse_scene(const std::string& spec) {
+    BenchScene scene;
+    std::stringstream ss(spec);
+    std::string pair;
+    while (std::getline(ss, pair, ',')) {
+        size_t eq = pair.find('=');
+        if (eq == std::string::npos) {
+            throw std::runtime_error("Expected key=value in the scene, got " + pair);
+        }
+        std::string key = pair.substr(0, eq);
+        std::string value = pair.substr(eq + 1);
+        if (key == "name") {
+            scene.name = value;
+        }
+        else if (key == "mesh") {
+            if (value == "bumpy") scene.mesh = MeshList::BUMPY;
+            else if (value == "bunny") scene.mesh = MeshList::BUNNY;
+            else if (value == "monkey") scene.mesh = MeshList::MONKEY;
+            else throw std::runtime_error("Unknown mesh " + value);
+        }
+        else if (key == "count") {
+            scene.count = std::stoi(value);
+        }
+        else if (key == "lights") {
+            scene.lights = std::stoi(value);
+        }
+        else if (key == "reflectors") {
+            scene.reflectors = std::stoi(value);
+        }
+        else if (key == "msaa") {
+            scene.msaa = parse_bool(value);
+        }
+        else if (key == "fxaa") {
+            scene.fxaa = parse_bool(value);
+        }
+        else if (key == "shadows") {
+            scene.shadows = parse_bool(value);
+        }
+        else if (key == "camera") {
+            if (value == "trackball") scene.camera = BenchCamera::TRACKBALL;
+            else if (value == "free") scene.camera = BenchCamera::FREE;
+            else throw std::runtime_error("Unknown camera " + value);
+        }
+        else {
+            throw std::runtime_error("Unknown scene key " + key);
+        }
+    }
+    return scene;
+}
+
+// a context holding a synthetic scene rather than the editor's
+class BenchContext : public Context {
+    float extent_;
+    // radius, theta and phi the trackball camera's path starts from
+    glm::vec3 start_orbit_;
+
+public:
+    BenchContext(int width, int height, const BenchScene& scene);
+
+    // places the camera at its pose on the path for frame of frames, independent of the frames drawn before
+    void move_camera(const BenchScene& scene, int frame, int frames);
+};
+
+BenchContext::BenchContext(int width, int height, const BenchScene& scene) :
+    // the editor's fixed render resolution
+    Context{
+        width,
+        height,
+        256,
+        256,
+    }
+{
+    const float spacing = 1.5f;
+    int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(scene.count))));
+    extent_ = std::max(side * spacing, 3.1f);
+
+    float aspect = static_cast<float>(width) / height;
+    std::unique_ptr<Camera> camera;
+    if (scene.camera == BenchCamera::TRACKBALL) {
+        camera = std::make_unique<TrackballCamera>(aspect);
+        // the radius starts at 3.1, which frames a single mesh
+        camera->zoom(Spatial::ScaleDir::Out, extent_ / 3.1f - 1.f);
+        start_orbit_ = static_cast<TrackballCamera*>(camera.get())->get_orbit();
+    }
+    else {
+        camera = std::make_unique<FreeCamera>(aspect);
+        camera->set_view(glm::lookAt(glm::vec3(0.f, extent_ * 0.5f, extent_), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f)));
+    }
+
+    PointLights point_lights;
+    for (int i = 0; i < scene.lights; i++) {
+        float angle = glm::two_pi<float>() * i / scene.lights;
+        point_lights.push_back(std::make_shared<PointLight>(glm::vec3(std::cos(angle), 0.f, std::sin(angle)) * extent_ * 0.4f + glm::vec3(0.f, 1.f, 0.f)));
+    }
+    set_env(std::make_unique<Environment>(
+        std::move(camera),
+        1920,
+        std::move(point_lights),
+        std::make_unique<Def_CubeMapEntity>()
+    ));
+    init_mesh_prototypes({ BumpyCubeMesh{}, BunnyMesh{}, MonkeyMesh{} });
+
+    push_mesh_entity({ DefMeshList::QUAD });
+    auto& inserted_quad = *(mesh_list.end() - 1);
+    inserted_quad->translate(glm::mat4{ 1.f }, glm::vec3(0.f, -1.f, 0.f));
+    inserted_quad->rotate(glm::mat4{ 1.f }, -90.f, glm::vec3(1.f, 0.f, 0.f));
+    inserted_quad->scale(glm::mat4{ 1.f }, Spatial::ScaleDir::In, 40.f);
+    inserted_quad->set_color(glm::vec3(252, 137, 42) / 256.f);
+
+    // fitted into a unit cube standing on the ground
+    auto place = [this](int id, glm::vec3 position, glm::vec3 color) -> MeshEntity& {
+        push_mesh_entity({ id });
+        MeshEntity& entity = **(mesh_list.end() - 1);
+        entity.set_to_origin();
+        entity.set_trans(glm::translate(glm::mat4{ 1.f }, position) * entity.get_trans());
+        entity.set_color(color);
+        return entity;
+    };
+    for (int i = 0; i < scene.count; i++) {
+        float x = (i % side - (side - 1) / 2.f) * spacing;
+        float z = (i / side - (side - 1) / 2.f) * spacing;
+        // spread over the hues without randomness, so that every run draws the same scene
+        float hue = (i * 0.618034f) - std::floor(i * 0.618034f);
+        place(scene.mesh, glm::vec3(x, -0.5f, z), glm::vec3(0.5f + 0.5f * hue, 0.4f, 1.f - 0.5f * hue));
+    }
+    for (int i = 0; i < scene.reflectors; i++) {
+        float angle = glm::two_pi<float>() * (i + 0.5f) / scene.reflectors;
+        MeshEntity& reflector = place(DefMeshList::SPHERE, glm::vec3(std::cos(angle), 0.f, std::sin(angle)) * extent_ * 0.25f + glm::vec3(0.f, 0.5f, 0.f), glm::vec3(1.f));
+        reflector.set_shader(ShaderPrograms::REFLECT);
+        reflector.set_dyn_reflections(true);
+        reflector.set_probe_update(ProbeUpdate::EVERY_FRAME);
+    }
+
+    msaa_use_ = scene.msaa;
+    fxaa_use_ = scene.fxaa;
+    shadows_use_ = scene.shadows;
+    // the editor's overlay, not part of the scene
+    draw_grid_ = false;
+}
+
+void BenchContext::move_camera(const BenchScene& scene, int frame, int frames) {
+    float angle = glm::two_pi<float>() * frame / frames;
+    if (scene.camera == BenchCamera::TRACKBALL) {
+        // around once, bobbing up and down twice
+        glm::vec3 orbit = start_orbit_ + glm::vec3(0.f, angle, -0.125f * std::sin(2.f * angle));
+        static_cast<TrackballCamera&>(env->camera.get_camera()).set_orbit(orbit, 1.f);
+    }
+    else {
+        // around once at the starting height and distance
+        glm::vec3 position(-extent_ * std::sin(angle), extent_ * 0.5f, extent_ * std::cos(angle));
+        env->camera->set_view(glm::lookAt(position, glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f)));
+    }
+}
+
+// milliseconds of a set of samples
+struct BenchTimes {
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+static BenchTimes get_times(std::vector<double> samples) {
+    BenchTimes times;
+    if (samples.empty()) {
+        return times;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {
+        return samples[std::min(samples.size() - 1, static_cast<size_t>(p / 100.0 * samples.size()))];
+    };
+    double sum = 0.0;
+    for (double sample : samples) {
+        sum += sample;
+    }
+    times.mean = sum / samples.size();
+    times.p50 = percentile(50.0);
+    times.p95 = percentile(95.0);
+    times.p99 = percentile(99.0);
+    times.max = samples.back();
+    return times;
+}
+
+struct BenchPass {
+    std::string name;
+    BenchTimes cpu;
+    // gpu times are missing without timer queries
+    bool has_gpu = false;
+    float gpu_mean = 0.f;
+    float gpu_p99 = 0.f;
+};
+
+struct BenchResult {
+    BenchScene scene;
+    size_t entities = 0;
+    BenchTimes frame;
+    std::vector<BenchPass> passes;
+    std::array<double, RenderCounter::NUM_RENDER_COUNTERS> counters{};
+    size_t render_target_bytes = 0;
+    // 0 where it can't be read
+    size_t rss_bytes = 0;
+};
+
+// resident memory of the process
+static size_t get_rss_bytes() {
+#ifdef __linux__
+    std::ifstream f("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    if (f >> pages >> resident) {
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+#endif
+    return 0;
+}
+
+static BenchResult run_scene(GLFWwindow* window, const BenchScene& scene, int warmup, int frames) {
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    auto ctx = std::make_unique<BenchContext>(width, height, scene);
+
+    int frame = 0;
+    auto draw_frame = [&] {
+        ctx->move_camera(scene, frame++, frames);
+        ctx->draw();
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    };
+
+    // compiles the programs, allocates the targets and captures the baked probes
+    for (int i = 0; i < warmup; i++) {
+        draw_frame();
+    }
+    glFinish();
+
+    // only the measured frames are profiled
+    ctx->gpu_profiler_ = std::make_unique<GpuProfiler>();
+    ctx->gpu_profiler_->max_samples_ = frames;
+    cpu_profiler().clear();
+    cpu_profiler().set_enabled(true);
+    render_stats().max_history_ = frames;
+    render_stats().set_enabled(true);
+
+    std::vector<double> frame_ms;
+    frame = 0;
+    for (int i = 0; i < frames; i++) {
+        auto start = std::chrono::steady_clock::now();
+        draw_frame();
+        frame_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    cpu_profiler().set_enabled(false);
+    std::vector<RenderStatsFrame> history = render_stats().get_history();
+    render_stats().set_enabled(false);
+    // the gpu times of a frame are read back GPU_PROFILER_FRAMES frames later
+    for (size_t i = 0; i < GPU_PROFILER_FRAMES; i++) {
+        draw_frame();
+    }
+
+    BenchResult result;
+    result.scene = scene;
+    result.entities = ctx->mesh_list.size();
+    result.frame = get_times(frame_ms);
+
+    std::map<std::string, std::vector<double>> zones;
+    for (auto& [thread, event] : cpu_profiler().get_events()) {
+        zones[event.name].push_back(event.duration / 1e6);
+    }
+    // in the order the graph ran them, which is the order the gpu profiler saw them in
+    for (auto& stats : ctx->gpu_profiler_->get_stats()) {
+        BenchPass pass;
+        pass.name = stats.name;
+        pass.cpu = get_times(zones[stats.name]);
+        pass.has_gpu = true;
+        pass.gpu_mean = stats.mean;
+        pass.gpu_p99 = stats.p99;
+        result.passes.push_back(pass);
+    }
+    if (!ctx->gpu_profiler_->is_supported()) {
+        for (auto& name : { "shadows", "reflections", "scene", "resolve", "post" }) {
+            if (!zones[name].empty()) {
+                result.passes.push_back({ name, get_times(zones[name]) });
+            }
+        }
+    }
+
+    for (auto& stats : history) {
+        for (size_t i = 0; i < stats.counters.size(); i++) {
+            result.counters[i] += static_cast<double>(stats.counters[i]) / history.size();
+        }
+    }
+    result.render_target_bytes = ctx->render_targets_.get_stats().bytes;
+    result.rss_bytes = get_rss_bytes();
+    return result;
+}
+
+static void write_times(std::ostream& f, const BenchTimes& times) {
+    f << "{\"mean\":" << times.mean << ",\"p50\":" << times.p50 << ",\"p95\":" << times.p95 << ",\"p99\":" << times.p99 << ",\"max\":" << times.max << "}";
+}
+
+static bool write_results(const std::string& path, const std::vector<BenchResult>& results, int width, int height, int warmup, int frames) {
+    std::error_code error;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, error);
+    }
+
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream f(tmp_path, std::ios::trunc);
+        if (!f) {
+            return false;
+        }
+        auto gl_string = [](GLenum name) {
+            const GLubyte* str = glGetString(name);
+            return str == nullptr ? std::string() : std::string(reinterpret_cast<const char*>(str));
+        };
+        f << std::fixed << std::setprecision(4);
+        // times in milliseconds, counters are the mean per frame
+        f << "{\n\"renderer\":\"" << gl_string(GL_RENDERER) << "\",\"gl_version\":\"" << gl_string(GL_VERSION) << "\""
+            << ",\"width\":" << width << ",\"height\":" << height << ",\"warmup\":" << warmup << ",\"frames\":" << frames << ",\n\"scenes\":[";
+        bool first = true;
+        for (auto& result : results) {
+            const BenchScene& scene = result.scene;
+            f << (first ? "" : ",") << "\n{\"name\":\"" << scene.name << "\",\"mesh\":\"" << get_mesh_name(scene.mesh) << "\",\"count\":" << scene.count
+                << ",\"lights\":" << scene.lights << ",\"reflectors\":" << scene.reflectors << ",\"msaa\":" << (scene.msaa ? "true" : "false")
+                << ",\"fxaa\":" << (scene.fxaa ? "true" : "false") << ",\"shadows\":" << (scene.shadows ? "true" : "false")
+                << ",\"camera\":\"" << BENCH_CAMERA_NAMES[scene.camera] << "\",\"entities\":" << result.entities;
+            f << ",\n \"frame_ms\":";
+            write_times(f, result.frame);
+            f << ",\n \"passes\":[";
+            for (size_t i = 0; i < result.passes.size(); i++) {
+                const BenchPass& pass = result.passes[i];
+                f << (i == 0 ? "" : ",") << "\n  {\"name\":\"" << pass.name << "\",\"cpu_ms\":";
+                write_times(f, pass.cpu);
+                if (pass.has_gpu) {
+                    f << ",\"gpu_ms\":{\"mean\":" << pass.gpu_mean << ",\"p99\":" << pass.gpu_p99 << "}";
+                }
+                else {
+                    f << ",\"gpu_ms\":null";
+                }
+                f << "}";
+            }
+            f << "],\n \"counters\":{";
+            for (int i = 0; i < RenderCounter::NUM_RENDER_COUNTERS; i++) {
+                f << (i == 0 ? "" : ",") << "\"" << RENDER_COUNTER_NAMES[i] << "\":" << result.counters[i];
+            }
+            f << "},\n \"memory\":{\"render_target_bytes\":" << result.render_target_bytes << ",\"rss_bytes\":" << result.rss_bytes << "}}";
+            first = false;
+        }
+        f << "\n]}\n";
+        if (!f) {
+            return false;
+        }
+    }
+    return replace_file(tmp_path, path);
+}
+
+int main(int argc, char** argv)
+{
+    int frames = 300;
+    int warmup = 30;
+    int width = 1280;
+    int height = 720;
+    std::string out_path = SCENE_BENCH_PATH;
+    std::string only;
+    std::vector<BenchScene> scenes;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing the value of " + arg);
+            }
+            std::string value = argv[++i];
+            if (arg == "--frames") {
+                frames = std::stoi(value);
+            }
+            else if (arg == "--warmup") {
+                warmup = std::stoi(value);
+            }
+            else if (arg == "--width") {
+                width = std::stoi(value);
+            }
+            else if (arg == "--height") {
+                height = std::stoi(value);
+            }
+            else if (arg == "--out") {
+                out_path = value;
+            }
+            else if (arg == "--only") {
+                only = value;
+            }
+            else if (arg == "--scene") {
+                scenes.push_back(parse_scene(value));
+            }
+            else {
+                throw std::runtime_error("Unknown argument " + arg);
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        std::cout << "usage: " << argv[0] << " [--frames N] [--warmup N] [--width W] [--height H] [--out path] [--only name] [--scene key=value,...]" << std::endl;
+        return -1;
+    }
+    if (frames <= 0) {
+        std::cout << "--frames must be positive" << std::endl;
+        return -1;
+    }
+    // the scenes given on the command line replace the suite
+    if (scenes.empty()) {
+        scenes = get_suite();
+    }
+    if (!only.empty()) {
+        scenes.erase(std::remove_if(scenes.begin(), scenes.end(), [&only](const BenchScene& scene) {
+            return scene.name != only;
+        }), scenes.end());
+    }
+
+    if (!glfwInit())
+        return -1;
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    GLFWwindow* window = glfwCreateWindow(width, height, "Scene Benchmark", NULL, NULL);
+    if (!window)
+    {
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    // swaps don't wait for vsync
+    glfwSwapInterval(0);
+
+#ifndef __APPLE__
+    glewExperimental = true;
+    GLenum err = glewInit();
+    if (GLEW_OK != err)
+    {
+        fprintf(stderr, "Error: %s\n", glewGetErrorString(err));
+        return -1;
+    }
+    glGetError(); // pull and savely ignonre unhandled errors like GL_INVALID_ENUM
+#endif
+    std::cout << "Benchmarking on " << glGetString(GL_RENDERER) << ", " << frames << " frames per scene" << std::endl;
+
+    // every zone of the measured frames is kept
+    cpu_profiler().events_per_thread_ = 1 << 20;
+
+    std::vector<BenchResult> results;
+    for (auto& scene : scenes) {
+        BenchResult result = run_scene(window, scene, warmup, frames);
+        std::cout << std::fixed << std::setprecision(2) << "  " << std::left << std::setw(16) << scene.name << std::right
+            << " frame mean " << result.frame.mean << " ms, p99 " << result.frame.p99 << " ms, "
+            << result.counters[RenderCounter::DRAW_CALLS] << " draw calls" << std::defaultfloat << std::endl;
+        results.push_back(result);
+    }
+
+    int pix_width, pix_height;
+    glfwGetFramebufferSize(window, &pix_width, &pix_height);
+    if (!write_results(out_path, results, pix_width, pix_height, warmup, frames)) {
+        std::cout << "Results could not be written to " << out_path << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    std::cout << "Results written to " << out_path << std::endl;
+
+    glfwTerminate();
+    return 0;
+}
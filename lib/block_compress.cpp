@@ -0,0 +1,169 @@
+#include "block_compress.h"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+
+#include "thread_pool.h"
+
+// block rows encoded per worker task
+constexpr int BC1_ROWS_PER_TASK = 16;
+
+constexpr int NUM_BLOCK_TEXELS = BC1_BLOCK_WIDTH * BC1_BLOCK_WIDTH;
+
+static uint16_t pack_565(const float color[3]) {
+    int r = static_cast<int>(std::lround(std::clamp(color[0], 0.f, 255.f) * 31.f / 255.f));
+    int g = static_cast<int>(std::lround(std::clamp(color[1], 0.f, 255.f) * 63.f / 255.f));
+    int b = static_cast<int>(std::lround(std::clamp(color[2], 0.f, 255.f) * 31.f / 255.f));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void unpack_565(uint16_t packed, int color[3]) {
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// the endpoints are the extremes of the texels along their principal axis
+static void encode_block(const float texels[NUM_BLOCK_TEXELS][3], uint8_t* block) {
+    float mean[3] = { 0.f, 0.f, 0.f };
+    for (int i = 0; i < NUM_BLOCK_TEXELS; i++) {
+        for (int c = 0; c < 3; c++) {
+            mean[c] += texels[i][c];
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        mean[c] /= NUM_BLOCK_TEXELS;
+    }
+
+    float cov[3][3] = {};
+    for (int i = 0; i < NUM_BLOCK_TEXELS; i++) {
+        float d[3] = { texels[i][0] - mean[0], texels[i][1] - mean[1], texels[i][2] - mean[2] };
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) {
+                cov[r][c] += d[r] * d[c];
+            }
+        }
+    }
+
+    // a few power iterations are enough to find the dominant axis of 16 texels
+    float axis[3] = { 1.f, 1.f, 1.f };
+    for (int iter = 0; iter < 4; iter++) {
+        float next[3];
+        for (int r = 0; r < 3; r++) {
+            next[r] = cov[r][0] * axis[0] + cov[r][1] * axis[1] + cov[r][2] * axis[2];
+        }
+        float len = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (len < 1e-6f) {
+            break;
+        }
+        for (int c = 0; c < 3; c++) {
+            axis[c] = next[c] / len;
+        }
+    }
+
+    float t_min = 0.f, t_max = 0.f;
+    for (int i = 0; i < NUM_BLOCK_TEXELS; i++) {
+        float t = (texels[i][0] - mean[0]) * axis[0] + (texels[i][1] - mean[1]) * axis[1] + (texels[i][2] - mean[2]) * axis[2];
+        t_min = std::min(t_min, t);
+        t_max = std::max(t_max, t);
+    }
+    float end0[3], end1[3];
+    for (int c = 0; c < 3; c++) {
+        end0[c] = mean[c] + axis[c] * t_max;
+        end1[c] = mean[c] + axis[c] * t_min;
+    }
+
+    // color0 > color1 selects the four color mode
+    uint16_t color0 = pack_565(end0);
+    uint16_t color1 = pack_565(end1);
+    if (color0 < color1) {
+        std::swap(color0, color1);
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        int palette[4][3];
+        unpack_565(color0, palette[0]);
+        unpack_565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < NUM_BLOCK_TEXELS; i++) {
+            uint32_t best = 0;
+            float best_dist = INFINITY;
+            for (uint32_t p = 0; p < 4; p++) {
+                float dr = texels[i][0] - palette[p][0], dg = texels[i][1] - palette[p][1], db = texels[i][2] - palette[p][2];
+                float dist = dr * dr + dg * dg + db * db;
+                if (dist < best_dist) {
+                    best_dist = dist;
+                    best = p;
+                }
+            }
+            indices |= best << (i * 2);
+        }
+    }
+
+    block[0] = color0 & 0xff;
+    block[1] = color0 >> 8;
+    block[2] = color1 & 0xff;
+    block[3] = color1 >> 8;
+    for (int b = 0; b < 4; b++) {
+        block[4 + b] = (indices >> (b * 8)) & 0xff;
+    }
+}
+
+void encode_bc1(const uint8_t* texels, int width, uint8_t* blocks, int first_row, int last_row) {
+    int blocks_wide = (width + BC1_BLOCK_WIDTH - 1) / BC1_BLOCK_WIDTH;
+    float block_texels[NUM_BLOCK_TEXELS][3];
+    for (int by = first_row; by < last_row; by++) {
+        for (int bx = 0; bx < blocks_wide; bx++) {
+            for (int y = 0; y < BC1_BLOCK_WIDTH; y++) {
+                int src_y = std::min(by * BC1_BLOCK_WIDTH + y, width - 1);
+                for (int x = 0; x < BC1_BLOCK_WIDTH; x++) {
+                    int src_x = std::min(bx * BC1_BLOCK_WIDTH + x, width - 1);
+                    const uint8_t* texel = texels + (src_y * width + src_x) * 3;
+                    for (int c = 0; c < 3; c++) {
+                        block_texels[y * BC1_BLOCK_WIDTH + x][c] = texel[c];
+                    }
+                }
+            }
+            encode_block(block_texels, blocks + (by * blocks_wide + bx) * BC1_BLOCK_SIZE);
+        }
+    }
+}
+
+void compress_bc1(CubeMapImage& image) {
+    if (image.format == BC1) {
+        return;
+    }
+
+    CubeMapImage compressed;
+    compressed.width = image.width;
+    compressed.format = BC1;
+    std::vector<std::future<void>> tasks;
+    for (size_t face = 0; face < NUM_CUBE_FACES; face++) {
+        // sized up front so that the levels handed to the workers never move
+        compressed.faces[face].resize(image.get_levels());
+        for (int level = 0; level < image.get_levels(); level++) {
+            int width = image.get_level_width(level);
+            int blocks_wide = (width + BC1_BLOCK_WIDTH - 1) / BC1_BLOCK_WIDTH;
+            const std::vector<uint8_t>& src = image.faces[face][level];
+            std::vector<uint8_t>& dst = compressed.faces[face][level];
+            dst.resize(compressed.get_level_size(level));
+            // each task writes its own block rows so no locking is needed
+            for (int row = 0; row < blocks_wide; row += BC1_ROWS_PER_TASK) {
+                int last_row = std::min(row + BC1_ROWS_PER_TASK, blocks_wide);
+                tasks.push_back(worker_pool().submit([&src, &dst, width, row, last_row] {
+                    encode_bc1(src.data(), width, dst.data(), row, last_row);
+                }));
+            }
+        }
+    }
+    for (auto& task : tasks) {
+        task.get();
+    }
+    image = std::move(compressed);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+#include "texture_cache.h"
+
+constexpr int BC1_BLOCK_WIDTH = 4;
+constexpr size_t BC1_BLOCK_SIZE = 8;
+
+// encodes block rows [first_row, last_row) of a width x width rgb8 level into bc1 blocks
+// texels past the edge of levels narrower than a block repeat the last row and column
+void encode_bc1(const uint8_t* texels, int width, uint8_t* blocks, int first_row, int last_row);
+
+// encodes every face and level of an rgb8 image into bc1, in bands of block rows on the worker pool
+void compress_bc1(CubeMapImage& image);
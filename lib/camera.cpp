@@ -34,7 +34,25 @@ float Camera::get_up() {
 
 glm::mat4 Camera::get_projection() const {
     // return projection_mode_ == Projection::Perspective ? glm::perspective(glm::radians(fov_), aspect_, 0.1f, 100.f) : glm::ortho((aspect_ <= 1 ? -aspect_ : -1.0f), (aspect_ <= 1 ? aspect_ : 1.0f), (aspect_ > 1 ? -1.f/aspect_ : -1.0f), (aspect_ > 1 ? 1.f/aspect_ : 1.0f), 0.1f, 100.f);
-    return projection_mode_ == Projection::Perspective ? glm::perspective(glm::radians(fov_), aspect_, 0.001f, 100.f) : glm::ortho(-aspect_, aspect_, -1.f, 1.f, 0.001f, 100.f);
+    glm::mat4 projection = projection_mode_ == Projection::Perspective ? glm::perspective(glm::radians(fov_), aspect_, 0.001f, 100.f) : glm::ortho(-aspect_, aspect_, -1.f, 1.f, 0.001f, 100.f);
+    if (!clip_plane_.has_value()) {
+        return projection;
+    }
+
+    // oblique near plane (Lengyel). the far plane is skewed so that it still bounds the frustum
+    glm::vec4 plane = glm::transpose(glm::inverse(get_view())) * clip_plane_.value();
+    glm::vec4 corner = glm::inverse(projection) * glm::vec4(glm::sign(plane.x), glm::sign(plane.y), 1.f, 1.f);
+    glm::vec4 near_row = plane * (2.f / glm::dot(plane, corner));
+    for (int col = 0; col < 4; col++) {
+        projection[col][2] = near_row[col] - projection[col][3];
+    }
+    return projection;
+}
+void Camera::set_clip_plane(glm::vec4 plane) {
+    clip_plane_ = plane;
+}
+void Camera::clear_clip_plane() {
+    clip_plane_.reset();
 }
 glm::mat4 Camera::get_view() const {
     return trans_;
@@ -130,6 +148,18 @@ void TrackballCamera::update_trans() {
     }
 }
 
+glm::vec3 TrackballCamera::get_orbit() const {
+    return glm::vec3(radius_, theta_, phi_);
+}
+void TrackballCamera::set_orbit(glm::vec3 orbit, float up) {
+    radius_ = orbit.x;
+    theta_ = orbit.y;
+    phi_ = orbit.z;
+    up_ = up;
+    ortho_scale_ = glm::vec3(1.f);
+    update_trans();
+}
+
 void TrackballCamera::zoom(ScaleDir zoom_dir, float percent) {
     // TODO: limit zoom in
 
@@ -6,6 +6,7 @@
 
 #include <memory>
 #include <chrono>
+#include <optional>
 
 #include "definitions.h"
 #include "renderer.h"
@@ -31,6 +32,9 @@ protected:
 
     Projection projection_mode_;
 
+    // world space plane replacing the near plane when set, used for planar reflections
+    std::optional<glm::vec4> clip_plane_;
+
 public:
     friend class RenderCamera;
 
@@ -53,6 +57,9 @@ public:
     virtual void set_aspect(float aspect);
     virtual void set_aspect(int width, int height);
     virtual void set_fov(float fov);
+    // clips everything behind the plane (dot(plane, pos) < 0) with an oblique near plane
+    void set_clip_plane(glm::vec4 plane);
+    void clear_clip_plane();
     virtual void set_position(glm::vec3 new_pos) {
         trans_[3] = glm::inverse(trans_) * glm::vec4(new_pos, 1.0);
     }
@@ -120,6 +127,10 @@ public:
     virtual void scale_view(ScaleDir zoom_dir, float percent = 0.2) override;
 
     void update_trans();
+    // radius, theta and phi
+    glm::vec3 get_orbit() const;
+    // rebuilds the transform around the origin, the ortho zoom is reset
+    void set_orbit(glm::vec3 orbit, float up);
 };
 
 // stores a Camera or descendent type and necessary gl info to bind to the appropriate uniforms such as the view and projection matrix transforms
@@ -1,6 +1,13 @@
+#include <algorithm>
 #include <cmath>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <unordered_set>
 
 #include "context.h"
+#include "cpu_profiler.h"
 
 void MouseContext::hold() {
     held_ = true;
@@ -65,10 +72,17 @@ Context::Context(int width, int height, int base_width, int base_height) :
 
     auto aspect = base_width / (static_cast<float>(width) / height);
     main_fbo_ = std::make_unique<FBO>(0, width, height);
-    offscreen_fbo_ = std::make_unique<Offscreen_FBO>(base_width, aspect);
-    offscreen_fbo_msaa_ = std::make_unique<Offscreen_FBO_Multisample>(base_width, aspect);
-    depth_fbo_ = std::make_unique<Depth_FBO>(1024, 1024);
+    offscreen_width_ = base_width;
+    offscreen_height_ = aspect;
     debug_shadows_ = std::make_unique<DebugShadows>();
+
+    gpu_profiler_ = std::make_unique<GpuProfiler>();
+    render_graph_.on_pass_begin_ = [this](const std::string& name) {
+        gpu_profiler_->begin_pass(name);
+    };
+    render_graph_.on_pass_end_ = [this](const std::string& name) {
+        gpu_profiler_->end_pass(name);
+    };
 }
 
 void Context::set_env(std::unique_ptr<Environment>&& new_env) {
@@ -77,6 +91,7 @@ void Context::set_env(std::unique_ptr<Environment>&& new_env) {
     for (auto& point_light : env->point_lights_) {
         mesh_list.push_back(point_light);
     }
+    begin_prewarm();
 }
 
 void Context::set_viewport(int width, int height) {
@@ -88,18 +103,29 @@ void Context::set_viewport(int width, int height) {
         int height_ = base_width_ / aspect;
         int base_height = base_width_ * 1.f / base_aspect;
         int width_ = base_height * aspect;
+        // the targets of the new size are allocated by the pool when next drawn
         if (width_ < height_) {
-            offscreen_fbo_->resize(width_, base_height);
-            offscreen_fbo_msaa_->resize(width_, base_height);
+            offscreen_width_ = width_;
+            offscreen_height_ = base_height;
         }
         else {
-            offscreen_fbo_->resize(base_width_, height_);
-            offscreen_fbo_msaa_->resize(base_width_, height_);
+            offscreen_width_ = base_width_;
+            offscreen_height_ = height_;
         }
         main_fbo_->resize(width, height);
     }
 }
 
+void Context::print_gpu_stats() const {
+    gpu_profiler_->print();
+}
+
+void Context::print_render_target_stats() const {
+    RenderTargetStats stats = render_targets_.get_stats();
+    std::cout << "render targets: " << stats.targets << " allocated (" << stats.bytes / 1024 << " KB), " << stats.in_use << " in use" << std::endl;
+    std::cout << "  last frame: " << stats.acquires << " acquired, " << stats.allocations << " allocated, " << stats.frees << " freed" << std::endl;
+}
+
 int Context::intersected_mesh_perspective(glm::vec3 world_ray) const {
     float min_dist = std::numeric_limits<float>::infinity();
     int closest = -1;
@@ -129,6 +155,7 @@ int Context::intersected_mesh_ortho(glm::vec3 world_pos) const {
     return closest;
 }
 void Context::select(glm::vec2 cursor_pos, float width, float height) {
+    PROFILE_ZONE("Context::select");
     if (env->camera->get_projection_mode() == Camera::Projection::Ortho) {
         glm::vec3 pos_world = env->camera->get_pos_world(cursor_pos, width, height);
         select_ortho(pos_world);
@@ -175,8 +202,6 @@ Optional<MeshEntity> Context::get_selected() {
 }
 
 void Context::update(std::chrono::duration<float> delta) {
-    renderer->reload();
-
     if (mouse_ctx.is_held()) {
         glm::vec2 old_point = mouse_ctx.get_prev_position();
         glm::vec2 new_point = mouse_ctx.get_position();
@@ -185,11 +210,185 @@ void Context::update(std::chrono::duration<float> delta) {
 }
 
 void Context::init_mesh_prototypes(std::vector<Mesh>&& meshes) {
+    PROFILE_ZONE("Context::init_mesh_prototypes");
     MESH_FACTORY->push(meshes);
 }
 void Context::push_mesh_entity(std::vector<int>&& ids) {
     for (const auto& id : ids) {
         mesh_list.push_back(std::make_shared<MeshEntity>(MESH_FACTORY->get_mesh_entity(id)));
+        if (journal_) {
+            journal_->touch(*mesh_list.back());
+        }
+    }
+}
+
+SceneEntity Context::capture_entity(MeshEntity& mesh_entity) {
+    SceneEntity record{};
+    record.trans = mesh_entity.get_trans();
+    record.color = mesh_entity.get_color();
+    record.shader = mesh_entity.get_shader();
+    record.draw_mode = mesh_entity.get_draw_mode();
+    record.probe_update = mesh_entity.get_probe_update();
+    record.env_projection = mesh_entity.get_env_projection();
+    record.dyn_reflections = mesh_entity.get_dyn_reflections();
+    record.shadows = mesh_entity.get_variant().shadows;
+    record.pcf_size = mesh_entity.get_variant().pcf_size;
+    return record;
+}
+
+ScenePointLight Context::capture_point_light(PointLight& point_light, bool selectable) {
+    const LightTraits& traits = point_light.light_traits_;
+    ScenePointLight record{};
+    record.trans = point_light.get_trans();
+    record.mesh_color = point_light.get_color();
+    record.ambient_color = traits.ambient_.color_;
+    record.ambient = traits.ambient_.strength_;
+    record.diffuse_color = traits.diffuse_.color_;
+    record.diffuse = traits.diffuse_.strength_;
+    record.specular_color = traits.specular_.color_;
+    record.specular = traits.specular_.strength_;
+    record.shininess = traits.shininess_;
+    record.constant = point_light.attenuation_.constant;
+    record.linear = point_light.attenuation_.linear;
+    record.quadratic = point_light.attenuation_.quadratic;
+    record.selectable = selectable;
+    return record;
+}
+
+std::vector<SceneProbe> Context::capture_probes() {
+    std::vector<SceneProbe> probes;
+    for (auto& probe : env->reflection_probes_) {
+        probes.push_back({ probe->get_position(), probe->get_influence_radius() });
+    }
+    return probes;
+}
+
+SceneCamera Context::capture_camera() {
+    Camera& camera = env->camera.get_camera();
+    auto trackball = dynamic_cast<TrackballCamera*>(&camera);
+    SceneCamera record{};
+    record.trans = camera.get_trans();
+    record.orbit = trackball != nullptr ? trackball->get_orbit() : glm::vec3(0.f);
+    record.up = camera.get_up();
+    record.fov = camera.get_fov();
+    record.kind = trackball != nullptr ? SceneCameraKind::TRACKBALL_CAMERA : SceneCameraKind::FREE_CAMERA;
+    record.projection = camera.get_projection_mode();
+    return record;
+}
+
+SceneData Context::capture_scene() {
+    PROFILE_ZONE("Context::capture_scene");
+    SceneData scene;
+
+    // index into scene.prototypes of each prototype of the factory, added the first time an entity references it
+    const std::vector<uint64_t>& hashes = MESH_FACTORY->get_hashes();
+    std::vector<uint32_t> prototypes(hashes.size(), std::numeric_limits<uint32_t>::max());
+
+    // point lights are in the mesh list too, they are stored with the other lights
+    std::unordered_set<const MeshEntity*> selectable_lights;
+    scene.entities.reserve(mesh_list.size());
+    for (auto& mesh_entity : mesh_list) {
+        if (dynamic_cast<PointLight*>(mesh_entity.get()) != nullptr) {
+            selectable_lights.insert(mesh_entity.get());
+            continue;
+        }
+        size_t id = mesh_entity->get_id();
+        if (prototypes[id] == std::numeric_limits<uint32_t>::max()) {
+            prototypes[id] = static_cast<uint32_t>(scene.prototypes.size());
+            scene.prototypes.push_back(hashes[id]);
+        }
+        SceneEntity& record = scene.entities.emplace_back(capture_entity(*mesh_entity));
+        record.prototype = prototypes[id];
+    }
+
+    for (auto& point_light : env->point_lights_) {
+        scene.point_lights.push_back(capture_point_light(*point_light, selectable_lights.count(point_light.get()) != 0));
+    }
+
+    scene.probes = capture_probes();
+    scene.camera = capture_camera();
+    scene.environment.dir_light_trans = env->dir_light_.get_trans();
+    return scene;
+}
+
+void Context::apply_scene(const SceneData& scene) {
+    PROFILE_ZONE("Context::apply_scene");
+    // checked up front, so that a scene that can't be applied leaves the current one as it was
+    const std::vector<uint64_t>& hashes = MESH_FACTORY->get_hashes();
+    std::vector<size_t> prototypes;
+    prototypes.reserve(scene.prototypes.size());
+    for (uint64_t hash : scene.prototypes) {
+        auto itr = std::find(hashes.begin(), hashes.end(), hash);
+        if (itr == hashes.end()) {
+            throw std::runtime_error("Error applying scene, it references a mesh that isn't loaded");
+        }
+        prototypes.push_back(itr - hashes.begin());
+    }
+    for (const SceneEntity& record : scene.entities) {
+        if (record.shader < ShaderPrograms::DEF_SHADER || record.shader >= ShaderPrograms::DEF_SHADER + ShaderPrograms::NUM_SHADERS
+            || record.draw_mode < 0 || record.draw_mode >= DrawMode::NUM_DRAWMODES
+            || record.probe_update < 0 || record.probe_update >= ProbeUpdate::NUM_PROBE_UPDATES
+            || record.env_projection < 0 || record.env_projection >= EnvProjection::NUM_ENV_PROJECTIONS
+            || record.pcf_size < 1 || record.pcf_size > 7 || record.pcf_size % 2 == 0) {
+            throw std::runtime_error("Error applying scene, an entity has an unknown mode");
+        }
+    }
+
+    deselect();
+    mesh_list.clear();
+    mesh_list.reserve(scene.entities.size() + scene.point_lights.size());
+    for (const SceneEntity& record : scene.entities) {
+        auto mesh_entity = std::make_shared<MeshEntity>(MESH_FACTORY->get_mesh_entity(prototypes[record.prototype]));
+        mesh_entity->set_trans(record.trans);
+        mesh_entity->set_color(record.color);
+        mesh_entity->set_shader(static_cast<ShaderPrograms>(record.shader));
+        mesh_entity->set_draw_mode(static_cast<DrawMode>(record.draw_mode));
+        mesh_entity->set_probe_update(static_cast<ProbeUpdate>(record.probe_update));
+        mesh_entity->set_env_projection(static_cast<EnvProjection>(record.env_projection));
+        mesh_entity->set_dyn_reflections(record.dyn_reflections != 0);
+        ShaderVariant variant = mesh_entity->get_variant();
+        variant.shadows = record.shadows != 0;
+        variant.pcf_size = record.pcf_size;
+        mesh_entity->set_variant(variant);
+        mesh_list.push_back(std::move(mesh_entity));
+    }
+
+    env->point_lights_.clear();
+    for (const ScenePointLight& record : scene.point_lights) {
+        auto point_light = std::make_shared<PointLight>(glm::vec3(0.f), LightTraits(glm::vec3(1.f), 0.1, 1.0, 1.0, 7), Attenuation{ record.constant, record.linear, record.quadratic });
+        point_light->set_trans(record.trans);
+        point_light->MeshEntity::set_color(record.mesh_color);
+        LightTraits& traits = point_light->light_traits_;
+        traits.ambient_ = LightTrait(record.ambient_color, record.ambient);
+        traits.diffuse_ = LightTrait(record.diffuse_color, record.diffuse);
+        traits.specular_ = LightTrait(record.specular_color, record.specular);
+        traits.shininess_ = record.shininess;
+        env->point_lights_.push_back(point_light);
+        if (record.selectable != 0) {
+            mesh_list.push_back(point_light);
+        }
+    }
+
+    env->clear_reflection_probes();
+    for (const SceneProbe& record : scene.probes) {
+        env->add_reflection_probe(record.position);
+        env->reflection_probes_.back()->set_influence_radius(record.influence_radius);
+    }
+
+    env->dir_light_.set_trans(scene.environment.dir_light_trans);
+    // the scene's light class and entity keys may bind other variants
+    begin_prewarm();
+}
+
+void Context::apply_camera(const SceneCamera& scene_camera) {
+    Camera& camera = env->camera.get_camera();
+    camera.set_projection_mode(scene_camera.projection == Camera::Projection::Ortho ? Camera::Projection::Ortho : Camera::Projection::Perspective);
+    camera.set_fov(scene_camera.fov);
+    if (auto trackball = dynamic_cast<TrackballCamera*>(&camera)) {
+        trackball->set_orbit(scene_camera.orbit, scene_camera.up);
+    }
+    else {
+        camera.set_trans(scene_camera.trans);
     }
 }
 
@@ -207,7 +406,6 @@ void Context::draw_selected_to_stencil(MeshEntity& mesh_entity) {
 
 void Context::draw_selected(MeshEntity& mesh_entity) {
     glEnable(GL_STENCIL_TEST);
-    ShaderPrograms selected = mesh_entity.get_shader();
     renderer->bind(ShaderPrograms::OUTLINE);
     Uniform aspect("u_aspect");
     aspect.buffer(env->camera->get_aspect());
@@ -224,34 +422,31 @@ void Context::draw_selected(MeshEntity& mesh_entity) {
     glDisable(GL_STENCIL_TEST);
     // glCullFace(GL_BACK);
     glEnable(GL_CULL_FACE);
-    renderer->bind(selected);
 }
 
+// every draw binds its own program, so the entity's base program is never bound and only its variant is compiled
 void Context::draw_w_mode(MeshEntity& mesh_entity) {
-    renderer->bind(mesh_entity.get_shader());
-    env->camera.buffer();
     if (mesh_entity.get_draw_mode() != DrawMode::WIREFRAME_ONLY) {
         draw_surfaces(mesh_entity);
     }
     if (mesh_entity.get_draw_mode() == DrawMode::WIREFRAME || mesh_entity.get_draw_mode() == DrawMode::WIREFRAME_ONLY) {
         draw_wireframe(mesh_entity);
     }
-    else if (mesh_entity.get_draw_mode() == DrawMode::DRAW_NORMALS) {
+    // the normals program has its own geometry shader and no layered variant so they are left out of layered captures
+    else if (mesh_entity.get_draw_mode() == DrawMode::DRAW_NORMALS && !renderer->get_layered()) {
         draw_normals(mesh_entity);
     }
 }
-void Context::draw(FBO& main_fbo, MeshEntity& mesh_entity, MeshEntityList& mesh_entities) {
-    if (mesh_entity.get_dyn_reflections() && (mesh_entity.get_shader() == ShaderPrograms::REFLECT || mesh_entity.get_shader() == ShaderPrograms::REFRACT)) {
-        env->draw_dynamic_cubemap(main_fbo, mesh_entity, mesh_entities, [&](MeshEntity& sec_mesh) {
-            draw_w_mode(sec_mesh);
-            });
+void Context::bind_env_map(MeshEntity& mesh_entity) {
+    if (mesh_entity.is_dyn_env_mapped()) {
+        env->bind_dynamic(mesh_entity);
     }
-    else if (mesh_entity.get_shader() == ShaderPrograms::REFLECT || mesh_entity.get_shader() == ShaderPrograms::REFRACT) {
+    else if (mesh_entity.is_env_mapped()) {
         env->bind_static();
     }
-    // else {
-    //     env->depth_fbo_->get_tex().bind();
-    // }
+}
+void Context::draw(MeshEntity& mesh_entity) {
+    bind_env_map(mesh_entity);
     draw_static(mesh_entity);
 }
 
@@ -287,103 +482,210 @@ void Context::draw_grid() {
 }
 
 void Context::draw() {
-    FBO* draw_fbo = offscreen_fbo_.get();
-    if (msaa_use_) {
-        draw_fbo = offscreen_fbo_msaa_.get();
-    }
-    draw_fbo->bind();
-    // main_fbo_->bind();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    PROFILE_ZONE("Context::draw");
+    // applies shader changes once per frame rather than once per fixed update
+    renderer->reload();
 
-    depth_fbo_->bind();
-    // env->draw_shadows(main_fbo_, mesh_list);
-    env->draw_shadows(*draw_fbo, mesh_list);
-    // depth_fbo_->unbind(*main_fbo_.get());
-    depth_fbo_->unbind(*draw_fbo);
+    render_targets_.begin_frame();
+    gpu_profiler_->begin_frame();
+    RenderGraph& graph = render_graph_;
+    graph.reset();
+
+    RenderGraph::Resource window = graph.import("window", *main_fbo_, true);
+    RenderGraph::Resource offscreen = graph.create("offscreen", { COLOR_DEPTH_STENCIL, offscreen_width_, offscreen_height_, 0 });
+    // the scene is drawn to the msaa target and resolved into the offscreen target when msaa is on
+    RenderGraph::Resource scene = msaa_use_ ? graph.create("scene_msaa", { COLOR_DEPTH_STENCIL, offscreen_width_, offscreen_height_, 4 }) : offscreen;
+    // without shadows there's no shadow map to allocate or draw
+    std::optional<RenderGraph::Resource> shadow_map;
+    depth_fbo_ = nullptr;
+    if (shadows_use_) {
+        shadow_map = graph.create("shadow_map", { DEPTH, shadow_map_size_, shadow_map_size_, 0 });
+    }
 
     // swap selected to end of drawing list
     uint32_t selected_idx = mesh_list.size() - 1.0;
     swap_selected_mesh(selected_idx);
-    for (auto& mesh_entity : mesh_list) {
-        draw(*draw_fbo, *mesh_entity, mesh_list);
-        // draw(main_fbo_, *mesh_entity, mesh_list);
+
+    if (shadow_map.has_value()) {
+        graph.add_pass("shadows", [&](RenderGraph::PassBuilder& pass) {
+            pass.write(shadow_map.value(), DISCARD);
+        }, [&] {
+            depth_fbo_ = &graph.get<Depth_FBO>(shadow_map.value());
+            depth_fbo_->bind();
+            env->draw_shadows(*depth_fbo_, mesh_list);
+        });
     }
 
-    env->draw_static_scene();
+    // the captures rebind the scene target when done, and the planar reflections are sized by it
+    graph.add_pass("reflections", [&](RenderGraph::PassBuilder& pass) {
+        if (shadow_map.has_value()) {
+            pass.read(shadow_map.value());
+        }
+        pass.write(scene, CLEAR);
+    }, [&] {
+        FBO& draw_fbo = graph.get(scene);
+        env->draw_dynamic_cubemaps(draw_fbo, mesh_list, [&](MeshEntity& sec_mesh) {
+            bind_env_map(sec_mesh);
+            draw_w_mode(sec_mesh);
+            });
+        env->draw_planar_reflections(draw_fbo, render_targets_, mesh_list, [&](MeshEntity& sec_mesh) {
+            bind_env_map(sec_mesh);
+            draw_w_mode(sec_mesh);
+            });
+    });
+
+    graph.add_pass("scene", [&](RenderGraph::PassBuilder& pass) {
+        if (shadow_map.has_value()) {
+            pass.read(shadow_map.value());
+        }
+        pass.write(scene);
+    }, [&] {
+        graph.get(scene).bind();
+        for (auto& mesh_entity : mesh_list) {
+            draw(*mesh_entity);
+        }
+        env->draw_static_scene();
+    });
 
     if (msaa_use_) {
-        draw_fbo->unbind(*offscreen_fbo_.get());
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-        draw_fbo->blit(*offscreen_fbo_.get());
+        graph.add_pass("resolve", [&](RenderGraph::PassBuilder& pass) {
+            pass.read(scene);
+            pass.write(offscreen, DISCARD);
+        }, [&] {
+            graph.get(scene).blit(graph.get(offscreen));
+        });
     }
 
-    draw_offscreen(*offscreen_fbo_.get());
-
+    // drawn into the offscreen target against the scene's stencil, so that fxaa smooths it in the post pass
     if (get_selected().has_value()) {
-        auto& mesh_entity = *mesh_list[selected_idx];
-        draw_selected(mesh_entity);
-    }
+        graph.add_pass("outline", [&](RenderGraph::PassBuilder& pass) {
+            pass.write(offscreen);
+        }, [&] {
+            graph.get(offscreen).bind();
+            draw_selected(*mesh_list[selected_idx]);
+        });
+    }
+
+    // depth and stencil are blitted for the grid, the color is written by the post pass
+    graph.add_pass("post", [&](RenderGraph::PassBuilder& pass) {
+        pass.read(offscreen);
+        pass.write(window, DISCARD);
+    }, [&] {
+        Offscreen_FBO& offscreen_fbo = graph.get<Offscreen_FBO>(offscreen);
+        offscreen_fbo.blit(*main_fbo_, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        draw_offscreen(offscreen_fbo);
+    });
 
-    offscreen_fbo_->unbind(*main_fbo_.get());
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    offscreen_fbo_->blit(*main_fbo_.get());
-    if (fxaa_use_) {
-        draw_fxaa(*offscreen_fbo_.get());
+    if (draw_grid_) {
+        graph.add_pass("grid", [&](RenderGraph::PassBuilder& pass) {
+            pass.write(window);
+        }, [&] {
+            draw_grid();
+        });
     }
 
-    if (draw_grid_) {
-        draw_grid();
+    if (debug_depth_map_ && shadow_map.has_value()) {
+        graph.add_pass("debug_depth_map", [&](RenderGraph::PassBuilder& pass) {
+            pass.read(shadow_map.value());
+            pass.write(window);
+        }, [&] {
+            draw_depth_map();
+        });
     }
 
-    if (debug_depth_map_) {
-        draw_depth_map();
+    if (gpu_overlay_) {
+        graph.add_pass("gpu_overlay", [&](RenderGraph::PassBuilder& pass) {
+            pass.write(window);
+        }, [&] {
+            main_fbo_->bind();
+            gpu_profiler_->draw_overlay(main_fbo_->get_width(), main_fbo_->get_height());
+        });
     }
+
+    graph.execute(render_targets_);
+    render_stats().end_frame();
+
+    // after the frame, so that a program used for the first time this frame never waited on an unrelated compile
+    renderer->prewarm();
+}
+
+int Context::get_post_features() const {
+    int features = 0;
+    if (fxaa_use_) features |= POST_FXAA;
+    if (fog_use_) features |= POST_FOG;
+    if (vignette_use_) features |= POST_VIGNETTE;
+    if (bw_use_) features |= POST_BW;
+    return features;
 }
 
 void Context::draw_offscreen(Offscreen_FBO& draw_fbo) {
+    renderer->set_post_features(get_post_features());
+
     draw_fbo.bind_offscreen();
-    // glDepthFunc(GL_ALWAYS);
+    // only declared by the fxaa permutation
+    glUniform1f(renderer->uniform("inverseScreenSize.x"), 1.f / draw_fbo.get_width());
+    glUniform1f(renderer->uniform("inverseScreenSize.y"), 1.f / draw_fbo.get_height());
     glDisable(GL_DEPTH_TEST); // not writing to depth in shader
     auto quad = MESH_FACTORY->get_mesh_entity(DefMeshList::QUAD);
     quad.draw_none();
-    // glDepthFunc(GL_LEQUAL);
     glEnable(GL_DEPTH_TEST);
 }
 
-void Context::draw_fxaa(Offscreen_FBO& draw_fbo) {
-    renderer->bind(ShaderPrograms::FXAA);
-    Uniform("u_offscreen_tex").buffer(0);
-    draw_fbo.get_tex().bind(GL_TEXTURE0);
-    glDisable(GL_DEPTH_TEST); // not writing to depth in shader
-    auto quad = MESH_FACTORY->get_mesh_entity(DefMeshList::QUAD);
-    Uniform("inverseScreenSize.x").buffer(1.f / draw_fbo.get_width());
-    Uniform("inverseScreenSize.y").buffer(1.f / draw_fbo.get_height());
-    quad.draw_none();
-    // glDepthFunc(GL_LEQUAL);
-    glEnable(GL_DEPTH_TEST);
+ShaderVariant Context::get_variant(MeshEntity& mesh_entity) {
+    return get_variant(mesh_entity.get_variant());
+}
+ShaderVariant Context::get_variant(ShaderVariant variant) {
+    variant.shadows = variant.shadows && shadows_use_;
+    variant.light_class = get_light_class(env->point_lights_.size());
+    variant.debug_shadows = debug_shadows_->debug_;
+    return variant;
+}
+
+void Context::begin_prewarm() {
+    std::vector<std::pair<ShaderPrograms, ShaderVariant>> variants;
+    // the variants of entities spawned with the default keys, and of the entities in the scene
+    for (ShaderPrograms shader : { ShaderPrograms::PHONG, ShaderPrograms::FLAT, ShaderPrograms::REFLECT, ShaderPrograms::REFRACT }) {
+        variants.push_back({ shader, get_variant(ShaderVariant{}) });
+    }
+    for (auto& mesh_entity : mesh_list) {
+        variants.push_back({ mesh_entity->get_shader(), get_variant(*mesh_entity) });
+    }
+    ShaderVariant post;
+    post.post_features = get_post_features();
+    variants.push_back({ ShaderPrograms::OFFSCREEN, post });
+    renderer->begin_prewarm(variants);
 }
 
 void Context::draw_surfaces(MeshEntity& mesh_entity) {
-    renderer->bind(mesh_entity.get_shader());
+    ShaderVariant variant = get_variant(mesh_entity);
+    renderer->bind(mesh_entity.get_shader(), variant);
+    env->camera.buffer();
     // TODO: check if shader has attached uniform at compile time elsewhere
-    if (mesh_entity.get_shader() == ShaderPrograms::PHONG || mesh_entity.get_shader() == ShaderPrograms::FLAT || mesh_entity.get_shader() == ShaderPrograms::REFLECT || mesh_entity.get_shader() == ShaderPrograms::REFRACT) {
+    if (mesh_entity.get_shader() == ShaderPrograms::PHONG || mesh_entity.get_shader() == ShaderPrograms::FLAT || mesh_entity.is_env_mapped()) {
         // bind the depth map as well for env mapped objs
         env->buffer_lights();
-        env->buffer_shadows();
-        debug_shadows_->buffer();
-    }
-    if (mesh_entity.get_shader() == ShaderPrograms::REFLECT || mesh_entity.get_shader() == ShaderPrograms::REFRACT) {
-        // * don't need to bind the cubemap texture here because it is already bound after rendering to it
-        depth_fbo_->get_tex().bind(GL_TEXTURE1); // bind the depthmap to the second texture slot
-        Uniform("u_skybox").buffer(0);
-        Uniform("u_shadow_map").buffer(1);
+        // the shadow uniforms are compiled out of variants without shadows
+        if (variant.shadows) {
+            env->buffer_shadows();
+        }
+    }
+    if (mesh_entity.is_env_mapped()) {
+        // * don't need to bind the cubemap texture here because it is already bound by bind_env_map
+        // the shadow map is only sampled by variants with shadows, and only exists while they're in use
+        if (variant.shadows && depth_fbo_ != nullptr) {
+            depth_fbo_->get_tex().bind(GL_TEXTURE1); // bind the depthmap to the second texture slot
+            glUniform1i(renderer->uniform("u_shadow_map"), 1);
+        }
+        env->buffer_env_map();
         glCullFace(GL_BACK);
         mesh_entity.draw_minimal();
     }
     else {
         mesh_entity.draw();
     }
-    depth_fbo_->get_tex().bind(); // bind back to first texture slot
+    if (depth_fbo_ != nullptr) {
+        depth_fbo_->get_tex().bind(); // bind back to first texture slot
+    }
 }
 void Context::draw_surfaces() {
     for (auto& mesh : mesh_list) {
@@ -391,8 +693,6 @@ void Context::draw_surfaces() {
     }
 }
 void Context::draw_wireframe(MeshEntity& mesh_entity) {
-    ShaderPrograms selected = mesh_entity.get_shader();
-
     renderer->bind(ShaderPrograms::DEF_SHADER);
 
     if (env->camera->get_projection_mode() == Camera::Projection::Perspective) {
@@ -412,8 +712,6 @@ void Context::draw_wireframe(MeshEntity& mesh_entity) {
         mesh_entity.draw_wireframe();
         mesh_entity.set_trans(old_trans);
     }
-
-    renderer->bind(selected);
 }
 void Context::draw_wireframes() {
     for (auto& mesh : mesh_list) {
@@ -421,8 +719,6 @@ void Context::draw_wireframes() {
     }
 }
 void Context::draw_normals(MeshEntity& mesh_entity) {
-    ShaderPrograms selected = mesh_entity.get_shader();
-
     renderer->bind(ShaderPrograms::NORMALS);;
     env->camera.buffer();
 
@@ -431,8 +727,6 @@ void Context::draw_normals(MeshEntity& mesh_entity) {
     mesh_entity.draw();
     mesh_entity.set_color(temp);
 
-    renderer->bind(selected);
-
     draw_wireframe(mesh_entity);
 }
 void Context::draw_normals() {
@@ -442,6 +736,9 @@ void Context::draw_normals() {
 }
 
 void Context::draw_depth_map() {
+    if (depth_fbo_ == nullptr) {
+        return;
+    }
     // debug quad
     glDisable(GL_DEPTH_TEST);
     renderer->bind(ShaderPrograms::SHADOW_MAP);
@@ -8,6 +8,12 @@
 #include "mesh.h"
 
 #include "environment.h"
+#include "frame_monitor.h"
+#include "gpu_profiler.h"
+#include "render_target_pool.h"
+#include "render_graph.h"
+#include "scene_file.h"
+#include "scene_journal.h"
 
 #ifdef DEBUG
 #include <iostream>
@@ -63,14 +69,36 @@ public:
 
     MouseContext mouse_ctx;
 
+    // autosaves the edits to a journal, empty unless autosave is enabled
+    std::unique_ptr<SceneJournal> journal_;
+
     std::unique_ptr<FBO> main_fbo_;
-    std::unique_ptr<Offscreen_FBO> offscreen_fbo_;
-    std::unique_ptr<Offscreen_FBO_Multisample> offscreen_fbo_msaa_;
+    // offscreen, msaa, shadow and planar reflection targets are acquired from the pool every frame
+    RenderTargetPool render_targets_;
+    // passes of the frame, rebuilt by draw
+    RenderGraph render_graph_;
+    // times the passes of the graph on the gpu
+    std::unique_ptr<GpuProfiler> gpu_profiler_;
+    // draws the pass times over the frame
+    bool gpu_overlay_ = false;
+    // percentiles of the frame times, fed by the main loop
+    FrameMonitor frame_monitor_{ FRAME_LOG_PATH };
+    // size of the offscreen targets, follows the window's aspect
+    int offscreen_width_;
+    int offscreen_height_;
 
     bool msaa_use_ = false;
+    // post processing effects, each combination is its own permutation of the post program
     bool fxaa_use_ = true;
+    bool fog_use_ = false;
+    bool vignette_use_ = false;
+    bool bw_use_ = false;
     
-    std::unique_ptr<Depth_FBO> depth_fbo_;
+    // without shadows the shadow map isn't allocated or drawn and the lit programs don't sample it
+    bool shadows_use_ = true;
+    int shadow_map_size_ = 1024;
+    // shadow map of the frame being drawn, null without shadows
+    Depth_FBO* depth_fbo_ = nullptr;
 
     bool draw_grid_ = true;
     bool debug_depth_map_ = false;
@@ -100,6 +128,19 @@ public:
     // adds a mesh entity to mesh_list. these are references to the prototypes in mesh_factory
     void push_mesh_entity(std::vector<int>&& ids);
 
+    // the record of an entity, its prototype is left to the caller
+    static SceneEntity capture_entity(MeshEntity& mesh_entity);
+    static ScenePointLight capture_point_light(PointLight& point_light, bool selectable);
+    std::vector<SceneProbe> capture_probes();
+    SceneCamera capture_camera();
+    // the entities, point lights, probes and camera as stored in scene files. the environment's cube map is left to the caller
+    SceneData capture_scene();
+    // replaces the entities, point lights and probes with the scene's. the camera is restored separately by apply_camera
+    // throws, leaving the scene as it was, if it references a mesh that isn't a prototype
+    void apply_scene(const SceneData& scene);
+    // restores the projection and placement of the camera without changing its type
+    void apply_camera(const SceneCamera& scene_camera);
+
     // frame by frame updates. call prior to drawing
     void update(std::chrono::duration<float> delta);
     // updates and draws the model using the user bound shader program and the selected draw mode
@@ -110,8 +151,17 @@ public:
     void draw_static(MeshEntity& mesh_entity);
     // draws a model based on its mode
     void draw_w_mode(MeshEntity& mesh_entity);
-    // draws a model when other model's state's are also necessary; such as dynamic reflections
-    void draw(FBO& main_fbo, MeshEntity& mesh_entity, MeshEntityList& mesh_entity_list);
+    // binds the static or dynamic env map of an env mapped model
+    void bind_env_map(MeshEntity& mesh_entity);
+    // binds the model's env map and draws it
+    void draw(MeshEntity& mesh_entity);
+    // the model's shader variant with the keys that depend on the scene, such as the number of point lights
+    ShaderVariant get_variant(MeshEntity& mesh_entity);
+    ShaderVariant get_variant(ShaderVariant variant);
+    // PostFeatures of the enabled effects
+    int get_post_features() const;
+    // starts compiling the programs as the variants the scene binds them with, e.g. the lit programs of its light class
+    void begin_prewarm();
     // draws the model using the user bound shader program
     void draw_surfaces(MeshEntity& mesh_entity);
     // draws a wireframe above the mesh
@@ -125,9 +175,11 @@ public:
     // draws the mesh normals
     void draw_normals();
     void draw_depth_map();
+    // post processes draw_fbo into the bound target with the enabled effects in a single pass
     void draw_offscreen(Offscreen_FBO& draw_fbo);
-    void draw_fxaa(Offscreen_FBO& draw_fbo);
 
     void set_viewport(int width, int height);
+    void print_render_target_stats() const;
+    void print_gpu_stats() const;
     void set_env(std::unique_ptr<Environment>&& env);
 };
\ No newline at end of file
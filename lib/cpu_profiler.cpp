@@ -0,0 +1,115 @@
+#include "cpu_profiler.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "utilities.h"
+
+CpuProfiler::CpuProfiler() : epoch_(std::chrono::steady_clock::now()) {}
+
+void CpuProfiler::set_enabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+int64_t CpuProfiler::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_).count();
+}
+
+std::shared_ptr<ProfileThread> CpuProfiler::add_thread() {
+    auto thread = std::make_shared<ProfileThread>();
+    thread->events.resize(events_per_thread_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    thread->id = threads_.size();
+    threads_.push_back(thread);
+    return thread;
+}
+
+ProfileThread& CpuProfiler::get_thread() {
+    thread_local std::shared_ptr<ProfileThread> thread = add_thread();
+    return *thread;
+}
+
+const char* CpuProfiler::intern(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return names_.insert(name).first->c_str();
+}
+
+void CpuProfiler::push(ProfileThread& thread, const ProfileEvent& event) {
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    thread.events[thread.next % thread.events.size()] = event;
+    thread.next++;
+}
+
+void CpuProfiler::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& thread : threads_) {
+        std::lock_guard<std::mutex> thread_lock(thread->mutex);
+        thread->next = 0;
+    }
+}
+
+// zone names are identifiers and pass names, only quotes and backslashes need escaping
+static std::string escape_json(const char* str) {
+    std::string escaped;
+    for (; *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\') {
+            escaped += '\\';
+        }
+        escaped += *str;
+    }
+    return escaped;
+}
+
+std::vector<std::pair<uint32_t, ProfileEvent>> CpuProfiler::get_events() {
+    std::vector<std::pair<uint32_t, ProfileEvent>> events;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& thread : threads_) {
+        std::lock_guard<std::mutex> thread_lock(thread->mutex);
+        size_t size = thread->events.size();
+        size_t count = std::min(thread->next, size);
+        for (size_t i = thread->next - count; i < thread->next; i++) {
+            events.push_back({ thread->id, thread->events[i % size] });
+        }
+    }
+    return events;
+}
+
+bool CpuProfiler::export_trace(const std::string& path) {
+    std::vector<std::pair<uint32_t, ProfileEvent>> events = get_events();
+
+    std::error_code error;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, error);
+    }
+
+    // written next to the trace and renamed over it, like the program cache
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream f(tmp_path, std::ios::trunc);
+        if (!f) {
+            return false;
+        }
+        f << std::fixed << std::setprecision(3);
+        f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        for (auto& [id, event] : events) {
+            // complete events, timestamps in microseconds
+            f << (first ? "" : ",") << "\n{\"name\":\"" << escape_json(event.name) << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << id
+                << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << ",\"args\":{\"depth\":" << event.depth << "}}";
+            first = false;
+        }
+        f << "\n]}\n";
+        if (!f) {
+            return false;
+        }
+    }
+    if (!replace_file(tmp_path, path)) {
+        return false;
+    }
+    std::cout << "CPU trace of " << events.size() << " zones written to " << path << std::endl;
+    return true;
+}
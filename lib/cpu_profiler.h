@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+const std::string TRACE_PATH = "../data/trace.json";
+
+// a closed zone
+struct ProfileEvent {
+    const char* name;
+    // nanoseconds since the profiler was created
+    int64_t start;
+    int64_t duration;
+    // number of zones it is nested in
+    uint32_t depth;
+};
+
+// the zones of one thread, kept in a ring so that a running profiler never allocates
+// only its own thread writes to it, the mutex is uncontended except while a trace is exported
+struct ProfileThread {
+    std::mutex mutex;
+    std::vector<ProfileEvent> events;
+    size_t next = 0;
+    uint32_t id = 0;
+    // zones open on the thread, only used by the thread itself
+    uint32_t depth = 0;
+};
+
+// collects the scoped zones of every thread. disabled it costs a zone one relaxed load
+class CpuProfiler {
+    std::atomic<bool> enabled_{ false };
+    std::chrono::steady_clock::time_point epoch_;
+
+    std::mutex mutex_;
+    // kept after their threads exit, so that their zones can still be exported
+    std::vector<std::shared_ptr<ProfileThread>> threads_;
+    // names of zones that aren't string literals, such as the render graph's passes. node based, so the pointers stay valid
+    std::unordered_set<std::string> names_;
+
+    std::shared_ptr<ProfileThread> add_thread();
+
+public:
+    // zones each thread keeps, the oldest are overwritten. read when a thread records its first zone
+    size_t events_per_thread_ = 1 << 14;
+
+    CpuProfiler();
+
+    bool is_enabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+    void set_enabled(bool enabled);
+
+    int64_t now() const;
+    // the calling thread's ring, created on first use
+    ProfileThread& get_thread();
+    // a pointer to the name that lives as long as the profiler
+    const char* intern(const std::string& name);
+    void push(ProfileThread& thread, const ProfileEvent& event);
+
+    // drops every recorded zone
+    void clear();
+    // the recorded zones with the id of their thread, oldest first for each thread
+    std::vector<std::pair<uint32_t, ProfileEvent>> get_events();
+    // writes the recorded zones as chrome trace event json, which perfetto and chrome://tracing open
+    bool export_trace(const std::string& path);
+};
+
+// shared profiler of every thread
+inline CpuProfiler& cpu_profiler() {
+    static CpuProfiler profiler;
+    return profiler;
+}
+
+// records the time from its construction to its destruction as a zone, if the profiler is enabled when it is constructed
+class ProfileZone {
+    ProfileThread* thread_ = nullptr;
+    const char* name_;
+    int64_t start_;
+
+public:
+    ProfileZone(const char* name) : name_(name) {
+        CpuProfiler& profiler = cpu_profiler();
+        if (name == nullptr || !profiler.is_enabled()) {
+            return;
+        }
+        thread_ = &profiler.get_thread();
+        thread_->depth++;
+        start_ = profiler.now();
+    }
+    // names that aren't string literals are interned, which only happens while the profiler is enabled
+    ProfileZone(const std::string& name) : ProfileZone(cpu_profiler().is_enabled() ? cpu_profiler().intern(name) : nullptr) {}
+    ~ProfileZone() {
+        if (thread_ == nullptr) {
+            return;
+        }
+        CpuProfiler& profiler = cpu_profiler();
+        thread_->depth--;
+        profiler.push(*thread_, { name_, start_, profiler.now() - start_, thread_->depth });
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// profiles the rest of the enclosing scope
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__){ name }
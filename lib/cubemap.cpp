@@ -1,5 +1,15 @@
 #include "cubemap.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <exception>
+#include <future>
+
+#include "block_compress.h"
+#include "thread_pool.h"
+#include "utilities.h"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -81,32 +91,214 @@ uint32_t CubeMapEntity::gl_decode_face(const std::string& path_name) {
     return gl_decode_face(parse_path_name(path_name));
 }
 
-void CubeMapEntity::init(const std::string& dir_path, bool flip) {
-    bind();
+std::string CubeMapEntity::cache_path(const std::string& dir_path) {
+    std::string path = dir_path;
+    while (!path.empty() && (path.back() == '/' || path.back() == '\\')) {
+        path.pop_back();
+    }
+    return path + ".cache";
+}
+
+CubeMapImage CubeMapEntity::decode(const std::vector<std::filesystem::path>& face_paths, bool flip) {
+    if (face_paths.size() != NUM_CUBE_FACES) {
+        throw std::runtime_error("Error loading cube map, expected 6 faces");
+    }
 
-    stbi_set_flip_vertically_on_load(flip);
-    for (auto& tex_path : std::filesystem::directory_iterator(dir_path)) {
-        int n_chan;
-        unsigned char* data = stbi_load(tex_path.path().string().c_str(), &width_, &width_, &n_chan, 0);
-        if (data) {
-            glTexImage2D(
-                gl_decode_face(tex_path.path().string()),
-                0, GL_RGB, width_, width_, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-            );
+    // every face has to appear once, two files of the same face would leave another one empty
+    std::array<bool, NUM_CUBE_FACES> seen{};
+    std::vector<size_t> faces;
+    for (auto& face_path : face_paths) {
+        size_t face = gl_decode_face(face_path.string()) - GL_TEXTURE_CUBE_MAP_POSITIVE_X;
+        if (seen[face]) {
+            throw std::runtime_error("Error loading cube map, duplicate face " + face_path.string());
         }
-        else {
+        seen[face] = true;
+        faces.push_back(face);
+    }
+
+    // each face is decoded on its own worker and returned by value, the image is only written on this thread
+    struct DecodedFace {
+        int width;
+        std::vector<uint8_t> texels;
+    };
+    std::vector<std::future<DecodedFace>> decoded;
+    for (auto& face_path : face_paths) {
+        decoded.push_back(worker_pool().submit([face_path, flip] {
+            int width, height, n_chan;
+            // the global stbi flip flag isn't thread safe, rows are flipped below instead
+            unsigned char* data = stbi_load(face_path.string().c_str(), &width, &height, &n_chan, 3);
+            if (data == nullptr || width != height) {
+                stbi_image_free(data);
+                throw std::runtime_error("Error loading texture data for cube map");
+            }
+            size_t row_size = width * 3;
+            std::vector<uint8_t> texels(data, data + row_size * height);
             stbi_image_free(data);
-            throw std::runtime_error("Error loading texture data for cube map");
+            if (flip) {
+                for (int y = 0; y < height / 2; y++) {
+                    std::swap_ranges(texels.begin() + y * row_size, texels.begin() + (y + 1) * row_size, texels.begin() + (height - 1 - y) * row_size);
+                }
+            }
+            return DecodedFace{ width, std::move(texels) };
+        }));
+    }
+
+    // every worker is waited for before an error is rethrown
+    CubeMapImage image;
+    std::exception_ptr error;
+    for (size_t i = 0; i < decoded.size(); i++) {
+        try {
+            DecodedFace face = decoded[i].get();
+            if (image.width != 0 && image.width != face.width) {
+                throw std::runtime_error("Error loading cube map, faces differ in size");
+            }
+            image.width = face.width;
+            image.faces[faces[i]] = { std::move(face.texels) };
         }
-        stbi_image_free(data);
+        catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
     }
-    stbi_set_flip_vertically_on_load(false);
+    return image;
+}
+
+void CubeMapEntity::upload(const CubeMapImage& image, size_t first_face, size_t num_faces) {
+    size_t last_face = std::min(first_face + num_faces, NUM_CUBE_FACES);
+    size_t size = 0;
+    for (size_t face = first_face; face < last_face; face++) {
+        for (auto& level : image.faces[face]) {
+            size += level.size();
+        }
+    }
+
+    width_ = image.width;
+    height_ = image.width;
+    bind();
+
+    // stage every face and level in one pixel buffer so that the driver can copy them asynchronously
+    uint32_t pbo;
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    uint8_t* staging = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (staging == nullptr) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &pbo);
+        throw std::runtime_error("Error mapping pixel buffer for cube map");
+    }
+    size_t offset = 0;
+    for (size_t face = first_face; face < last_face; face++) {
+        for (auto& level : image.faces[face]) {
+            std::copy(level.begin(), level.end(), staging + offset);
+            offset += level.size();
+        }
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // rgb rows aren't 4 byte aligned for every width
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    offset = 0;
+    for (size_t face = first_face; face < last_face; face++) {
+        for (int level = 0; level < image.get_levels(); level++) {
+            int level_width = image.get_level_width(level);
+            if (image.format == BC1) {
+                glCompressedTexImage2D(
+                    GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                    level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, level_width, level_width, 0, image.get_level_size(level), reinterpret_cast<void*>(offset)
+                );
+            }
+            else {
+                glTexImage2D(
+                    GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                    level, GL_RGB, level_width, level_width, 0, GL_RGB, GL_UNSIGNED_BYTE, reinterpret_cast<void*>(offset)
+                );
+            }
+            offset += image.faces[face][level].size();
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &pbo);
 
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, image.get_levels() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, image.get_levels() - 1);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // restores the cull face set by bind, uploads can happen between draws
+    unbind();
+
+#ifdef DEBUG
+    check_gl_error();
+#endif
+}
+
+bool CubeMapEntity::supports_compression() {
+    return GLEW_EXT_texture_compression_s3tc;
+}
+
+CubeMapImage CubeMapEntity::load_image(const std::string& dir_path, bool flip, bool mips, bool compress) {
+#ifdef DEBUG
+    auto start = std::chrono::steady_clock::now();
+#endif
+    // the cache is keyed by the face files and the decode options, editing a face invalidates it
+    std::vector<std::filesystem::path> face_paths;
+    size_t key = 0;
+    for (auto& entry : std::filesystem::directory_iterator(dir_path)) {
+        face_paths.push_back(entry.path());
+    }
+    std::sort(face_paths.begin(), face_paths.end());
+    for (auto& face_path : face_paths) {
+        hash_combine(key, face_path.filename().string());
+        hash_combine(key, static_cast<size_t>(std::filesystem::file_size(face_path)));
+        hash_combine(key, static_cast<int64_t>(std::filesystem::last_write_time(face_path).time_since_epoch().count()));
+    }
+    hash_combine(key, flip);
+    hash_combine(key, mips);
+    // a cache built for a driver without bc1 is rebuilt compressed on one that has it, and vice versa
+    compress = compress && supports_compression();
+    hash_combine(key, compress);
+
+    TextureCache cache{ cache_path(dir_path), key };
+    std::optional<CubeMapImage> image = cache.load();
+    bool cached = image.has_value();
+    if (!cached) {
+        image = decode(face_paths, flip);
+        if (mips) {
+            gen_mips(image.value());
+        }
+        if (compress) {
+            compress_bc1(image.value());
+        }
+        if (!cache.save(image.value())) {
+#ifdef DEBUG
+            std::cout << "Texture cache could not be written: " << cache.get_path() << std::endl;
+#endif
+        }
+    }
+
+#ifdef DEBUG
+    std::cout << "Loaded cube map " << dir_path << (cached ? " from cache" : "") << " in " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+    if (image->format == BC1) {
+        size_t rgb8_vram = 0;
+        for (int level = 0; level < image->get_levels(); level++) {
+            rgb8_vram += NUM_CUBE_FACES * image->get_level_width(level) * image->get_level_width(level) * 4;
+        }
+        std::cout << "  BC1 " << image->get_vram() / 1024 << " KB of VRAM, saves " << (rgb8_vram - image->get_vram()) / 1024 << " KB over RGB8" << std::endl;
+    }
+#endif
+    return std::move(image.value());
+}
+
+void CubeMapEntity::init(const std::string& dir_path, bool flip, bool mips, bool compress) {
+    upload(load_image(dir_path, flip, mips, compress));
 }
 
 void CubeMapEntity::draw() {
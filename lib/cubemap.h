@@ -3,11 +3,13 @@
 #include <string>
 #include <filesystem>
 #include <functional>
+#include <vector>
 
 #include "renderer.h"
 #include "texture.h"
 #include "mesh.h"
 #include "camera.h"
+#include "texture_cache.h"
 
 const std::string DEF_CUBE_MAP_DIR_PATH = "../data/day_sky_env/";
 
@@ -54,20 +56,34 @@ protected:
 public:
     CubeMapLoader() : cube_entity_(MESH_FACTORY->get_mesh_entity(DefMeshList::CUBE)) {}
 
-    virtual void init(const std::string& dir_path, bool flip = false) = 0;
+    virtual void init(const std::string& dir_path, bool flip = false, bool mips = false, bool compress = true) = 0;
 };
 
 class CubeMapEntity : public CubeMapTex, public CubeMapLoader {
     // decode the face into the gl equivelant
     static uint32_t gl_decode_face(CubeMapFace face);
     // parse and decode the full path name into the gl equivelant
-    uint32_t gl_decode_face(const std::string& path_name);
+    static uint32_t gl_decode_face(const std::string& path_name);
+
+    // decoded texel cache of the env map in dir_path, stored next to the directory
+    static std::string cache_path(const std::string& dir_path);
+    // decodes the faces in parallel on the worker pool
+    static CubeMapImage decode(const std::vector<std::filesystem::path>& face_paths, bool flip);
 
 public:
-    CubeMapEntity(const std::string& dir_path, bool flip = false) { init(dir_path, flip); }
+    CubeMapEntity(const std::string& dir_path, bool flip = false, bool mips = false, bool compress = true) { init(dir_path, flip, mips, compress); }
     CubeMapEntity() {}
 
-    void init(const std::string& dir_path, bool flip = false) override;
+    // whether the driver can sample bc1 textures
+    static bool supports_compression();
+    // loads the texels from the texture cache when it is up to date, otherwise decodes the faces and writes the cache. mips are generated when the cache is built
+    // compress stores the texels as bc1 when the driver supports it, rgb8 otherwise
+    // makes no gl calls so it can run on a background thread
+    static CubeMapImage load_image(const std::string& dir_path, bool flip = false, bool mips = false, bool compress = true);
+    void init(const std::string& dir_path, bool flip = false, bool mips = false, bool compress = true) override;
+    // uploads num_faces faces starting at first_face, with all their levels, through a pixel buffer
+    // the cube map is complete once all six faces are uploaded, which lets uploads be spread across frames
+    void upload(const CubeMapImage& image, size_t first_face = 0, size_t num_faces = NUM_CUBE_FACES);
     void draw();
 };
 
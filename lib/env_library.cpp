@@ -0,0 +1,184 @@
+#include "env_library.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+bool EnvLibrary::Entry::is_resident() const {
+    return cube_map != nullptr;
+}
+bool EnvLibrary::Entry::is_complete() const {
+    return is_resident() && uploaded_faces == NUM_CUBE_FACES;
+}
+
+EnvLibrary::EnvLibrary(std::initializer_list<EnvSource> sources) {
+    for (auto& source : sources) {
+        entries_.push_back(Entry{ source });
+    }
+}
+
+std::unique_ptr<CubeMapEntity> EnvLibrary::load_active(size_t i) {
+    Entry& entry = entries_.at(i);
+    CubeMapImage image = CubeMapEntity::load_image(entry.source.dir_path, entry.source.flip, entry.source.mips, entry.source.compress);
+    auto cube_map = std::make_unique<CubeMapEntity>();
+    cube_map->upload(image);
+
+    entry.vram = image.get_vram();
+    entry.last_used = frame_;
+    active_ = i;
+    return cube_map;
+}
+
+void EnvLibrary::request_switch(size_t i) {
+    if (i >= entries_.size()) {
+        throw std::runtime_error("Environment " + std::to_string(i) + " is not in the library");
+    }
+    if (i == active_) {
+        pending_.reset();
+    } else {
+        // requested explicitly, so a load that failed before is tried again
+        entries_[i].failed = false;
+        pending_ = i;
+    }
+}
+
+void EnvLibrary::request_next() {
+    request_switch((pending_.value_or(active_) + 1) % entries_.size());
+}
+
+void EnvLibrary::prefetch(size_t i) {
+    Entry& entry = entries_[i];
+    if (i == active_ || entry.failed || entry.is_resident() || entry.image.has_value() || entry.loading.valid()) {
+        return;
+    }
+    // not on the worker pool, decoding waits on the pool for its faces
+    entry.loading = std::async(std::launch::async, CubeMapEntity::load_image, entry.source.dir_path, entry.source.flip, entry.source.mips, entry.source.compress);
+}
+
+void EnvLibrary::poll() {
+    for (size_t i = 0; i < entries_.size(); i++) {
+        Entry& entry = entries_[i];
+        if (!entry.loading.valid() || (!blocking_ && entry.loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready)) {
+            continue;
+        }
+        try {
+            entry.image = entry.loading.get();
+        }
+        catch (const std::exception& e) {
+            std::cout << "Environment " << entry.source.dir_path << " failed to load: " << e.what() << std::endl;
+            entry.failed = true;
+            if (pending_ == i) {
+                pending_.reset();
+            }
+        }
+    }
+}
+
+std::vector<size_t> EnvLibrary::get_candidates() const {
+    std::vector<size_t> candidates;
+    size_t from = pending_.value_or(active_);
+    for (size_t k = 1; k < entries_.size() && candidates.size() < prefetch_count_; k++) {
+        size_t i = (from + k) % entries_.size();
+        if (i != active_) {
+            candidates.push_back(i);
+        }
+    }
+    return candidates;
+}
+
+void EnvLibrary::upload() {
+    std::optional<size_t> target;
+    if (pending_.has_value() && entries_[pending_.value()].image.has_value()) {
+        target = pending_;
+    } else {
+        // candidates are only uploaded ahead of a switch while there's room in the budget
+        for (size_t i : get_candidates()) {
+            Entry& entry = entries_[i];
+            if (entry.image.has_value() && (entry.is_resident() || get_vram_usage() + entry.image.value().get_vram() <= vram_budget_)) {
+                target = i;
+                break;
+            }
+        }
+    }
+    if (!target.has_value()) {
+        return;
+    }
+
+    Entry& entry = entries_[target.value()];
+    if (!entry.is_resident()) {
+        entry.cube_map = std::make_unique<CubeMapEntity>();
+        entry.uploaded_faces = 0;
+        entry.vram = entry.image.value().get_vram();
+    }
+    entry.cube_map->upload(entry.image.value(), entry.uploaded_faces, faces_per_frame_);
+    entry.uploaded_faces = std::min(entry.uploaded_faces + faces_per_frame_, NUM_CUBE_FACES);
+    entry.last_used = frame_;
+    if (entry.is_complete()) {
+        entry.image.reset();
+    }
+}
+
+void EnvLibrary::evict() {
+    while (get_vram_usage() > vram_budget_) {
+        Entry* lru = nullptr;
+        for (size_t i = 0; i < entries_.size(); i++) {
+            Entry& entry = entries_[i];
+            if (i == active_ || i == pending_ || !entry.is_resident()) {
+                continue;
+            }
+            if (lru == nullptr || entry.last_used < lru->last_used) {
+                lru = &entry;
+            }
+        }
+        if (lru == nullptr) {
+            return;
+        }
+        // the texture cache on disk makes reloading it later cheap
+        lru->cube_map.reset();
+        lru->image.reset();
+        lru->uploaded_faces = 0;
+        lru->vram = 0;
+    }
+}
+
+void EnvLibrary::update(Environment& env) {
+    frame_++;
+    entries_[active_].last_used = frame_;
+
+    poll();
+    if (pending_.has_value()) {
+        prefetch(pending_.value());
+    }
+    for (size_t i : get_candidates()) {
+        prefetch(i);
+    }
+    upload();
+
+    if (pending_.has_value() && entries_[pending_.value()].is_complete()) {
+        size_t target = pending_.value();
+        // the environment takes the target's texture and hands back the previously active one
+        env.swap_cube_map(entries_[target].cube_map);
+        std::swap(entries_[active_].cube_map, entries_[target].cube_map);
+        active_ = target;
+        entries_[active_].last_used = frame_;
+        pending_.reset();
+    }
+    evict();
+}
+
+size_t EnvLibrary::get_active() const {
+    return active_;
+}
+
+size_t EnvLibrary::get_size() const {
+    return entries_.size();
+}
+
+size_t EnvLibrary::get_vram_usage() const {
+    size_t usage = 0;
+    for (auto& entry : entries_) {
+        usage += entry.vram;
+    }
+    return usage;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "cubemap.h"
+#include "environment.h"
+
+// where an environment's cube map is loaded from
+struct EnvSource {
+    std::string dir_path;
+    bool flip = false;
+    bool mips = false;
+    bool compress = true;
+};
+
+// a list of environments of which only the active one is loaded up front
+// the next candidates are decoded on a background thread and uploaded a few faces per frame, so switching never stalls a frame on disk or decode
+// uploaded environments other than the active one are evicted least recently used first to stay under the vram budget
+class EnvLibrary {
+    struct Entry {
+        EnvSource source;
+        std::future<CubeMapImage> loading;
+        std::optional<CubeMapImage> image;  // decoded texels waiting to be uploaded
+        std::unique_ptr<CubeMapEntity> cube_map;  // empty while the entry is active, the environment owns its texture
+        size_t uploaded_faces = 0;
+        size_t vram = 0;
+        uint64_t last_used = 0;
+        bool failed = false;  // not prefetched again after its load threw, until a switch to it is requested
+
+        bool is_resident() const;
+        bool is_complete() const;
+    };
+
+    std::vector<Entry> entries_;
+    size_t active_ = 0;
+    std::optional<size_t> pending_;  // the entry a switch was requested to
+    uint64_t frame_ = 0;
+
+    void prefetch(size_t i);
+    // collects the decodes that have finished without blocking. a load that throws is logged and cancels a switch to it
+    void poll();
+    // uploads up to faces_per_frame_ faces of the switch target, or of the next candidate that fits the budget
+    void upload();
+    void evict();
+    // the entries after the active one in switching order, nearest first
+    std::vector<size_t> get_candidates() const;
+
+public:
+    size_t vram_budget_ = 256 << 20;
+    // faces uploaded per frame, spreads the driver copies of a large environment across frames
+    size_t faces_per_frame_ = 1;
+    // how many of the next environments are decoded ahead of a switch
+    size_t prefetch_count_ = 1;
+    // waits for decodes rather than polling them, so that a switch completes on the same frame regardless of disk and decode times
+    bool blocking_ = false;
+
+    EnvLibrary(std::initializer_list<EnvSource> sources);
+
+    // synchronously loads entry i, to be handed to the environment as its static env map
+    std::unique_ptr<CubeMapEntity> load_active(size_t i);
+    // the environment switches to entry i on a later frame once it is uploaded, or stays if it fails to load
+    void request_switch(size_t i);
+    // switches to the entry after the pending or active one
+    void request_next();
+    // call once per frame prior to drawing
+    void update(Environment& env);
+
+    size_t get_active() const;
+    // the number of entries
+    size_t get_size() const;
+    size_t get_vram_usage() const;
+};
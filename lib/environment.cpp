@@ -1,10 +1,61 @@
 #include "environment.h"
+#include "cpu_profiler.h"
 
 void Environment::bind_static() {
+    cube_map_->bind(GL_TEXTURE2);
     cube_map_->bind();
+    blend_ = 0.f;
+    paraboloid_ = false;
+    planar_ = false;
 }
-void Environment::bind_dynamic() {
-    cubemap_fbo_.bind();
+void Environment::bind_dynamic(MeshEntity& mesh_entity) {
+    if (mesh_entity.is_planar_reflector()) {
+        auto planar_fbo = planar_fbos_.find(&mesh_entity);
+        // the mirrored scene is in screen space of the main camera, useless while capturing
+        if (capturing_ || planar_fbo == planar_fbos_.end()) {
+            bind_static();
+            return;
+        }
+        planar_fbo->second->get_tex().bind(GL_TEXTURE4);
+        bind_static();
+        planar_ = true;
+        return;
+    }
+
+    auto binding = probe_bindings_.find(&mesh_entity);
+    // not captured yet
+    if (binding == probe_bindings_.end() || binding->second.probe == nullptr) {
+        bind_static();
+        return;
+    }
+    EnvProbe& probe = *binding->second.probe;
+    if (probe.get_projection() == EnvProjection::DUAL_PARABOLOID) {
+        probe.bind(GL_TEXTURE3);
+        // the cube samplers are unused but still need a complete texture
+        bind_static();
+        paraboloid_ = true;
+        return;
+    }
+    EnvProbe& blend_probe = binding->second.blend_probe ? *binding->second.blend_probe : probe;
+    blend_probe.bind(GL_TEXTURE2);
+    probe.bind(GL_TEXTURE0);
+    blend_ = binding->second.blend;
+    paraboloid_ = false;
+    planar_ = false;
+}
+void Environment::buffer_env_map() {
+    Uniform("u_skybox").buffer(0);
+    Uniform("u_skybox_blend").buffer(2);
+    Uniform("u_skybox_blend_weight").buffer(blend_);
+    Uniform("u_paraboloid_map").buffer(3);
+    Uniform("u_env_paraboloid").buffer(paraboloid_);
+    // only the reflect program samples planar reflections, the locations are -1 for the others which makes these noops
+    glUniform1i(renderer_->uniform("u_planar"), planar_);
+    glUniform1i(renderer_->uniform("u_planar_map"), 4);
+    glUniform2f(renderer_->uniform("u_screen_size"), screen_size_.x, screen_size_.y);
+#ifdef DEBUG
+    check_gl_error();
+#endif
 }
 
 void Environment::buffer() {
@@ -32,6 +83,7 @@ void Environment::draw_lights() {
     point_lights_.draw();
 }
 void Environment::draw_shadows(FBO& main_fbo, MeshEntityList& mesh_list) {
+    PROFILE_ZONE("Environment::draw_shadows");
     renderer_->bind(ShaderPrograms::SHADOWS);
     dir_light_.buffer_shadows();
     // disable culling to prevent shadow bias issue
@@ -46,7 +98,6 @@ void Environment::draw_shadows(FBO& main_fbo, MeshEntityList& mesh_list) {
 
 void Environment::draw_static_scene() {
     bind_static();
-    renderer_->bind(ShaderPrograms::PHONG);
     // // not necesary anymore since the point lights are drawn with MeshEntities
     // draw_lights();
     draw_static_cubemap();
@@ -54,13 +105,11 @@ void Environment::draw_static_scene() {
 
 void Environment::draw_static_cubemap() {
     bind_static();
-    renderer_->bind(ShaderPrograms::PHONG);
 
     glm::mat4 old_view = camera->get_view();
     glm::mat4 w_out_scale = glm::lookAt(camera->get_position(), glm::vec3(glm::inverse(old_view) * glm::vec4(0.f, 0.f, -1.f, 0.f)), glm::vec3(0.f, camera->get_up(), 0.f));
     camera->set_view(w_out_scale);
 
-    ShaderPrograms selected = renderer_->get_selected();
     renderer_->bind(ShaderPrograms::ENV);
 
     Camera::Projection old_mode = camera->get_projection_mode();
@@ -76,78 +125,375 @@ void Environment::draw_static_cubemap() {
     camera->set_fov(old_fov);
     camera->set_projection_mode(old_mode);
     camera->set_view(old_view);
-    renderer_->bind(selected);
 
     cube_map_->unbind();
 }
 
-void Environment::draw_dynamic_cubemap(FBO& main_fbo, MeshEntity& mesh_entity, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f) {
-    bind_dynamic();
-
-    ShaderPrograms selected = renderer_->get_selected();
-
-    std::array<const glm::vec3, 6> dirs = {
-        glm::vec3(10.f, 0.f, 0.f),
-        glm::vec3(-10.f, 0.f, 0.f),
-        glm::vec3(0.f, 10.f, 0.f),
-        glm::vec3(0.f, -10.f, 0.f),
-        glm::vec3(0.f, 0.f, 10.f),
-        glm::vec3(0.f, 0.f, -10.f),
-    };
-    std::array<const glm::vec3, 6> up = {
-        glm::vec3(0.f, -1.f, 0.f),
-        glm::vec3(0.f, -1.f, 0.f),
-        glm::vec3(0.f, 0.f, 1.f),
-        glm::vec3(0.f, 0.f, -1.f),
-        glm::vec3(0.f, -1.f, 0.f),
-        glm::vec3(0.f, -1.f, 0.f),
-    };
-    auto old_view = camera->get_view();
-    auto old_fov = camera->get_fov();
-    auto old_proj = camera->get_projection_mode();
-    auto old_aspect = camera->get_aspect();
+// view directions and up vectors of the cubemap faces, in gl face order
+static const std::array<glm::vec3, NUM_CUBE_FACES> FACE_DIRS = {
+    glm::vec3(10.f, 0.f, 0.f),
+    glm::vec3(-10.f, 0.f, 0.f),
+    glm::vec3(0.f, 10.f, 0.f),
+    glm::vec3(0.f, -10.f, 0.f),
+    glm::vec3(0.f, 0.f, 10.f),
+    glm::vec3(0.f, 0.f, -10.f),
+};
+static const std::array<glm::vec3, NUM_CUBE_FACES> FACE_UPS = {
+    glm::vec3(0.f, -1.f, 0.f),
+    glm::vec3(0.f, -1.f, 0.f),
+    glm::vec3(0.f, 0.f, 1.f),
+    glm::vec3(0.f, 0.f, -1.f),
+    glm::vec3(0.f, -1.f, 0.f),
+    glm::vec3(0.f, -1.f, 0.f),
+};
 
-    std::unique_ptr<Camera> old_camera = std::move(camera.get_camera_move());
-    camera.set_camera(std::make_unique<FreeCamera>(old_camera->get_aspect(), 90.f));
+void Environment::buffer_cube_faces() {
+    std::array<glm::mat4, NUM_CUBE_FACES> face_views;
+    for (size_t i = 0; i < NUM_CUBE_FACES; i++) {
+        face_views[i] = glm::lookAt(glm::vec3(0.f), FACE_DIRS[i], FACE_UPS[i]);
+    }
+    u_cube_faces_.buffer(face_views.data(), sizeof(face_views));
+}
+
+size_t Environment::probe_signature(const ProbeCapture& capture, float radius, MeshEntityList& mesh_entities) {
+    size_t seed = 0;
+    // swapping the static env map changes every reflection
+    hash_combine(seed, cube_map_.get());
 
+    for (auto& sec_mesh : mesh_entities) {
+        if (capture.is_excluded(sec_mesh.get()) || glm::length(sec_mesh->get_origin() - capture.origin) > radius) {
+            continue;
+        }
+        hash_combine(seed, sec_mesh.get());
+        glm::mat4 trans = sec_mesh->get_trans();
+        for (int col = 0; col < 4; col++) {
+            for (int row = 0; row < 4; row++) {
+                hash_combine(seed, trans[col][row]);
+            }
+        }
+        hash_combine(seed, static_cast<int>(sec_mesh->get_shader()));
+        hash_combine(seed, sec_mesh->get_variant().shadows);
+        hash_combine(seed, sec_mesh->get_variant().pcf_size);
+        hash_combine(seed, static_cast<int>(sec_mesh->get_draw_mode()));
+    }
+    return seed;
+}
+
+ProbeBinding Environment::bind_reflection_probes(glm::vec3 pos) {
+    ProbeBinding binding;
+    float weight = 0.f;
+    float blend_weight = 0.f;
+    for (auto& reflection_probe : reflection_probes_) {
+        float probe_weight = reflection_probe->get_weight(pos);
+        if (probe_weight > weight) {
+            binding.blend_probe = binding.probe;
+            blend_weight = weight;
+            binding.probe = reflection_probe.get();
+            weight = probe_weight;
+        }
+        else if (probe_weight > blend_weight) {
+            binding.blend_probe = reflection_probe.get();
+            blend_weight = probe_weight;
+        }
+    }
+    if (binding.blend_probe != nullptr) {
+        binding.blend = blend_weight / (weight + blend_weight);
+    }
+    return binding;
+}
+
+void Environment::draw_dynamic_cubemaps(FBO& main_fbo, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f) {
+    PROFILE_ZONE("Environment::draw_dynamic_cubemaps");
+    // the reflection probes come first, the meshes bound to them are excluded from their captures below
+    std::vector<ProbeCapture> captures;
+    for (auto& reflection_probe : reflection_probes_) {
+        captures.push_back({ reflection_probe.get(), reflection_probe->get_position(), reflection_probe->get_update(), {} });
+    }
+    probe_bindings_.clear();
+    for (auto& mesh_entity : mesh_entities) {
+        if (!mesh_entity->is_dyn_env_mapped() || mesh_entity->is_planar_reflector()) {
+            // release the env maps of meshes that no longer reflect dynamically
+            mesh_entity->set_probe(nullptr);
+            continue;
+        }
+        ProbeBinding binding = bind_reflection_probes(mesh_entity->get_origin());
+        if (binding.probe != nullptr) {
+            // a shared probe replaces the mesh's own env map
+            mesh_entity->set_probe(nullptr);
+            for (auto& capture : captures) {
+                if (capture.probe == binding.probe || capture.probe == binding.blend_probe) {
+                    capture.excluded.push_back(mesh_entity.get());
+                }
+            }
+        }
+        else {
+            if (mesh_entity->get_probe() == nullptr || mesh_entity->get_probe()->get_projection() != mesh_entity->get_env_projection()) {
+                mesh_entity->set_probe(make_probe(mesh_entity->get_env_projection()));
+            }
+            binding.probe = mesh_entity->get_probe();
+            captures.push_back({ binding.probe, mesh_entity->get_origin(), mesh_entity->get_probe_update(), { mesh_entity.get() } });
+        }
+        probe_bindings_[mesh_entity.get()] = binding;
+    }
+
+    // schedule every probe, even those that won't fit in the budget, so that their policies keep advancing
+    std::vector<const ProbeCapture*> stale;
+    for (auto& capture : captures) {
+        // reflection probes no mesh samples are left stale until one does
+        if (capture.excluded.empty()) {
+            continue;
+        }
+        capture.probe->schedule(capture.update, capture.origin, probe_signature(capture, capture.probe->get_radius(), mesh_entities));
+        if (capture.probe->is_dirty()) {
+            stale.push_back(&capture);
+        }
+    }
+    if (stale.empty()) {
+        return;
+    }
+
+    std::unique_ptr<Camera> old_camera = std::move(camera.get_camera_move());
+    camera.set_camera(std::make_unique<FreeCamera>(1.f, 90.f));
     camera->set_projection_mode(Camera::Projection::Perspective);
-    camera->set_fov(90);
-    camera->set_aspect(1.0);
 
-    size_t i = 0;
-    for (const auto& dir : dirs) {
-        cubemap_fbo_.next_face(i);
+    u_cube_faces_.bind();
+    capturing_ = true;
+
+    int budget = face_budget_;
+    for (size_t i = 0; i < stale.size() && budget > 0; i++) {
+        const ProbeCapture& capture = *stale[(probe_cursor_ + i) % stale.size()];
+        if (capture.probe->get_projection() == EnvProjection::DUAL_PARABOLOID) {
+            budget -= draw_dynamic_paraboloid(capture, mesh_entities, draw_f, budget);
+        }
+        else if (layered_capture_) {
+            budget -= draw_dynamic_cubemap_layered(capture, mesh_entities, draw_f, budget);
+        }
+        else {
+            budget -= draw_dynamic_cubemap(capture, mesh_entities, draw_f, budget);
+        }
+    }
+    probe_cursor_++;
+
+    // restore
+    capturing_ = false;
+    renderer_->set_layered(false);
+    camera.set_camera(std::move(old_camera));
+
+    main_fbo.bind();
+}
+
+int Environment::draw_dynamic_cubemap(const ProbeCapture& capture, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f, int budget) {
+    PROFILE_ZONE("Environment::draw_dynamic_cubemap");
+    CubeMapProbe& probe = static_cast<CubeMapProbe&>(*capture.probe);
+
+    if (cubemap_fbo_ == nullptr) {
+        cubemap_fbo_ = std::make_unique<CubeMap_FBO>(probe_width_);
+    }
+    cubemap_fbo_->bind();
+    renderer_->set_layered(false);
+
+    int captured = 0;
+    for (; captured < budget && probe.is_dirty(); captured++) {
+        size_t i = probe.pop_dirty();
+        cubemap_fbo_->next_face(probe, i);
 
         // draw env
         renderer_->bind(ShaderPrograms::ENV);
-        camera->set_view(glm::lookAt(glm::vec3(0), glm::vec3(dir), up[i]));
+        camera->set_view(glm::lookAt(glm::vec3(0), FACE_DIRS[i], FACE_UPS[i]));
         camera.buffer();
         cube_map_->draw();
 
-        glm::mat4 looking_at = glm::lookAt(mesh_entity.get_origin(), mesh_entity.get_origin() + dir, up[i]);
+        glm::mat4 looking_at = glm::lookAt(probe.get_origin(), probe.get_origin() + FACE_DIRS[i], FACE_UPS[i]);
         camera->set_view(looking_at);
 
-        // TODO: the reason the empty spots appear in the reflection of contained reflictive objects is because it is sampling from the same tex that the containing object is drawing
-
-        // draw all other meshes
+        // draw all other meshes in the face's frustum. the meshes sampling the probe are excluded so nothing samples the face being rendered to
         for (auto& sec_mesh : mesh_entities) {
-            if (sec_mesh.get() != &mesh_entity) {
+            if (!capture.is_excluded(sec_mesh.get()) && probe.visible_faces(sec_mesh->get_bounds()) & (1 << i)) {
                 draw_f(*sec_mesh);
-                cube_map_->bind();
             }
         }
+    }
 
-        i++;
+    return captured;
+}
+
+int Environment::draw_dynamic_cubemap_layered(const ProbeCapture& capture, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f, int budget) {
+    PROFILE_ZONE("Environment::draw_dynamic_cubemap_layered");
+    CubeMapProbe& probe = static_cast<CubeMapProbe&>(*capture.probe);
+
+    if (layered_fbo_ == nullptr) {
+        layered_fbo_ = std::make_unique<CubeMap_Layered_FBO>(probe_width_);
     }
+    layered_fbo_->bind();
+    renderer_->set_layered(true);
 
-    // restore
-    camera.set_camera(std::move(old_camera));
+    uint8_t faces = probe.pop_dirty_mask(budget);
+    layered_fbo_->attach(probe);
+
+    // the layered programs apply the face rotations, the view only translates to the probe
+    camera->set_view(glm::translate(glm::mat4{ 1.f }, -probe.get_origin()));
+
+    // draw env
+    renderer_->set_face_mask(faces);
+    renderer_->bind(ShaderPrograms::ENV);
+    camera.buffer();
+    cube_map_->draw();
+
+    // draw all other meshes once, routed only to the stale faces their bounds intersect
+    for (auto& sec_mesh : mesh_entities) {
+        if (capture.is_excluded(sec_mesh.get())) {
+            continue;
+        }
+        uint8_t visible = faces & probe.visible_faces(sec_mesh->get_bounds());
+        if (visible) {
+            renderer_->set_face_mask(visible);
+            draw_f(*sec_mesh);
+        }
+    }
+
+    int captured = 0;
+    for (; faces; faces &= faces - 1) {
+        captured++;
+    }
+    return captured;
+}
+
+int Environment::draw_dynamic_paraboloid(const ProbeCapture& capture, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f, int budget) {
+    PROFILE_ZONE("Environment::draw_dynamic_paraboloid");
+    ParaboloidProbe& probe = static_cast<ParaboloidProbe&>(*capture.probe);
+
+    if (paraboloid_fbo_ == nullptr) {
+        paraboloid_fbo_ = std::make_unique<Paraboloid_Layered_FBO>(probe_width_);
+    }
+    paraboloid_fbo_->bind();
+    renderer_->set_layered(true);
+    renderer_->set_paraboloid(true);
 
-    cubemap_fbo_.unbind(main_fbo);
+    uint8_t faces = probe.pop_dirty_mask(budget);
+    paraboloid_fbo_->attach(probe);
 
-    renderer_->bind(selected);
+    // the paraboloid projection is applied in the layered programs, the view only translates to the probe
+    camera->set_view(glm::translate(glm::mat4{ 1.f }, -probe.get_origin()));
 
+    // draw env with a screen covering triangle per hemisphere, behind everything else
+    renderer_->set_face_mask(faces);
+    renderer_->bind(ShaderPrograms::ENV);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    cube_map_->bind();
+    MESH_FACTORY->get_mesh_entity(DefMeshList::QUAD).draw_none();
     cube_map_->unbind();
+    glEnable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
+
+    // triangles crossing between the hemispheres are clipped against both
+    glEnable(GL_CLIP_DISTANCE0);
+    for (auto& sec_mesh : mesh_entities) {
+        if (capture.is_excluded(sec_mesh.get())) {
+            continue;
+        }
+        uint8_t visible = faces & probe.visible_faces(sec_mesh->get_bounds());
+        if (visible) {
+            renderer_->set_face_mask(visible);
+            draw_f(*sec_mesh);
+        }
+    }
+    glDisable(GL_CLIP_DISTANCE0);
+
+    renderer_->set_paraboloid(false);
+
+    int captured = 0;
+    for (; faces; faces &= faces - 1) {
+        captured++;
+    }
+    return captured;
+}
+
+void Environment::draw_planar_reflections(FBO& main_fbo, RenderTargetPool& render_targets, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f) {
+    PROFILE_ZONE("Environment::draw_planar_reflections");
+    screen_size_ = glm::vec2(main_fbo.get_width(), main_fbo.get_height());
+    int width = std::max(main_fbo.get_width() / planar_downscale_, 1);
+    int height = std::max(main_fbo.get_height() / planar_downscale_, 1);
+
+    // the mirrored scenes are sampled by the main pass so the targets stay acquired for the rest of the frame
+    planar_fbos_.clear();
+    for (auto& mesh_entity : mesh_entities) {
+        if (mesh_entity->is_planar_reflector()) {
+            planar_fbos_[mesh_entity.get()] = &render_targets.acquire_offscreen(width, height);
+        }
+    }
+    if (planar_fbos_.empty()) {
+        return;
+    }
+
+    capturing_ = true;
+    for (auto& [mirror, target] : planar_fbos_) {
+        draw_planar_reflection(*mirror, *target, mesh_entities, draw_f);
+    }
+    capturing_ = false;
+
+    main_fbo.bind();
+}
+
+void Environment::draw_planar_reflection(MeshEntity& mirror, Offscreen_FBO& target, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f) {
+    target.bind();
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+    glm::vec4 plane = mirror.get_plane().value();
+    glm::vec3 normal{ plane };
+    // nothing to reflect when looking at the back of the mirror
+    if (glm::dot(normal, camera->get_position()) + plane.w <= 0.f) {
+        return;
+    }
+
+    // reflects across the plane: pos - 2 * (dot(normal, pos) + d) * normal
+    glm::mat4 reflection = glm::mat3(1.f) - 2.f * glm::outerProduct(normal, normal);
+    reflection[3] = glm::vec4(-2.f * plane.w * normal, 1.f);
+
+    glm::mat4 old_view = camera->get_view();
+    glm::mat4 mirrored_view = old_view * reflection;
+    // the reflection flips the winding of every triangle
+    glFrontFace(GL_CW);
+
+    // draw env, with the same projection as draw_static_cubemap
+    Camera::Projection old_mode = camera->get_projection_mode();
+    float old_fov = camera->get_fov();
+    camera->set_view(glm::mat3(mirrored_view));
+    camera->set_projection_mode(Camera::Projection::Perspective);
+    camera->set_fov(fov_);
+    renderer_->bind(ShaderPrograms::ENV);
+    camera.buffer();
+    cube_map_->draw();
+    camera->set_fov(old_fov);
+    camera->set_projection_mode(old_mode);
+
+    // draw all other meshes, clipping what is behind the mirror
+    camera->set_view(mirrored_view);
+    camera->set_clip_plane(plane);
+    for (auto& sec_mesh : mesh_entities) {
+        if (sec_mesh.get() != &mirror) {
+            draw_f(*sec_mesh);
+        }
+    }
+    camera->clear_clip_plane();
+    camera->set_view(old_view);
+
+    glFrontFace(GL_CCW);
+}
+
+std::shared_ptr<EnvProbe> Environment::make_probe(EnvProjection projection) {
+    if (projection == EnvProjection::DUAL_PARABOLOID) {
+        return std::make_shared<ParaboloidProbe>(probe_width_);
+    }
+    return std::make_shared<CubeMapProbe>(probe_width_);
+}
+
+void Environment::add_reflection_probe(glm::vec3 position) {
+    reflection_probes_.push_back(std::make_shared<ReflectionProbe>(probe_width_, position, probe_influence_radius_));
+}
+void Environment::clear_reflection_probes() {
+    reflection_probes_.clear();
 }
 
 void Environment::set_cube_map(std::unique_ptr<CubeMapEntity> cube_map) {
@@ -1,17 +1,66 @@
 #pragma once
 
+#include <unordered_map>
 
 #include "framebuffer.h"
+#include "render_target_pool.h"
 #include "cubemap.h"
 #include "camera.h"
 #include "light.h"
+#include "probe.h"
 
 class Environment : public RenderObj {
     float fov_ = 50.0;
 
+    // width of each dynamic env map face
+    int probe_width_;
+    // rotates which probe is captured first so that a tight budget doesn't starve the last probes
+    size_t probe_cursor_ = 0;
+
+    // capture target shared by the dynamic env maps, allocated on first use
+    std::unique_ptr<CubeMap_FBO> cubemap_fbo_;
+    // capture target for layered captures, allocated on first use
+    std::unique_ptr<CubeMap_Layered_FBO> layered_fbo_;
+    // capture target for dual paraboloid probes, allocated on first use
+    std::unique_ptr<Paraboloid_Layered_FBO> paraboloid_fbo_;
+    // face rotations read by the layered programs
+    UniformBlock u_cube_faces_{ 0, sizeof(glm::mat4) * NUM_CUBE_FACES };
+
+    // env maps sampled by each dynamically env mapped mesh this frame
+    std::unordered_map<const MeshEntity*, ProbeBinding> probe_bindings_;
+    // weight of the second env map bound by the last bind call
+    float blend_ = 0.f;
+    // whether the last bind call bound a dual paraboloid map
+    bool paraboloid_ = false;
+    // whether the last bind call bound a planar reflection
+    bool planar_ = false;
+
+    // mirrored scene of each planar reflector, re-rendered every frame into targets from the pool
+    std::unordered_map<MeshEntity*, Offscreen_FBO*> planar_fbos_;
+    // size of the main target, planar reflections are sampled in its screen space
+    glm::vec2 screen_size_{ 1.f };
+    // set while rendering probes or planar reflections, planar reflectors then sample the static env map
+    bool capturing_ = false;
+
+    // hashes the transforms of the meshes within the probe's radius, used to detect changes
+    size_t probe_signature(const ProbeCapture& capture, float radius, MeshEntityList& mesh_entities);
+    // the nearest one or two reflection probes whose influence volume contains pos
+    ProbeBinding bind_reflection_probes(glm::vec3 pos);
+    std::shared_ptr<EnvProbe> make_probe(EnvProjection projection);
+
 public:
     std::unique_ptr<CubeMapEntity> cube_map_;  // static env map
-    CubeMap_FBO cubemap_fbo_;  // dynamic env map
+
+    // max cubemap faces captured per frame across all probes
+    int face_budget_ = 6;
+    // capture all stale faces of a probe with one submission per mesh instead of one per face
+    bool layered_capture_ = true;
+    // planar reflections are rendered at the main target's size divided by this
+    int planar_downscale_ = 2;
+
+    // probes shared by the meshes within their influence volumes, meshes outside all of them capture their own
+    ReflectionProbes reflection_probes_;
+    float probe_influence_radius_ = 3.f;
 
     DirLight dir_light_;
     PointLights point_lights_;
@@ -19,10 +68,14 @@ public:
     RenderCamera camera;
     
     Environment(std::unique_ptr<Camera> new_cam, int width, PointLights&& point_lights, std::unique_ptr<CubeMapEntity> cube_map) : Environment(std::move(new_cam), width, 50.0, std::move(point_lights), std::move(cube_map))  {}
-    Environment(std::unique_ptr<Camera> new_cam, int width, float fov, PointLights&& point_lights, std::unique_ptr<CubeMapEntity> cube_map) : camera(std::move(new_cam)), point_lights_(std::move(point_lights)), cube_map_(std::move(cube_map)), cubemap_fbo_(width / 2.f), fov_(fov) {}
+    Environment(std::unique_ptr<Camera> new_cam, int width, float fov, PointLights&& point_lights, std::unique_ptr<CubeMapEntity> cube_map) : camera(std::move(new_cam)), point_lights_(std::move(point_lights)), cube_map_(std::move(cube_map)), probe_width_(width / 2.f), fov_(fov) {
+        buffer_cube_faces();
+    }
 
     void bind_static();
-    void bind_dynamic();
+    void bind_dynamic(MeshEntity& mesh_entity);
+    // buffers the env map samplers bound by the last bind call
+    void buffer_env_map();
 
     void buffer();
     void buffer_lights();
@@ -32,7 +85,21 @@ public:
 
     void draw_static_scene();
     void draw_static_cubemap();
-    void draw_dynamic_cubemap(FBO& main_fbo, MeshEntity& mesh_entity, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f);
+    // captures the stale faces of the dynamic env maps in mesh_entities, limited by face_budget_
+    void draw_dynamic_cubemaps(FBO& main_fbo, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f);
+    // captures up to budget stale faces of the probe, one pass per face. returns the number of faces captured
+    int draw_dynamic_cubemap(const ProbeCapture& capture, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f, int budget);
+    // captures up to budget stale faces of the probe in a single layered pass. returns the number of faces captured
+    int draw_dynamic_cubemap_layered(const ProbeCapture& capture, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f, int budget);
+    // captures up to budget stale hemispheres of a dual paraboloid probe in a single layered pass. returns the number of hemispheres captured
+    int draw_dynamic_paraboloid(const ProbeCapture& capture, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f, int budget);
+    void buffer_cube_faces();
+    // renders the mirrored scene of every planar reflector in mesh_entities, the targets are held until the pool's next frame
+    void draw_planar_reflections(FBO& main_fbo, RenderTargetPool& render_targets, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f);
+    void draw_planar_reflection(MeshEntity& mirror, Offscreen_FBO& target, MeshEntityList& mesh_entities, std::function<void(MeshEntity&)> draw_f);
+
+    void add_reflection_probe(glm::vec3 position);
+    void clear_reflection_probes();
 
     void set_cube_map(std::unique_ptr<CubeMapEntity> cube_map);
     void swap_cube_map(std::unique_ptr<CubeMapEntity>& cube_map);
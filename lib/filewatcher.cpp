@@ -1,35 +1,151 @@
 #include "filewatcher.h"
 
-FileWatcher::FileWatcher(int milli_delay) : delay_(milli_delay), thread_([&] {
-    while (!destroy_) {
-        std::this_thread::sleep_for(delay_);  // currently it will always sleep for delay_ time regardless of how long it takes to do i/o
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 
-        for (auto& [path, val] : paths_) {
-            auto last_time = std::filesystem::last_write_time(std::filesystem::path(path));
-            if (last_time > val->f_time) {
-                std::cout << "Watched File | Modified: " << path << std::endl;
-                if (val->func) {
-                    val->func();
-                }
-                val->f_time = last_time;
-                val->changed_ = true;
+FileWatcher::FileWatcher(int milli_delay) : delay_(milli_delay) {
+#ifdef __linux__
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    thread_ = std::thread([this] {
+        while (!destroy_) {
+            if (is_event_driven()) {
+                read_events();
+            }
+            else {
+                std::this_thread::sleep_for(delay_);  // currently it will always sleep for delay_ time regardless of how long it takes to do i/o
             }
+            // files inotify couldn't watch are polled either way
+            poll_files();
         }
-    }
-    }) {}
+    });
+}
 
 FileWatcher::FileWatcher() : FileWatcher(5000) {}
 FileWatcher::~FileWatcher() {
     destroy_ = true;
     thread_.join();
+#ifdef __linux__
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+    }
+#endif
+}
+
+void FileWatcher::read_events() {
+#ifdef __linux__
+    // sleeps until a watched directory is written to. the timeout only bounds how long destruction waits for the thread
+    pollfd fds{ inotify_fd_, POLLIN, 0 };
+    if (poll(&fds, 1, static_cast<int>(delay_.count())) <= 0) {
+        return;
+    }
+    alignas(inotify_event) char buffer[4096];
+    ssize_t size;
+    while ((size = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+        for (char* ptr = buffer; ptr < buffer + size;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow_ = true;
+            }
+            else if (event->len > 0) {
+                push({ event->wd, event->name });
+            }
+            ptr += sizeof(inotify_event) + event->len;
+        }
+    }
+#endif
+}
+
+void FileWatcher::poll_files() {
+    std::lock_guard<std::mutex> lock(polled_mutex_);
+    for (auto& [path, f_time] : polled_) {
+        std::error_code error;
+        auto last_time = std::filesystem::last_write_time(std::filesystem::path(path), error);
+        // editors that save by replacing the file leave it missing for a moment
+        if (!error && last_time > f_time) {
+            f_time = last_time;
+            push({ -1, path });
+        }
+    }
+}
+
+void FileWatcher::push(FileEvent event) {
+    if (!events_.push(std::move(event))) {
+        overflow_ = true;
+    }
 }
 
 void FileWatcher::add_path(const std::string& path, std::function<void()> func) {
-    if (paths_.find(path) == paths_.end()) {
-        auto f_time = std::filesystem::last_write_time(path);
-        paths_[path] = std::unique_ptr<FileWatcherVal>(new FileWatcherVal{f_time, false, func}); // save allocation
+    if (paths_.find(path) != paths_.end()) {
+        return;
+    }
+    auto f_time = std::filesystem::last_write_time(path);
+    paths_[path] = std::unique_ptr<FileWatcherVal>(new FileWatcherVal{f_time, false, func}); // save allocation
+
+#ifdef __linux__
+    if (inotify_fd_ >= 0) {
+        // the directory is watched rather than the file, editors that save by renaming a new file over the old one replace its inode
+        std::filesystem::path fs_path(path);
+        std::string dir = fs_path.has_parent_path() ? fs_path.parent_path().string() : ".";
+        int watch = inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watch >= 0) {
+            watches_[watch][fs_path.filename().string()] = path;
+            return;
+        }
+        // e.g. the user's watch limit is reached, the file is polled instead
     }
+#endif
+    std::lock_guard<std::mutex> lock(polled_mutex_);
+    polled_.push_back({ path, f_time });
 }
+
+bool FileWatcher::set_changed(const std::string& path) {
+    auto& val = paths_.at(path);
+    if (val->changed_) {
+        return false;
+    }
+    std::cout << "Watched File | Modified: " << path << std::endl;
+    if (val->func) {
+        val->func();
+    }
+    std::error_code error;
+    val->f_time = std::filesystem::last_write_time(std::filesystem::path(path), error);
+    val->changed_ = true;
+    return true;
+}
+
+bool FileWatcher::update() {
+    if (events_.empty() && !overflow_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    bool changed = false;
+    while (std::optional<FileEvent> event = events_.pop()) {
+        if (event->watch < 0) {
+            changed = set_changed(event->name) || changed;
+            continue;
+        }
+        // writes to other files in a watched directory, such as an editor's swap files, are ignored
+        auto dir = watches_.find(event->watch);
+        if (dir == watches_.end()) {
+            continue;
+        }
+        auto file = dir->second.find(event->name);
+        if (file != dir->second.end()) {
+            changed = set_changed(file->second) || changed;
+        }
+    }
+    if (overflow_.exchange(false)) {
+        for (auto& [path, val] : paths_) {
+            changed = set_changed(path) || changed;
+        }
+    }
+    return changed;
+}
+
 bool FileWatcher::check_change(const std::string& path) const {
     auto& val = paths_.at(path);
     return val->changed_;
@@ -37,4 +153,12 @@ bool FileWatcher::check_change(const std::string& path) const {
 void FileWatcher::set_unchanged(const std::string& path) {
     auto& val = paths_.at(path);
     val->changed_ = false;
-}
\ No newline at end of file
+}
+void FileWatcher::set_unchanged() {
+    for (auto& [path, val] : paths_) {
+        val->changed_ = false;
+    }
+}
+bool FileWatcher::is_event_driven() const {
+    return inotify_fd_ >= 0;
+}
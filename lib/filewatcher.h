@@ -2,12 +2,17 @@
 
 #include <iostream>
 
+#include <atomic>
 #include <filesystem>
 #include <chrono>
 #include <thread>
+#include <mutex>
 #include <unordered_map>
 #include <functional>
 #include <memory>
+#include <vector>
+
+#include "spsc_queue.h"
 
 struct FileWatcherVal {
     // last change time
@@ -18,23 +23,60 @@ struct FileWatcherVal {
     std::function<void()> func;
 };
 
+// a change seen by the watcher thread, resolved to a watched path on the main thread
+struct FileEvent {
+    // inotify watch of the file's directory, -1 if the file is polled
+    int watch = -1;
+    // the file name within the watched directory, or the path of a polled file
+    std::string name;
+};
+
 // starts a thread that checks the file system for changes to the files stored in the paths_ container
-// used for hotreloading shaders
+// used for hotreloading shaders. on linux the thread sleeps until inotify reports a write to a watched directory,
+// elsewhere, or if inotify is unavailable, it polls the write times every delay_
+// the thread passes changes through a lock free queue that update drains on the main thread, so that paths_ is never shared
 class FileWatcher {
     std::chrono::duration<int, std::milli> delay_;
     std::unordered_map<std::string, std::unique_ptr<FileWatcherVal>> paths_;
-    std::thread thread_;
+
+    SpscQueue<FileEvent, 256> events_;
+    // set by the thread when events were lost, every path is treated as changed then
+    std::atomic<bool> overflow_{ false };
+
+    // inotify instance, -1 when polling
+    int inotify_fd_ = -1;
+    // inotify watch of each watched directory -> names of the watched files in it -> their watched paths
+    std::unordered_map<int, std::unordered_map<std::string, std::string>> watches_;
+
+    // files the thread polls, with their last write time. used without inotify or when a watch couldn't be added
+    std::mutex polled_mutex_;
+    std::vector<std::pair<std::string, std::filesystem::file_time_type>> polled_;
 
     // stops the thread
-    bool destroy_ = false;
+    std::atomic<bool> destroy_{ false };
+    // declared last, the thread starts once every other member is initialized
+    std::thread thread_;
+
+    // thread functions, push events for changed files
+    void read_events();
+    void poll_files();
+    void push(FileEvent event);
+    // marks the path changed. editors may write a file several times per save, those are coalesced into one change
+    bool set_changed(const std::string& path);
 
 public:
     FileWatcher(int milli_delay);
     FileWatcher();
-    FileWatcher(FileWatcher&&) = default;
     ~FileWatcher();
 
     void add_path(const std::string& path, std::function<void()> func);
+    // applies the changes the thread found since the last call and calls their funcs. call once per frame
+    // returns false without any further work if nothing changed
+    bool update();
     bool check_change(const std::string& path) const;
     void set_unchanged(const std::string& path);
-};
\ No newline at end of file
+    // marks every path unchanged
+    void set_unchanged();
+    // whether changes are reported by inotify rather than by polling
+    bool is_event_driven() const;
+};
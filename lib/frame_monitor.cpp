@@ -0,0 +1,200 @@
+#include "frame_monitor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+
+#include "render_stats.h"
+#include "utilities.h"
+
+size_t Histogram::get_bucket(uint64_t value) {
+    if (value < LINEAR) {
+        return value;
+    }
+    int magnitude = 0;
+    for (uint64_t v = value; v > 1; v >>= 1) {
+        magnitude++;
+    }
+    if (magnitude >= MAX_MAGNITUDE) {
+        return NUM_BUCKETS - 1;
+    }
+    // the top HISTOGRAM_SUB_BITS + 1 bits of the value, the leading bit is always set
+    uint64_t sub = value >> (magnitude - HISTOGRAM_SUB_BITS);
+    return LINEAR + (magnitude - HISTOGRAM_SUB_BITS - 1) * SUB_BUCKETS + (sub - SUB_BUCKETS);
+}
+
+uint64_t Histogram::get_value(size_t bucket) {
+    if (bucket < LINEAR) {
+        return bucket;
+    }
+    size_t offset = bucket - LINEAR;
+    int magnitude = offset / SUB_BUCKETS + HISTOGRAM_SUB_BITS + 1;
+    uint64_t sub = offset % SUB_BUCKETS + SUB_BUCKETS;
+    return ((sub + 1) << (magnitude - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+void Histogram::record(uint64_t value) {
+    buckets_[get_bucket(value)]++;
+    count_++;
+    max_ = std::max(max_, value);
+}
+
+void Histogram::reset() {
+    buckets_.fill(0);
+    count_ = 0;
+    max_ = 0;
+}
+
+uint64_t Histogram::get_percentile(float percentile) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile / 100.f * count_)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets_.size(); i++) {
+        seen += buckets_[i];
+        if (seen >= target) {
+            // the bucket's bound can exceed the largest value recorded, the last bucket has no bound
+            return i == buckets_.size() - 1 ? max_ : std::min(get_value(i), max_);
+        }
+    }
+    return max_;
+}
+
+uint64_t Histogram::get_max() const {
+    return max_;
+}
+uint64_t Histogram::get_count() const {
+    return count_;
+}
+
+float FrameSample::get(FrameMetric metric) const {
+    switch (metric) {
+    case FrameMetric::FRAME_CPU:
+        return cpu;
+    case FrameMetric::FRAME_GPU:
+        return gpu;
+    case FrameMetric::FRAME_PRESENT:
+        return present;
+    default:
+        return -1.f;
+    }
+}
+
+FrameMonitor::FrameMonitor(std::string log_path) : interval_start_(std::chrono::steady_clock::now()), log_path_(std::move(log_path)) {}
+
+void FrameMonitor::record(const FrameSample& sample) {
+    frame_++;
+    for (int i = 0; i < FrameMetric::NUM_FRAME_METRICS; i++) {
+        float ms = sample.get(static_cast<FrameMetric>(i));
+        if (ms >= 0.f) {
+            uint64_t us = static_cast<uint64_t>(ms * 1000.f);
+            interval_[i].record(us);
+            total_[i].record(us);
+        }
+    }
+    if (sample.cpu > budget_ms_ || sample.present > present_budget_ms_) {
+        over_budget_++;
+        log_hitch(sample);
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - interval_start_ >= interval_length_) {
+        last_report_ = get_report(interval_, over_budget_);
+        log_report(last_report_);
+        if (print_reports_) {
+            print(last_report_);
+        }
+        for (auto& histogram : interval_) {
+            histogram.reset();
+        }
+        over_budget_ = 0;
+        interval_start_ = now;
+    }
+}
+
+FrameReport FrameMonitor::get_report(const std::array<Histogram, FrameMetric::NUM_FRAME_METRICS>& histograms, uint64_t over_budget) const {
+    FrameReport report;
+    report.frames = histograms[FrameMetric::FRAME_CPU].get_count();
+    report.over_budget = over_budget;
+    for (int i = 0; i < FrameMetric::NUM_FRAME_METRICS; i++) {
+        report.p50[i] = histograms[i].get_percentile(50.f) / 1000.f;
+        report.p95[i] = histograms[i].get_percentile(95.f) / 1000.f;
+        report.p99[i] = histograms[i].get_percentile(99.f) / 1000.f;
+        report.max[i] = histograms[i].get_max() / 1000.f;
+    }
+    return report;
+}
+
+void FrameMonitor::rotate_log() {
+    if (!log_.is_open()) {
+        std::error_code error;
+        std::filesystem::path parent = std::filesystem::path(log_path_).parent_path();
+        if (!parent.empty()) {
+            std::filesystem::create_directories(parent, error);
+        }
+        log_.open(log_path_, std::ios::app);
+    }
+    // the previous log is kept as .1, so the log never takes more than twice max_log_bytes_
+    if (log_ && static_cast<size_t>(log_.tellp()) > max_log_bytes_) {
+        log_.close();
+        std::string old_path = log_path_ + ".1";
+        replace_file(log_path_, old_path);
+        log_.open(log_path_, std::ios::trunc);
+    }
+}
+
+void FrameMonitor::log_hitch(const FrameSample& sample) {
+    rotate_log();
+    if (!log_) {
+        return;
+    }
+    log_ << std::fixed << std::setprecision(2) << "frame " << frame_ << " over budget: cpu " << sample.cpu << " ms, present " << sample.present << " ms";
+    if (sample.gpu >= 0.f) {
+        log_ << ", gpu " << sample.gpu << " ms";
+    }
+    // what the frame was doing, the frame was snapshot by its draw. the counters are only collected while render stats are enabled
+    if (render_stats().is_enabled()) {
+        RenderStatsFrame last = render_stats().get_last();
+        for (int i = 0; i < RenderCounter::NUM_RENDER_COUNTERS; i++) {
+            log_ << ", " << RENDER_COUNTER_NAMES[i] << " " << last.counters[i];
+        }
+    }
+    log_ << std::endl;
+}
+
+void FrameMonitor::log_report(const FrameReport& report) {
+    rotate_log();
+    if (!log_) {
+        return;
+    }
+    log_ << std::fixed << std::setprecision(2) << "frames " << report.frames << ", " << report.over_budget << " over budget";
+    for (int i = 0; i < FrameMetric::NUM_FRAME_METRICS; i++) {
+        log_ << " | " << FRAME_METRIC_NAMES[i] << " p50 " << report.p50[i] << " p95 " << report.p95[i] << " p99 " << report.p99[i] << " max " << report.max[i];
+    }
+    log_ << std::endl;
+}
+
+const FrameReport& FrameMonitor::get_last_report() const {
+    return last_report_;
+}
+
+FrameReport FrameMonitor::get_total_report() const {
+    return get_report(total_, 0);
+}
+
+const Histogram& FrameMonitor::get_histogram(FrameMetric metric) const {
+    return total_[metric];
+}
+
+void FrameMonitor::print(const FrameReport& report) {
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "frames: " << report.frames << " (" << report.over_budget << " over budget)" << std::endl;
+    for (int i = 0; i < FrameMetric::NUM_FRAME_METRICS; i++) {
+        std::cout << "  " << std::left << std::setw(8) << FRAME_METRIC_NAMES[i] << std::right
+            << " p50 " << report.p50[i] << "  p95 " << report.p95[i] << "  p99 " << report.p99[i] << "  max " << report.max[i] << " ms" << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
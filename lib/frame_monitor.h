@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+const std::string FRAME_LOG_PATH = "../data/frame_log.txt";
+
+// log-linear histogram of microsecond values, like hdr histogram. each power of two is split into 2^HISTOGRAM_SUB_BITS buckets,
+// so a recorded value is off by at most 1 / 2^HISTOGRAM_SUB_BITS (3%) at any magnitude, from a microsecond to a minute
+const int HISTOGRAM_SUB_BITS = 5;
+
+class Histogram {
+    static const int SUB_BUCKETS = 1 << HISTOGRAM_SUB_BITS;
+    // values below this get a bucket each
+    static const int LINEAR = 2 * SUB_BUCKETS;
+    // values up to 2^MAX_MAGNITUDE us, larger ones are counted in the last bucket
+    static const int MAX_MAGNITUDE = 36;
+    static const int NUM_BUCKETS = LINEAR + (MAX_MAGNITUDE - HISTOGRAM_SUB_BITS - 1) * SUB_BUCKETS;
+
+    std::array<uint64_t, NUM_BUCKETS> buckets_{};
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+
+    static size_t get_bucket(uint64_t value);
+    // the largest value that falls into the bucket
+    static uint64_t get_value(size_t bucket);
+
+public:
+    void record(uint64_t value);
+    void reset();
+
+    // the smallest value that percentile percent of the recorded values are at or below, 0 if nothing was recorded
+    uint64_t get_percentile(float percentile) const;
+    uint64_t get_max() const;
+    uint64_t get_count() const;
+};
+
+enum FrameMetric {
+    // update and draw, up to the swap
+    FRAME_CPU,
+    // the render graph's passes, reported GPU_PROFILER_FRAMES late
+    FRAME_GPU,
+    // time between two swaps, what the user sees
+    FRAME_PRESENT,
+
+    NUM_FRAME_METRICS = 3,
+};
+
+const char* const FRAME_METRIC_NAMES[FrameMetric::NUM_FRAME_METRICS] = { "cpu", "gpu", "present" };
+
+// milliseconds of one frame, negative for a metric that wasn't measured
+struct FrameSample {
+    float cpu = -1.f;
+    float gpu = -1.f;
+    float present = -1.f;
+
+    float get(FrameMetric metric) const;
+};
+
+// milliseconds of each metric over an interval
+struct FrameReport {
+    uint64_t frames = 0;
+    // frames that exceeded the cpu or present budget
+    uint64_t over_budget = 0;
+    std::array<float, FrameMetric::NUM_FRAME_METRICS> p50{};
+    std::array<float, FrameMetric::NUM_FRAME_METRICS> p95{};
+    std::array<float, FrameMetric::NUM_FRAME_METRICS> p99{};
+    std::array<float, FrameMetric::NUM_FRAME_METRICS> max{};
+};
+
+// records the time of every frame into histograms and reports their percentiles every interval, so that hitches don't average out
+// frames over budget and the reports are appended to a log, which is rotated once it grows past max_log_bytes_
+class FrameMonitor {
+    std::array<Histogram, FrameMetric::NUM_FRAME_METRICS> interval_;
+    std::array<Histogram, FrameMetric::NUM_FRAME_METRICS> total_;
+    uint64_t frame_ = 0;
+    uint64_t over_budget_ = 0;
+    std::chrono::steady_clock::time_point interval_start_;
+    FrameReport last_report_;
+
+    std::string log_path_;
+    std::ofstream log_;
+
+    FrameReport get_report(const std::array<Histogram, FrameMetric::NUM_FRAME_METRICS>& histograms, uint64_t over_budget) const;
+    void log_hitch(const FrameSample& sample);
+    void log_report(const FrameReport& report);
+    void rotate_log();
+
+public:
+    // a frame is over budget if its cpu time exceeds this, a 60 hz frame by default
+    float budget_ms_ = 16.7f;
+    // or if its present interval exceeds this. the loop paces frames to the timestep, so an on time frame is presented about budget_ms_ after the last
+    float present_budget_ms_ = 25.f;
+    std::chrono::milliseconds interval_length_{ 1000 };
+    size_t max_log_bytes_ = 1 << 20;
+    // the reports are also printed
+    bool print_reports_ = false;
+
+    FrameMonitor(std::string log_path);
+
+    void record(const FrameSample& sample);
+
+    // the last complete interval
+    const FrameReport& get_last_report() const;
+    // every frame since launch
+    FrameReport get_total_report() const;
+    const Histogram& get_histogram(FrameMetric metric) const;
+
+    static void print(const FrameReport& report);
+};
@@ -38,6 +38,7 @@ public:
     virtual void bind() {
         glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
         reset_viewport();
+        render_stats().count(RenderCounter::FBO_BINDS);
 
 #ifdef DEBUG
         check_gl_error();
@@ -183,43 +184,107 @@ public:
     }
 };
 
-class CubeMap_FBO : public FBO_RBO_Tex_Interface<CubeMapTex> {
+// render target for capturing cubemaps. only the depth attachment is owned, the color attachment is a face of the CubeMapTex being captured
+// so that a single FBO can be shared by every dynamic env map
+class CubeMap_FBO : public FBO_RBO {
     void init() override {
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, tex_.get_width(), tex_.get_width());
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, get_width(), get_height());
         glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo_);
 
-        tex_.init();
+#ifdef DEBUG
+        check_gl_error();
+#endif
+    }
 
-        // attach it to currently bound framebuffer object
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, tex_.get_id(), 0);
+public:
+    CubeMap_FBO(int width) {
+        Canvas::resize(width, width);
+        init();
+    }
+
+    void next_face(CubeMapTex& tex, size_t i) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, tex.get_id(), 0);
 
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
             throw std::runtime_error("framebuffer incomplete");
         }
 
+        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+#ifdef DEBUG
+        check_gl_error();
+#endif
+    }
+};
+
+// render target for capturing every face of a cubemap in one pass with the layered programs
+// both attachments are layered so that the geometry shader can route primitives with gl_Layer
+class CubeMap_Layered_FBO : public FBO {
+    CubeMapTex depth_tex_;
+
+    void init() override {
+        depth_tex_.bind();
+        for (int i = 0; i < 6; i++) {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT24, get_width(), get_height(), 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        }
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_tex_.get_id(), 0);
+        depth_tex_.unbind();
+
 #ifdef DEBUG
         check_gl_error();
 #endif
     }
 
 public:
-    CubeMap_FBO(int width) : FBO_RBO_Tex_Interface(width) { init(); }
-    CubeMap_FBO(int width, int height) : FBO_RBO_Tex_Interface(width, height) { init(); }
+    CubeMap_Layered_FBO(int width) : depth_tex_(width) {
+        Canvas::resize(width, width);
+        init();
+    }
 
-    void bind() override {
-        FBO_RBO_Tex_Interface::bind();
+    void attach(CubeMapTex& tex) {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tex.get_id(), 0);
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw std::runtime_error("framebuffer incomplete");
+        }
+
+        // clears the depth of every face. color is kept since faces that aren't stale are cached, stale faces are overdrawn by the env
+        glClear(GL_DEPTH_BUFFER_BIT);
 
 #ifdef DEBUG
         check_gl_error();
 #endif
     }
-    void next_face(size_t i) {
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, tex_.get_id(), 0);
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+};
+
+// layered target for dual paraboloid captures, both hemispheres are rendered to in one pass
+class Paraboloid_Layered_FBO : public FBO {
+    TextureArray depth_tex_;
+
+    void init() override {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_tex_.get_id(), 0);
+
+#ifdef DEBUG
+        check_gl_error();
+#endif
+    }
+
+public:
+    Paraboloid_Layered_FBO(int width) : depth_tex_(width, width, 2, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT) {
+        Canvas::resize(width, width);
+        init();
+    }
+
+    void attach(TextureArray& tex) {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tex.get_id(), 0);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw std::runtime_error("framebuffer incomplete");
+        }
+
+        // same as the cubemap target, cached sides keep their color
+        glClear(GL_DEPTH_BUFFER_BIT);
 
 #ifdef DEBUG
         check_gl_error();
@@ -318,7 +383,8 @@ public:
     void bind_offscreen() {
         renderer_->bind(ShaderPrograms::OFFSCREEN);
         Uniform("u_offscreen_tex").buffer(0);
-        Uniform("u_depth_map").buffer(1);
+        // only declared by the fog permutation
+        glUniform1i(renderer_->uniform("u_depth_map"), 1);
 
         get_tex().bind(GL_TEXTURE0);
         depth_tex_.bind(GL_TEXTURE1);
@@ -342,9 +408,11 @@ public:
 };
 
 class Offscreen_FBO_Multisample : public FBO_RBO_Tex_Interface<Texture> {
+    int samples_;
+
     void init() override {
         tex_.bind();
-        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 4, GL_RGBA, tex_.get_width(), tex_.get_height(), GL_TRUE);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples_, GL_RGBA, tex_.get_width(), tex_.get_height(), GL_TRUE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -359,7 +427,7 @@ class Offscreen_FBO_Multisample : public FBO_RBO_Tex_Interface<Texture> {
 #endif
 
         FBO_RBO::bind();
-        glRenderbufferStorageMultisample(GL_RENDERBUFFER, 4, GL_DEPTH24_STENCIL8, tex_.get_width(), tex_.get_height());
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples_, GL_DEPTH24_STENCIL8, tex_.get_width(), tex_.get_height());
         glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo_);
 
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
@@ -372,7 +440,7 @@ class Offscreen_FBO_Multisample : public FBO_RBO_Tex_Interface<Texture> {
     }
 
 public:
-    Offscreen_FBO_Multisample(int width, int height) : FBO_RBO_Tex_Interface(GL_TEXTURE_2D_MULTISAMPLE, width, height) { init(); }
+    Offscreen_FBO_Multisample(int width, int height, int samples = 4) : FBO_RBO_Tex_Interface(GL_TEXTURE_2D_MULTISAMPLE, width, height), samples_(samples) { init(); }
 
     void bind() override {
         FBO_RBO_Tex_Interface::bind();
@@ -387,7 +455,8 @@ public:
     void bind_offscreen() {
         renderer_->bind(ShaderPrograms::OFFSCREEN);
         Uniform("u_offscreen_tex").buffer(0);
-        Uniform("u_depth_map").buffer(1);
+        // only declared by the fog permutation
+        glUniform1i(renderer_->uniform("u_depth_map"), 1);
 
         get_tex().bind(GL_TEXTURE0);
 
@@ -401,9 +470,9 @@ public:
         tex_.set_height(height);
 
         tex_.bind();
-        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 4, GL_RGBA, tex_.get_width(), tex_.get_height(), GL_TRUE);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples_, GL_RGBA, tex_.get_width(), tex_.get_height(), GL_TRUE);
         
         FBO_RBO::bind();
-        glRenderbufferStorageMultisample(GL_RENDERBUFFER, 4, GL_DEPTH24_STENCIL8, tex_.get_width(), tex_.get_height());
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples_, GL_DEPTH24_STENCIL8, tex_.get_width(), tex_.get_height());
     }
 };
@@ -0,0 +1,217 @@
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+GpuProfiler::GpuProfiler() {
+    supported_ = GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+}
+
+GpuProfiler::~GpuProfiler() {
+    for (auto& frame : frames_) {
+        if (!frame.queries.empty()) {
+            glDeleteQueries(frame.queries.size(), frame.queries.data());
+        }
+    }
+}
+
+GpuProfiler::Frame& GpuProfiler::current() {
+    return frames_[frame_ % GPU_PROFILER_FRAMES];
+}
+
+void GpuProfiler::begin_frame() {
+    if (!supported_) {
+        return;
+    }
+    frame_++;
+    Frame& frame = current();
+    collect(frame);
+    frame.used = 0;
+}
+
+void GpuProfiler::collect(Frame& frame) {
+    if (frame.used == 0) {
+        return;
+    }
+    // the end of the last pass is the last to complete. if even that isn't done the gpu is more than GPU_PROFILER_FRAMES behind,
+    // the frame is dropped rather than waited for
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available != GL_TRUE) {
+        dropped_++;
+        return;
+    }
+    frame_ms_ = 0.f;
+    for (size_t i = 0; i + 1 < frame.used; i += 2) {
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.queries[i + 1], GL_QUERY_RESULT, &end);
+        push_sample(frame.names[i / 2], (end - begin) / 1e6f);
+        frame_ms_ += (end - begin) / 1e6f;
+    }
+
+#ifdef DEBUG
+    check_gl_error();
+#endif
+}
+
+void GpuProfiler::push_sample(const std::string& name, float ms) {
+    auto itr = std::find_if(passes_.begin(), passes_.end(), [&name](const PassSamples& pass) {
+        return pass.name == name;
+    });
+    if (itr == passes_.end()) {
+        passes_.push_back({ name, {}, 0 });
+        itr = passes_.end() - 1;
+    }
+    if (itr->samples.size() < max_samples_) {
+        itr->samples.push_back(ms);
+    }
+    else {
+        itr->samples[itr->next % itr->samples.size()] = ms;
+    }
+    itr->next = (itr->next + 1) % max_samples_;
+}
+
+void GpuProfiler::begin_pass(const std::string& name) {
+#ifdef DEBUG
+    if (!open_pass_.empty()) {
+        throw std::runtime_error("GPU pass " + name + " begun inside " + open_pass_);
+    }
+    open_pass_ = name;
+#endif
+    if (!supported_) {
+        return;
+    }
+    Frame& frame = current();
+    if (frame.used + 2 > frame.queries.size()) {
+        frame.queries.resize(frame.used + 2);
+        glGenQueries(2, &frame.queries[frame.used]);
+    }
+    size_t pass = frame.used / 2;
+    if (pass < frame.names.size()) {
+        frame.names[pass] = name;
+    }
+    else {
+        frame.names.push_back(name);
+    }
+    // timestamps rather than GL_TIME_ELAPSED, which can't be used by a pass that another profiler already brackets
+    glQueryCounter(frame.queries[frame.used], GL_TIMESTAMP);
+}
+
+void GpuProfiler::end_pass([[maybe_unused]] const std::string& name) {
+#ifdef DEBUG
+    if (open_pass_ != name) {
+        throw std::runtime_error("GPU pass " + name + " ended while " + (open_pass_.empty() ? std::string("no pass") : open_pass_) + " is open");
+    }
+    open_pass_.clear();
+#endif
+    if (!supported_) {
+        return;
+    }
+    Frame& frame = current();
+    glQueryCounter(frame.queries[frame.used + 1], GL_TIMESTAMP);
+    frame.used += 2;
+
+#ifdef DEBUG
+    check_gl_error();
+#endif
+}
+
+std::vector<GpuPassStats> GpuProfiler::get_stats() const {
+    std::vector<GpuPassStats> stats;
+    for (auto& pass : passes_) {
+        if (pass.samples.empty()) {
+            continue;
+        }
+        std::vector<float> sorted = pass.samples;
+        std::sort(sorted.begin(), sorted.end());
+        float sum = 0.f;
+        for (float sample : sorted) {
+            sum += sample;
+        }
+        size_t last = (pass.next + pass.samples.size() - 1) % pass.samples.size();
+        size_t p99 = std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * 0.99f));
+        stats.push_back({ pass.name, pass.samples[last], sorted.front(), sum / sorted.size(), sorted[p99], sorted.size() });
+    }
+    return stats;
+}
+
+float GpuProfiler::take_frame_ms() {
+    float ms = frame_ms_;
+    frame_ms_ = -1.f;
+    return ms;
+}
+
+bool GpuProfiler::is_supported() const {
+    return supported_;
+}
+size_t GpuProfiler::get_dropped() const {
+    return dropped_;
+}
+
+void GpuProfiler::print() const {
+    if (!supported_) {
+        std::cout << "gpu profiler: timer queries unsupported" << std::endl;
+        return;
+    }
+    std::cout << "gpu passes (ms over the last " << max_samples_ << " frames, " << dropped_ << " frames dropped):" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    float total = 0.f;
+    for (auto& pass : get_stats()) {
+        std::cout << "  " << std::left << std::setw(16) << pass.name << std::right
+            << " min " << pass.min << "  mean " << pass.mean << "  p99 " << pass.p99 << std::endl;
+        total += pass.mean;
+    }
+    std::cout << "  total mean " << total << std::endl;
+    std::cout << std::defaultfloat;
+}
+
+void GpuProfiler::draw_overlay(int width, int height) const {
+    static const float colors[][3] = {
+        { 0.90f, 0.30f, 0.25f },
+        { 0.95f, 0.65f, 0.20f },
+        { 0.35f, 0.75f, 0.35f },
+        { 0.25f, 0.60f, 0.90f },
+        { 0.65f, 0.40f, 0.85f },
+        { 0.85f, 0.85f, 0.85f },
+    };
+    const int margin = 8;
+    const int bar_height = 10;
+    const int bar_gap = 4;
+    const int max_width = width / 3;
+
+    GLfloat clear_color[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+    // scissored clears draw the bars without a program or a mesh
+    glEnable(GL_SCISSOR_TEST);
+    int y = height - margin - bar_height;
+    size_t i = 0;
+    for (auto& pass : get_stats()) {
+        if (y < 0) {
+            break;
+        }
+        auto bar = [&](int x, int w, float r, float g, float b) {
+            glScissor(x, y, std::max(w, 1), bar_height);
+            glClearColor(r, g, b, 1.f);
+            glClear(GL_COLOR_BUFFER_BIT);
+        };
+        auto scale = [&](float ms) {
+            return static_cast<int>(std::min(ms / overlay_budget_ms_, 1.f) * max_width);
+        };
+        const float* color = colors[i % (sizeof(colors) / sizeof(colors[0]))];
+        bar(margin, max_width, 0.1f, 0.1f, 0.1f);
+        bar(margin, scale(pass.mean), color[0], color[1], color[2]);
+        bar(margin + scale(pass.p99), 2, 1.f, 1.f, 1.f);
+        y -= bar_height + bar_gap;
+        i++;
+    }
+    glDisable(GL_SCISSOR_TEST);
+    glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+
+#ifdef DEBUG
+    check_gl_error();
+#endif
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+
+// frames of queries in flight. results are read this many frames after they were issued, by which time the gpu is done with them
+const size_t GPU_PROFILER_FRAMES = 4;
+
+// gpu time of a pass over the recent frames, in milliseconds
+struct GpuPassStats {
+    std::string name;
+    float last = 0.f;
+    float min = 0.f;
+    float mean = 0.f;
+    float p99 = 0.f;
+    size_t samples = 0;
+};
+
+// times named passes on the gpu with timestamp queries. each frame writes its own set of queries and reads back the set
+// written GPU_PROFILER_FRAMES frames earlier, so reading the results never waits for the gpu
+class GpuProfiler {
+    struct Frame {
+        // a begin and an end timestamp for each pass
+        std::vector<uint32_t> queries;
+        std::vector<std::string> names;
+        size_t used = 0;
+    };
+
+    struct PassSamples {
+        std::string name;
+        // ring of the last max_samples_ times
+        std::vector<float> samples;
+        size_t next = 0;
+    };
+
+    std::array<Frame, GPU_PROFILER_FRAMES> frames_;
+    size_t frame_ = 0;
+    // in order of first appearance, which is the order the passes run in
+    std::vector<PassSamples> passes_;
+    bool supported_;
+    // frames whose results weren't available yet when their queries were reused
+    size_t dropped_ = 0;
+    // sum of the passes of the last frame read back, negative once taken
+    float frame_ms_ = -1.f;
+    // name of the pass between its begin and end, checked in debug builds
+    std::string open_pass_;
+
+    Frame& current();
+    void collect(Frame& frame);
+    void push_sample(const std::string& name, float ms);
+
+public:
+    // frames the stats are aggregated over
+    size_t max_samples_ = 240;
+    // bars of the overlay are scaled so that this fills the width, a 60 hz frame by default
+    float overlay_budget_ms_ = 16.6f;
+
+    // requires a current context
+    GpuProfiler();
+    ~GpuProfiler();
+    GpuProfiler(const GpuProfiler&) = delete;
+
+    // reads the results of the oldest frame in flight. call prior to the first pass of a frame
+    void begin_frame();
+    // passes can't nest, each begin is followed by the end of the same name. debug builds throw otherwise
+    void begin_pass(const std::string& name);
+    void end_pass(const std::string& name);
+
+    std::vector<GpuPassStats> get_stats() const;
+    // the gpu time of the frame read back by the last begin_frame, or a negative time if none was read since the last call
+    float take_frame_ms();
+    bool is_supported() const;
+    size_t get_dropped() const;
+    void print() const;
+    // a bar per pass along the left edge of the bound target, sized by the pass's mean and marked at its p99
+    void draw_overlay(int width, int height) const;
+};
@@ -0,0 +1,216 @@
+#include "input_log.h"
+
+#include <cstring>
+#include <stdexcept>
+
+constexpr uint32_t INPUT_LOG_MAGIC = 0x4C4E5049; // "IPNL"
+
+InputEvent InputEvent::tick(float x, float y) {
+    InputEvent event;
+    event.type = InputEventType::INPUT_TICK;
+    event.x = x;
+    event.y = y;
+    return event;
+}
+
+InputEvent InputEvent::frame(uint32_t frame_us) {
+    InputEvent event;
+    event.type = InputEventType::INPUT_FRAME;
+    event.frame_us = frame_us;
+    return event;
+}
+
+InputEvent InputEvent::key(int key, int action, int mods) {
+    InputEvent event;
+    event.type = InputEventType::INPUT_KEY;
+    event.code = key;
+    event.action = action;
+    event.mods = mods;
+    return event;
+}
+
+InputEvent InputEvent::mouse_button(int button, int action, int mods, float x, float y, int width, int height) {
+    InputEvent event;
+    event.type = InputEventType::INPUT_MOUSE_BUTTON;
+    event.code = button;
+    event.action = action;
+    event.mods = mods;
+    event.x = x;
+    event.y = y;
+    event.width = width;
+    event.height = height;
+    return event;
+}
+
+InputEvent InputEvent::scroll(float x, float y) {
+    InputEvent event;
+    event.type = InputEventType::INPUT_SCROLL;
+    event.x = x;
+    event.y = y;
+    return event;
+}
+
+InputEvent InputEvent::resize(int width, int height) {
+    InputEvent event;
+    event.type = InputEventType::INPUT_RESIZE;
+    event.width = width;
+    event.height = height;
+    return event;
+}
+
+template<typename T>
+static void write(std::ofstream& f, T value) {
+    f.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+InputRecorder::InputRecorder(const std::string& path, const InputLogHeader& header) : file_(path, std::ios::binary | std::ios::trunc) {
+    if (!file_) {
+        throw std::runtime_error("Error opening input log " + path);
+    }
+    write(file_, INPUT_LOG_MAGIC);
+    write(file_, header.version);
+    write(file_, header.timestep_ns);
+    write(file_, header.width);
+    write(file_, header.height);
+}
+
+void InputRecorder::push(const InputEvent& event) {
+    write(file_, static_cast<uint8_t>(event.type));
+    // glfw keys fit 16 bits, buttons, actions and mods 8 bits. a tick, the bulk of a log, takes 9 bytes
+    switch (event.type) {
+    case InputEventType::INPUT_TICK:
+    case InputEventType::INPUT_SCROLL:
+        write(file_, event.x);
+        write(file_, event.y);
+        break;
+    case InputEventType::INPUT_FRAME:
+        write(file_, event.frame_us);
+        break;
+    case InputEventType::INPUT_KEY:
+        write(file_, static_cast<int16_t>(event.code));
+        write(file_, static_cast<uint8_t>(event.action));
+        write(file_, static_cast<uint8_t>(event.mods));
+        break;
+    case InputEventType::INPUT_MOUSE_BUTTON:
+        write(file_, static_cast<uint8_t>(event.code));
+        write(file_, static_cast<uint8_t>(event.action));
+        write(file_, static_cast<uint8_t>(event.mods));
+        write(file_, event.x);
+        write(file_, event.y);
+        write(file_, static_cast<uint16_t>(event.width));
+        write(file_, static_cast<uint16_t>(event.height));
+        break;
+    case InputEventType::INPUT_RESIZE:
+        write(file_, static_cast<uint16_t>(event.width));
+        write(file_, static_cast<uint16_t>(event.height));
+        break;
+    default:
+        throw std::runtime_error("Error recording input, unknown event type");
+    }
+    events_++;
+}
+
+void InputRecorder::flush() {
+    file_.flush();
+}
+
+size_t InputRecorder::get_events() const {
+    return events_;
+}
+
+InputReplayer::InputReplayer(const std::string& path) {
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) {
+        throw std::runtime_error("Error opening input log " + path);
+    }
+    data_.resize(f.tellg());
+    f.seekg(0);
+    f.read(data_.data(), data_.size());
+    if (!f) {
+        throw std::runtime_error("Error reading input log " + path);
+    }
+
+    if (read<uint32_t>() != INPUT_LOG_MAGIC) {
+        throw std::runtime_error("Error reading input log " + path + ", not an input log");
+    }
+    header_.version = read<uint32_t>();
+    if (header_.version != INPUT_LOG_VERSION) {
+        throw std::runtime_error("Error reading input log " + path + ", version " + std::to_string(header_.version) + " is unsupported");
+    }
+    header_.timestep_ns = read<uint32_t>();
+    header_.width = read<int32_t>();
+    header_.height = read<int32_t>();
+}
+
+template<typename T>
+T InputReplayer::read() {
+    if (pos_ + sizeof(T) > data_.size()) {
+        throw std::runtime_error("Error reading input log, unexpected end");
+    }
+    T value;
+    std::memcpy(&value, data_.data() + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return value;
+}
+
+// bytes written after the type byte of each event
+static const size_t EVENT_SIZES[InputEventType::NUM_INPUT_EVENT_TYPES] = { 8, 4, 4, 15, 8, 4 };
+
+bool InputReplayer::next(InputEvent& event) {
+    if (pos_ == data_.size()) {
+        return false;
+    }
+    uint8_t type = read<uint8_t>();
+    if (type < InputEventType::NUM_INPUT_EVENT_TYPES && data_.size() - pos_ < EVENT_SIZES[type]) {
+        // the recorder flushes once a frame, a crash can leave part of the last event
+        truncated_ = true;
+        pos_ = data_.size();
+        return false;
+    }
+    event = InputEvent();
+    event.type = static_cast<InputEventType>(type);
+    switch (event.type) {
+    case InputEventType::INPUT_TICK:
+    case InputEventType::INPUT_SCROLL:
+        event.x = read<float>();
+        event.y = read<float>();
+        break;
+    case InputEventType::INPUT_FRAME:
+        event.frame_us = read<uint32_t>();
+        frames_++;
+        break;
+    case InputEventType::INPUT_KEY:
+        event.code = read<int16_t>();
+        event.action = read<uint8_t>();
+        event.mods = read<uint8_t>();
+        break;
+    case InputEventType::INPUT_MOUSE_BUTTON:
+        event.code = read<uint8_t>();
+        event.action = read<uint8_t>();
+        event.mods = read<uint8_t>();
+        event.x = read<float>();
+        event.y = read<float>();
+        event.width = read<uint16_t>();
+        event.height = read<uint16_t>();
+        break;
+    case InputEventType::INPUT_RESIZE:
+        event.width = read<uint16_t>();
+        event.height = read<uint16_t>();
+        break;
+    default:
+        throw std::runtime_error("Error reading input log, unknown event type " + std::to_string(type));
+    }
+    return true;
+}
+
+const InputLogHeader& InputReplayer::get_header() const {
+    return header_;
+}
+
+size_t InputReplayer::get_frames() const {
+    return frames_;
+}
+
+bool InputReplayer::is_truncated() const {
+    return truncated_;
+}
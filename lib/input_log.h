@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// version 1: ticks, frames, keys, mouse buttons, scrolls and resizes
+const uint32_t INPUT_LOG_VERSION = 1;
+
+enum InputEventType {
+    // a fixed timestep update, preceded by sampling the cursor
+    INPUT_TICK,
+    // the frame is drawn, after the ticks of the frame
+    INPUT_FRAME,
+    INPUT_KEY,
+    INPUT_MOUSE_BUTTON,
+    INPUT_SCROLL,
+    // the framebuffer was resized
+    INPUT_RESIZE,
+
+    NUM_INPUT_EVENT_TYPES = 6,
+};
+
+// everything the main loop and the glfw callbacks pass on to the context. only the fields of its type are written
+struct InputEvent {
+    InputEventType type = InputEventType::INPUT_TICK;
+    // key or mouse button
+    int32_t code = 0;
+    int32_t action = 0;
+    int32_t mods = 0;
+    // cursor in nds of a tick or a mouse button, offsets of a scroll
+    float x = 0.f;
+    float y = 0.f;
+    // window size of a mouse button, framebuffer size of a resize
+    int32_t width = 0;
+    int32_t height = 0;
+    // time since the previous frame, to replay at the recorded pace
+    uint32_t frame_us = 0;
+
+    static InputEvent tick(float x, float y);
+    static InputEvent frame(uint32_t frame_us);
+    static InputEvent key(int key, int action, int mods);
+    static InputEvent mouse_button(int button, int action, int mods, float x, float y, int width, int height);
+    static InputEvent scroll(float x, float y);
+    static InputEvent resize(int width, int height);
+};
+
+// the size and timestep the log was recorded with, which the replay has to match to reproduce it
+struct InputLogHeader {
+    uint32_t version = INPUT_LOG_VERSION;
+    uint32_t timestep_ns = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+};
+
+// appends events to a binary log: a header, then per event a type byte followed by the fields of that type in native byte order
+class InputRecorder {
+    std::ofstream file_;
+    size_t events_ = 0;
+
+public:
+    InputRecorder(const std::string& path, const InputLogHeader& header);
+
+    void push(const InputEvent& event);
+    // writes the buffered events, done every frame so that a crash keeps the log up to it
+    void flush();
+    size_t get_events() const;
+};
+
+// reads a whole log up front, so that replaying doesn't wait on disk
+class InputReplayer {
+    std::vector<char> data_;
+    size_t pos_ = 0;
+    InputLogHeader header_;
+    size_t frames_ = 0;
+    bool truncated_ = false;
+
+    template<typename T>
+    T read();
+
+public:
+    InputReplayer(const std::string& path);
+
+    // false once the log is exhausted. an event cut off by a crash while recording ends the log. throws on an unknown event
+    bool next(InputEvent& event);
+    const InputLogHeader& get_header() const;
+    // frames replayed so far
+    size_t get_frames() const;
+    // whether the log ended with a partial event
+    bool is_truncated() const;
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 #include <sstream>
 
@@ -51,17 +52,24 @@ struct Light {
     Uniform u_light_vp_{ "u_light_vp" };
 
     Light(std::string&& kind, LightTraits light_traits, glm::mat4 projection = glm::mat4{ 1.f }) : uniform_prefix_(kind), light_traits_(light_traits), projection_(projection) {}
-    void buffer() {
+    // the names follow the prefix, which arrays of lights change to index their elements
+    void set_uniform_names() {
         u_ambient_.name_ = uniform_prefix_ + ".ambient";
         u_diffuse_.name_ = uniform_prefix_ + ".diffuse";
         u_specular_.name_ = uniform_prefix_ + ".specular";
         u_shininess_.name_ = uniform_prefix_ + ".shininess";
-
+    }
+    // buffers under the names set last
+    void buffer_values() {
         u_ambient_.buffer(light_traits_.ambient_.get_trait());
         u_diffuse_.buffer(light_traits_.diffuse_.get_trait());
         u_specular_.buffer(light_traits_.specular_.get_trait());
         u_shininess_.buffer(light_traits_.shininess_);
     }
+    void buffer() {
+        set_uniform_names();
+        buffer_values();
+    }
     void buffer_shadows(glm::mat4 light_vp) {
         u_light_vp_.buffer(light_vp);
     }
@@ -128,14 +136,17 @@ struct PointLight : public Light, public MeshEntity {
         translate(glm::mat4{ 1.f }, position);
         MeshEntity::set_color(glm::vec3{ 1.f });
     }
-    void buffer() {
-        Light::buffer();
+    void set_uniform_names() {
+        Light::set_uniform_names();
 
         u_constant.name_ = uniform_prefix_ + ".constant";
         u_linear.name_ = uniform_prefix_ + ".linear";
         u_quadratic.name_ = uniform_prefix_ + ".quadratic";
 
         u_position.name_ = uniform_prefix_ + ".position";
+    }
+    void buffer_values() {
+        Light::buffer_values();
 
         u_constant.buffer(attenuation_.constant);
         u_linear.buffer(attenuation_.linear);
@@ -143,8 +154,31 @@ struct PointLight : public Light, public MeshEntity {
 
         u_position.buffer(get_origin());
     }
+    void buffer() {
+        set_uniform_names();
+        buffer_values();
+    }
 };
 
+// names the uniforms of each light after its index, e.g. point_lights[2].position. templated so that lights without a mesh can be named too
+template<typename T>
+void set_array_uniform_names(std::vector<std::shared_ptr<T>>& lights) {
+    uint32_t i = 0;
+    for (auto& light_ptr : lights) {
+        auto& light = *light_ptr;
+        auto old_prefix = light.uniform_prefix_;
+
+        std::ostringstream ss;
+        ss << "s[" << i << "]";
+        light.uniform_prefix_ += ss.str();
+
+        light.set_uniform_names();
+        light.uniform_prefix_ = old_prefix;
+
+        i++;
+    }
+}
+
 struct PointLights : public std::vector<std::shared_ptr<PointLight>> {
     using std::vector<std::shared_ptr<PointLight>>::vector;
 
@@ -152,19 +186,13 @@ struct PointLights : public std::vector<std::shared_ptr<PointLight>> {
 
     PointLights(PointLights&& point_lights) : vector(point_lights) {}
     void buffer() {
-        uint32_t i = 0;
+        // the point light uniforms are compiled out of the variants for scenes without point lights
+        if (empty()) {
+            return;
+        }
+        set_array_uniform_names(*this);
         for (auto& light_ptr : *this) {
-            auto& light = *light_ptr;
-            auto old_prefix = light.uniform_prefix_;
-
-            std::ostringstream ss;
-            ss << "s[" << i << "]";
-            light.uniform_prefix_ += ss.str();
-
-            light.buffer();
-            light.uniform_prefix_ = old_prefix;
-            
-            i++;
+            light_ptr->buffer_values();
         }
         u_num_lights.buffer(static_cast<int>(size()));
     }
@@ -175,18 +203,7 @@ struct PointLights : public std::vector<std::shared_ptr<PointLight>> {
     }
 };
 
+// selects the debug_shadows variant of the lit programs
 struct DebugShadows {
-    Uniform u_debug{ "u_debug_shadows" };
     bool debug_ = false;
-
-    void buffer() {
-        try {
-            u_debug.buffer(debug_);
-        }
-        catch (const std::runtime_error& e) {
-#ifdef DEBUG
-            std::cout << "Shadow Debug Error: " << e.what() << std::endl;
-#endif
-        }
-    }
 };
\ No newline at end of file
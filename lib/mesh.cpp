@@ -1,15 +1,22 @@
 #include "mesh.h"
+#include "cpu_profiler.h"
 
 #include <cstring>
 
 Mesh::Mesh(std::string f_path) {
+    PROFILE_ZONE("Mesh::Mesh");
     std::ifstream f(f_path);
 
     // TODO: throw error
     if (!f.is_open()) {
         throw std::runtime_error("Error opening file");
     }
+    read_off(f);
 
+    init();
+}
+
+void Mesh::read_off(std::istream& f) {
     // local scope to destroy `OFF` string
     {
         const int off_size = 3;
@@ -28,18 +35,18 @@ Mesh::Mesh(std::string f_path) {
     }
 
     // Second line: the number of vertices, number of faces, and number of edges, in order (the latter can be ignored).
-    {
-        uint n_verts, n_faces, n_edges;
-        f >> n_verts >> n_faces >> n_edges;
+    uint n_verts, n_faces, n_edges;
+    f >> n_verts >> n_faces >> n_edges;
 
-        // init buffers
-        verts_.reserve(n_verts);
-        faces_.reserve(n_faces);
-    }
+    // init buffers
+    verts_.clear();
+    faces_.clear();
+    verts_.reserve(n_verts);
+    faces_.reserve(n_faces);
 
     // push verts
     glm::vec3 vert;
-    for (size_t i = 0; i < verts_.capacity(); i++) {
+    for (size_t i = 0; i < n_verts; i++) {
         f >> vert.x >> vert.y >> vert.z;
         verts_.push_back(vert);
     }
@@ -47,7 +54,7 @@ Mesh::Mesh(std::string f_path) {
     // number of vertices for the face
     uint n_verts_face;
     // push indices
-    for (size_t i = 0; i < faces_.capacity(); i++) {
+    for (size_t i = 0; i < n_faces; i++) {
         f >> n_verts_face;
         if (static_cast<unsigned long>(n_verts_face) != TRI) {
             throw std::runtime_error("Error: Not A Triangle Mesh");
@@ -59,13 +66,13 @@ Mesh::Mesh(std::string f_path) {
         }
         faces_.push_back(indexer);
     }
-
-    init();
 }
 
 void Mesh::init() {
     centroid_ = calc_centroid();
     scale_ = calc_scale();
+    bounds_ = calc_bounds();
+    plane_ = calc_plane();
     normals_ = calc_normals();
 }
 
@@ -89,6 +96,12 @@ const glm::vec3& Mesh::get_centroid() const {
 const glm::vec3& Mesh::get_scale() const {
     return scale_;
 }
+const BoundingSphere& Mesh::get_bounds() const {
+    return bounds_;
+}
+const std::optional<glm::vec4>& Mesh::get_plane() const {
+    return plane_;
+}
 
 void Mesh::print() const {
     std::cout << verts_.size() << ' ' << faces_.size() << ' ' << ' ' << 0 << std::endl;
@@ -104,6 +117,20 @@ void Mesh::print() const {
     }
 }
 
+uint64_t Mesh::calc_hash() const {
+    // fnv-1a over the vertex and index bytes
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+    mix(verts_.data(), verts_.size() * sizeof(glm::vec3));
+    mix(faces_.data(), faces_.size() * sizeof(Indexer));
+    return hash;
+}
+
 std::vector<glm::vec3> Mesh::calc_normals() const {
     std::vector<glm::vec3> normals{ verts_.size(), glm::vec3{0.0} };
     for (const Indexer& face : get_faces()) {
@@ -142,32 +169,65 @@ glm::vec3 Mesh::calc_centroid() const {
 
     return out;
 }
-glm::vec3 Mesh::calc_scale() const {
-    float xmin = std::numeric_limits<float>::infinity();
-    float xmax = -std::numeric_limits<float>::infinity();
-    float ymin = std::numeric_limits<float>::infinity();
-    float ymax = -std::numeric_limits<float>::infinity();
-    float zmin = std::numeric_limits<float>::infinity();
-    float zmax = -std::numeric_limits<float>::infinity();
+std::pair<glm::vec3, glm::vec3> Mesh::calc_extents() const {
+    glm::vec3 min_pos{ std::numeric_limits<float>::infinity() };
+    glm::vec3 max_pos{ -std::numeric_limits<float>::infinity() };
     for (glm::vec3 pos : get_verts()) {
-        xmin = std::min(xmin, pos.x);
-        xmax = std::max(xmax, pos.x);
+        min_pos.x = std::min(min_pos.x, pos.x);
+        max_pos.x = std::max(max_pos.x, pos.x);
 
-        ymin = std::min(ymin, pos.y);
-        ymax = std::max(ymax, pos.y);
+        min_pos.y = std::min(min_pos.y, pos.y);
+        max_pos.y = std::max(max_pos.y, pos.y);
 
-        zmin = std::min(zmin, pos.z);
-        zmax = std::max(zmax, pos.z);
+        min_pos.z = std::min(min_pos.z, pos.z);
+        max_pos.z = std::max(max_pos.z, pos.z);
     }
+    return { min_pos, max_pos };
+}
+glm::vec3 Mesh::calc_scale() const {
+    auto [min_pos, max_pos] = calc_extents();
 
-    float x_dist = xmax - xmin;
-    float y_dist = ymax - ymin;
-    float z_dist = zmax - zmin;
+    float x_dist = max_pos.x - min_pos.x;
+    float y_dist = max_pos.y - min_pos.y;
+    float z_dist = max_pos.z - min_pos.z;
     auto dists = std::array<float, 3>{ x_dist, y_dist, z_dist };
     float max_dist = *std::max_element(dists.begin(), dists.end());
 
     return glm::vec3{ 1.f / max_dist };
 }
+BoundingSphere Mesh::calc_bounds() const {
+    auto [min_pos, max_pos] = calc_extents();
+
+    return { (min_pos + max_pos) * 0.5f, glm::length(max_pos - min_pos) * 0.5f };
+}
+std::optional<glm::vec4> Mesh::calc_plane() const {
+    if (get_faces().empty()) {
+        return std::nullopt;
+    }
+    const Indexer& first = get_faces()[0];
+    glm::vec3 origin = get_verts()[first[0]];
+    glm::vec3 normal = glm::cross(get_verts()[first[1]] - origin, get_verts()[first[2]] - origin);
+    if (glm::length(normal) == 0.f) {
+        return std::nullopt;
+    }
+    normal = glm::normalize(normal);
+
+    // tolerance relative to the size of the mesh
+    float epsilon = 1e-4f * bounds_.radius;
+    for (glm::vec3 pos : get_verts()) {
+        if (std::abs(glm::dot(normal, pos - origin)) > epsilon) {
+            return std::nullopt;
+        }
+    }
+    // faces facing the other way would see the back of the reflection
+    for (const Indexer& face : get_faces()) {
+        Triangle tri{ get_verts()[face[0]], get_verts()[face[1]], get_verts()[face[2]] };
+        if (glm::dot(glm::cross(tri[1] - tri[0], tri[2] - tri[0]), normal) <= 0.f) {
+            return std::nullopt;
+        }
+    }
+    return glm::vec4(normal, -glm::dot(normal, origin));
+}
 
 void RenderMesh::init(int VAO, uint32_t VBO, uint32_t EBO) {
     // bind to VAO
@@ -227,6 +287,26 @@ glm::vec3 MeshEntity::get_position() {
     return get_mesh().get_centroid();
 }
 
+std::optional<glm::vec4> MeshEntity::get_plane() {
+    const std::optional<glm::vec4>& plane = get_mesh().get_plane();
+    if (!plane.has_value()) {
+        return std::nullopt;
+    }
+    // planes transform with the inverse transpose
+    glm::vec4 world_plane = glm::transpose(glm::inverse(trans_)) * plane.value();
+    return world_plane / glm::length(glm::vec3(world_plane));
+}
+bool MeshEntity::is_planar_reflector() {
+    return get_shader() == ShaderPrograms::REFLECT && get_dyn_reflections() && get_mesh().get_plane().has_value();
+}
+
+BoundingSphere MeshEntity::get_bounds() {
+    const BoundingSphere& bounds = get_mesh().get_bounds();
+    // conservatively scale by the largest axis
+    float scale = std::max(glm::length(glm::vec3(trans_[0])), std::max(glm::length(glm::vec3(trans_[1])), glm::length(glm::vec3(trans_[2]))));
+    return { glm::vec3(trans_ * glm::vec4(bounds.center, 1.f)), bounds.radius * scale };
+}
+
 void MeshEntity::set_color(glm::vec3 new_color) {
     color_ = new_color;
 }
@@ -240,9 +320,13 @@ float MeshEntity::intersected_triangles(glm::vec3 world_ray_origin, glm::vec3 wo
     glm::vec3 model_ray_origin = glm::inverse(trans_) * glm::vec4(world_ray_origin, 1.f);
     glm::vec3 model_ray_dir = glm::inverse(trans_) * glm::vec4(world_ray_dir, 0.f);
 
+    return mesh.intersected_triangles(model_ray_origin, model_ray_dir);
+}
+
+float Mesh::intersected_triangles(glm::vec3 model_ray_origin, glm::vec3 model_ray_dir) const {
     float min_dist = std::numeric_limits<float>::infinity();
-    for (const Indexer& face : mesh.get_faces()) {
-        std::array<glm::vec3, TRI> tri{ mesh.get_verts()[face[0]], mesh.get_verts()[face[1]], mesh.get_verts()[face[2]] };
+    for (const Indexer& face : get_faces()) {
+        std::array<glm::vec3, TRI> tri{ get_verts()[face[0]], get_verts()[face[1]], get_verts()[face[2]] };
 
         glm::vec2 bary_pos;
         float distance;
@@ -274,6 +358,8 @@ void MeshEntity::draw() {
 
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     glDrawElements(GL_TRIANGLES, mesh_ref.get_faces().size() * TRI, GL_UNSIGNED_INT, 0);
+    render_stats().count(RenderCounter::DRAW_CALLS);
+    render_stats().count(RenderCounter::TRIANGLES, mesh_ref.get_faces().size());
 
 #ifdef DEBUG
     check_gl_error();
@@ -290,6 +376,8 @@ void MeshEntity::draw_minimal() {
     u_model_trans.buffer(trans_);
 
     glDrawElements(GL_TRIANGLES, mesh_ref.get_faces().size() * TRI, GL_UNSIGNED_INT, 0);
+    render_stats().count(RenderCounter::DRAW_CALLS);
+    render_stats().count(RenderCounter::TRIANGLES, mesh_ref.get_faces().size());
 
 #ifdef DEBUG
     check_gl_error();
@@ -304,6 +392,8 @@ void MeshEntity::draw_none() {
     glBindVertexArray(mesh_ref.VAO_);
 
     glDrawElements(GL_TRIANGLES, mesh_ref.get_faces().size() * TRI, GL_UNSIGNED_INT, 0);
+    render_stats().count(RenderCounter::DRAW_CALLS);
+    render_stats().count(RenderCounter::TRIANGLES, mesh_ref.get_faces().size());
 
 #ifdef DEBUG
     check_gl_error();
@@ -323,6 +413,8 @@ void MeshEntity::draw_wireframe() {
     // // glLineWidth doesn't work, maybe an Apple driver bug 
     // glLineWidth(2.f);
     glDrawElements(GL_TRIANGLES, mesh_ref.get_faces().size() * TRI, GL_UNSIGNED_INT, 0);
+    render_stats().count(RenderCounter::DRAW_CALLS);
+    render_stats().count(RenderCounter::TRIANGLES, mesh_ref.get_faces().size());
 
     glEnable(GL_CULL_FACE);
 
@@ -345,6 +437,7 @@ MeshEntityList MeshFactory::push(std::vector<Mesh> meshes) {
     for (uint i = 0; i < meshes.size(); i++) {
         // assign gl objects and commit to mesh list
         meshes_.push_back(std::make_unique<RenderMesh>(VAOs[i], VBOs[i], EBOs[i], std::move(meshes[i])));
+        hashes_.push_back(meshes_.back()->calc_hash());
 
 #ifdef DEBUG
         check_gl_error();
@@ -359,6 +452,9 @@ MeshEntityList MeshFactory::push(std::vector<Mesh> meshes) {
 const std::vector<std::unique_ptr<RenderMesh>>& MeshFactory::get_meshes() const {
     return meshes_;
 }
+const std::vector<uint64_t>& MeshFactory::get_hashes() const {
+    return hashes_;
+}
 
 MeshEntity MeshFactory::get_mesh_entity(int i) {
     return MeshEntity{ *this, MeshFactory::get_from_kind(i) };
@@ -21,6 +21,8 @@
 #include <optional>
 #include <memory>
 #include <functional>
+#include <limits>
+#include <utility>
 
 enum DefMeshList {
     NUM_DEF_MESHES = 4,
@@ -37,19 +39,29 @@ using Indexer = std::array<uint32_t, TRI>;
 
 class MeshEntity;
 
+struct BoundingSphere {
+    glm::vec3 center;
+    float radius;
+};
+
 // vertex and mesh computations
 class Mesh {
     std::vector<glm::vec3> verts_;
     std::vector<Indexer> faces_;
 
     std::vector<glm::vec3> normals_;
-    std::vector<glm::vec3> calc_normals() const;
-
 	glm::vec3 centroid_ = glm::vec3{ 0.f };
-	glm::vec3 calc_centroid() const;
-
 	glm::vec3 scale_ = glm::vec3{ 1.f };
-	glm::vec3 calc_scale() const;
+
+    // never culled until computed
+    BoundingSphere bounds_{ glm::vec3{ 0.f }, std::numeric_limits<float>::infinity() };
+    BoundingSphere calc_bounds() const;
+    // min and max corners of the axis aligned bounding box
+    std::pair<glm::vec3, glm::vec3> calc_extents() const;
+
+    // set when every face lies in one plane facing the same way
+    std::optional<glm::vec4> plane_;
+    std::optional<glm::vec4> calc_plane() const;
 
 protected:
     void init();
@@ -59,6 +71,9 @@ public:
     // file path constructor
     Mesh(std::string f_path);
 
+    // replaces the verts and faces with those of an OFF file of triangles, without computing the derived data
+    void read_off(std::istream& f);
+
     // accessors
 
     void push_back(glm::vec3 vert, const Indexer& indexer);
@@ -67,12 +82,23 @@ public:
     const std::vector<Indexer>& get_faces() const;
     const glm::vec3& get_centroid() const;
     const glm::vec3& get_scale() const;
+    // model space bounding sphere
+    const BoundingSphere& get_bounds() const;
+    // model space plane of flat meshes, as (normal, d) with dot(normal, pos) + d = 0
+    const std::optional<glm::vec4>& get_plane() const;
 
     void print() const;
 
     // operations
     // TODO
     void gen_normals();
+    std::vector<glm::vec3> calc_normals() const;
+    glm::vec3 calc_centroid() const;
+    glm::vec3 calc_scale() const;
+    // identifies the mesh by its verts and faces, so that scenes reference prototypes regardless of the order they were loaded in
+    uint64_t calc_hash() const;
+    // distance along the model space ray to the nearest intersected triangle, -1 if none is intersected
+    float intersected_triangles(glm::vec3 model_ray_origin, glm::vec3 model_ray_dir) const;
 };
 
 class UnitCube : public Mesh {
@@ -170,6 +196,12 @@ public:
     void set_to_origin();
     glm::vec3 get_origin();
     glm::vec3 get_position() override;
+    // world space bounding sphere
+    BoundingSphere get_bounds();
+    // world space plane of flat meshes, normalized
+    std::optional<glm::vec4> get_plane();
+    // flat meshes reflect dynamically with a mirrored pass instead of an env map
+    bool is_planar_reflector();
 
     const RenderMesh& get_mesh();
 
@@ -202,6 +234,8 @@ public:
 class MeshFactory {
     // store meshes as unique pointers to avoid copy operations and so that mem gets deallocated at the end of the program
     std::vector<std::unique_ptr<RenderMesh>> meshes_;
+    // calc_hash of each mesh, computed once when pushed
+    std::vector<uint64_t> hashes_;
 
     // n is DefMeshList or user defined MeshList
     static size_t get_from_kind(int n) {
@@ -217,6 +251,7 @@ public:
     MeshEntityList push(std::vector<Mesh> meshes);
 
     const std::vector<std::unique_ptr<RenderMesh>>& get_meshes() const;
+    const std::vector<uint64_t>& get_hashes() const;
 
     MeshEntity get_mesh_entity(int i);
     MeshEntity get_mesh_entity(size_t i);
@@ -0,0 +1,142 @@
+#include "probe.h"
+
+#include <algorithm>
+
+#include <glm/gtc/constants.hpp>
+
+void EnvProbe::schedule(ProbeUpdate update, glm::vec3 origin, size_t signature) {
+    switch (update) {
+    case ProbeUpdate::EVERY_FRAME:
+        invalidate();
+        break;
+    case ProbeUpdate::ROUND_ROBIN:
+        dirty_ |= 1 << next_face_;
+        next_face_ = (next_face_ + 1) % num_faces_;
+        break;
+    case ProbeUpdate::ON_CHANGE:
+        if (origin != origin_ || signature != signature_) {
+            invalidate();
+        }
+        break;
+    default:
+        break;
+    }
+    origin_ = origin;
+    signature_ = signature;
+}
+
+void EnvProbe::invalidate() {
+    dirty_ = all_faces_;
+}
+
+bool EnvProbe::is_dirty() const {
+    return dirty_ != 0;
+}
+
+size_t EnvProbe::pop_dirty() {
+    for (size_t i = 0; i < num_faces_; i++) {
+        if (dirty_ & (1 << i)) {
+            dirty_ &= ~(1 << i);
+            return i;
+        }
+    }
+    throw std::runtime_error("Probe has no stale faces");
+}
+
+uint8_t EnvProbe::pop_dirty_mask(int max_faces) {
+    uint8_t mask = 0;
+    for (int i = 0; i < max_faces && is_dirty(); i++) {
+        mask |= 1 << pop_dirty();
+    }
+    return mask;
+}
+
+uint8_t CubeMapProbe::visible_faces(const BoundingSphere& bounds) const {
+    glm::vec3 center = bounds.center - get_origin();
+    // distance to the side planes of a 90 degree frustum along axis a is (s * p[a] -+ p[b]) / sqrt(2)
+    float min_dist = -bounds.radius * glm::root_two<float>();
+
+    uint8_t mask = 0;
+    for (size_t i = 0; i < NUM_CUBE_FACES; i++) {
+        int axis = i / 2;
+        float depth = i % 2 == 0 ? center[axis] : -center[axis];
+        float side_a = center[(axis + 1) % 3];
+        float side_b = center[(axis + 2) % 3];
+        if (depth - side_a >= min_dist && depth + side_a >= min_dist && depth - side_b >= min_dist && depth + side_b >= min_dist) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+}
+
+size_t EnvProbe::get_num_faces() const {
+    return num_faces_;
+}
+glm::vec3 EnvProbe::get_origin() const {
+    return origin_;
+}
+float EnvProbe::get_radius() const {
+    return radius_;
+}
+void EnvProbe::set_radius(float radius) {
+    radius_ = radius;
+}
+
+EnvProjection CubeMapProbe::get_projection() const {
+    return EnvProjection::CUBE_MAP;
+}
+void CubeMapProbe::bind(uint32_t tex_unit) {
+    CubeMapTex::bind(tex_unit);
+}
+void CubeMapProbe::bind() {
+    CubeMapTex::bind();
+}
+
+EnvProjection ParaboloidProbe::get_projection() const {
+    return EnvProjection::DUAL_PARABOLOID;
+}
+void ParaboloidProbe::bind(uint32_t tex_unit) {
+    TextureArray::bind(tex_unit);
+}
+void ParaboloidProbe::bind() {
+    TextureArray::bind();
+}
+
+uint8_t ParaboloidProbe::visible_faces(const BoundingSphere& bounds) const {
+    float depth = bounds.center.z - get_origin().z;
+    uint8_t mask = 0;
+    if (depth - bounds.radius <= 0.f) {
+        mask |= 1 << 0;
+    }
+    if (depth + bounds.radius >= 0.f) {
+        mask |= 1 << 1;
+    }
+    return mask;
+}
+
+float ReflectionProbe::get_weight(glm::vec3 pos) const {
+    return glm::max(1.f - glm::length(pos - position_) / influence_radius_, 0.f);
+}
+
+glm::vec3 ReflectionProbe::get_position() const {
+    return position_;
+}
+void ReflectionProbe::set_position(glm::vec3 position) {
+    position_ = position;
+}
+float ReflectionProbe::get_influence_radius() const {
+    return influence_radius_;
+}
+void ReflectionProbe::set_influence_radius(float influence_radius) {
+    influence_radius_ = influence_radius;
+}
+ProbeUpdate ReflectionProbe::get_update() const {
+    return update_;
+}
+void ReflectionProbe::set_update(ProbeUpdate update) {
+    update_ = update;
+}
+
+bool ProbeCapture::is_excluded(const MeshEntity* mesh_entity) const {
+    return std::find(excluded.begin(), excluded.end(), mesh_entity) != excluded.end();
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "cubemap.h"
+#include "mesh.h"
+#include "rendereable.h"
+
+constexpr size_t NUM_PARABOLOID_SIDES = 2;
+
+// a dynamic env map owned by one reflective entity, or shared by several through a ReflectionProbe
+// keeps track of which faces are stale so that captures can be spread across frames
+class EnvProbe {
+    size_t num_faces_;
+    uint8_t all_faces_;
+
+    // bit i set when face i needs to be re-captured
+    uint8_t dirty_;
+    // next face for round robin updates
+    size_t next_face_ = 0;
+
+    // state at the last schedule, for change detection
+    glm::vec3 origin_{ 0.f };
+    size_t signature_ = 0;
+
+    // meshes within the radius invalidate the probe when they move
+    float radius_ = 10.f;
+
+public:
+    EnvProbe(size_t num_faces) : num_faces_(num_faces), all_faces_((1 << num_faces) - 1), dirty_(all_faces_) {}
+    virtual ~EnvProbe() = default;
+
+    virtual EnvProjection get_projection() const = 0;
+    virtual void bind(uint32_t tex_unit) = 0;
+    // mask of the faces whose frustum intersects the sphere
+    virtual uint8_t visible_faces(const BoundingSphere& bounds) const = 0;
+
+    // marks faces as stale according to the update policy. call once per frame
+    void schedule(ProbeUpdate update, glm::vec3 origin, size_t signature);
+    // marks all faces as stale
+    void invalidate();
+
+    bool is_dirty() const;
+    // returns the next stale face and marks it as captured
+    size_t pop_dirty();
+    // returns a mask of up to max_faces stale faces and marks them as captured
+    uint8_t pop_dirty_mask(int max_faces);
+
+    size_t get_num_faces() const;
+    glm::vec3 get_origin() const;
+    float get_radius() const;
+    void set_radius(float radius);
+};
+
+// six faces in gl face order
+class CubeMapProbe : public CubeMapTex, public EnvProbe {
+public:
+    CubeMapProbe(int width) : CubeMapTex(width), EnvProbe(NUM_CUBE_FACES) {}
+
+    EnvProjection get_projection() const override;
+    void bind(uint32_t tex_unit) override;
+    void bind() override;
+    uint8_t visible_faces(const BoundingSphere& bounds) const override;
+};
+
+// two layers, the -z hemisphere and the +z hemisphere rotated half a turn around y
+class ParaboloidProbe : public TextureArray, public EnvProbe {
+public:
+    ParaboloidProbe(int width) : TextureArray(width, width, NUM_PARABOLOID_SIDES, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE), EnvProbe(NUM_PARABOLOID_SIDES) {}
+
+    EnvProjection get_projection() const override;
+    void bind(uint32_t tex_unit) override;
+    void bind() override;
+    uint8_t visible_faces(const BoundingSphere& bounds) const override;
+};
+
+// a placeable probe shared by the env mapped meshes within its influence volume
+class ReflectionProbe : public CubeMapProbe {
+    glm::vec3 position_;
+    // meshes farther than this from the position don't sample the probe
+    float influence_radius_;
+    ProbeUpdate update_ = ProbeUpdate::ON_CHANGE;
+
+public:
+    ReflectionProbe(int width, glm::vec3 position, float influence_radius) : CubeMapProbe(width), position_(position), influence_radius_(influence_radius) {}
+
+    // 1 at the position falling off to 0 at the edge of the influence volume
+    float get_weight(glm::vec3 pos) const;
+
+    glm::vec3 get_position() const;
+    void set_position(glm::vec3 position);
+    float get_influence_radius() const;
+    void set_influence_radius(float influence_radius);
+    ProbeUpdate get_update() const;
+    void set_update(ProbeUpdate update);
+};
+using ReflectionProbes = std::vector<std::shared_ptr<ReflectionProbe>>;
+
+// the env maps sampled by one mesh, blend_probe is mixed in with weight blend
+struct ProbeBinding {
+    EnvProbe* probe = nullptr;
+    EnvProbe* blend_probe = nullptr;
+    float blend = 0.f;
+};
+
+// a probe to schedule this frame, excluded are the meshes sampling it which are left out of its capture
+struct ProbeCapture {
+    EnvProbe* probe;
+    glm::vec3 origin;
+    ProbeUpdate update;
+    std::vector<MeshEntity*> excluded;
+
+    bool is_excluded(const MeshEntity* mesh_entity) const;
+};
@@ -0,0 +1,187 @@
+#include "program_cache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "renderer.h"
+#include "utilities.h"
+
+// bumped whenever the layout below changes
+constexpr uint32_t PROGRAM_CACHE_MAGIC = 0x50424E31; // "PBN1"
+
+// fnv-1a, detects binaries that were damaged on disk
+static uint32_t checksum(const std::vector<char>& data) {
+    uint32_t hash = 2166136261u;
+    for (char c : data) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+static std::string get_gl_string(GLenum name) {
+    const GLubyte* str = glGetString(name);
+    return str == nullptr ? "" : reinterpret_cast<const char*>(str);
+}
+
+ProgramCache::ProgramCache(std::string dir_path) : dir_path_(std::move(dir_path)) {
+    driver_ = get_gl_string(GL_VENDOR) + "\n" + get_gl_string(GL_RENDERER) + "\n" + get_gl_string(GL_VERSION);
+
+    // drivers may support the extension without any binary format, in which case nothing can be saved
+    GLint num_formats = 0;
+    if (GLEW_ARB_get_program_binary) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    }
+    supported_ = num_formats > 0;
+
+#ifdef DEBUG
+    check_gl_error();
+#endif
+}
+
+std::string ProgramCache::get_path(size_t key) const {
+    std::ostringstream ss;
+    ss << dir_path_ << std::hex << key << ".bin";
+    return ss.str();
+}
+
+size_t ProgramCache::get_key(const std::string& vertex_shader_string,
+    const std::string& geometry_shader_string,
+    const std::string& fragment_shader_string,
+    const std::string& fragment_data_name) const {
+    size_t key = 0;
+    hash_combine(key, vertex_shader_string);
+    hash_combine(key, geometry_shader_string);
+    hash_combine(key, fragment_shader_string);
+    hash_combine(key, fragment_data_name);
+    hash_combine(key, driver_);
+    return key;
+}
+
+bool ProgramCache::load(uint32_t program, size_t key) {
+    bool loaded = supported_ && read_binary(program, key);
+    if (loaded) {
+        hits_++;
+    }
+    else {
+        misses_++;
+    }
+    return loaded;
+}
+
+bool ProgramCache::read_binary(uint32_t program, size_t key) const {
+    std::ifstream f(get_path(key), std::ios::binary);
+    if (!f) {
+        return false;
+    }
+
+    uint32_t magic = 0;
+    size_t stored_key = 0;
+    uint32_t driver_size = 0;
+    f.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    f.read(reinterpret_cast<char*>(&stored_key), sizeof(stored_key));
+    f.read(reinterpret_cast<char*>(&driver_size), sizeof(driver_size));
+    if (!f || magic != PROGRAM_CACHE_MAGIC || stored_key != key || driver_size != driver_.size()) {
+        return false;
+    }
+    // the key is a hash, the driver is compared in full so that a collision can't hand a binary to the wrong driver
+    std::string driver(driver_size, '\0');
+    f.read(driver.data(), driver_size);
+
+    uint32_t format = 0;
+    uint32_t size = 0;
+    uint32_t sum = 0;
+    f.read(reinterpret_cast<char*>(&format), sizeof(format));
+    f.read(reinterpret_cast<char*>(&size), sizeof(size));
+    f.read(reinterpret_cast<char*>(&sum), sizeof(sum));
+    // binaries are in the hundreds of kilobytes, a larger size is a damaged header
+    if (!f || driver != driver_ || size == 0 || size > (64u << 20)) {
+        return false;
+    }
+    std::vector<char> binary(size);
+    f.read(binary.data(), size);
+    if (!f || checksum(binary) != sum) {
+        return false;
+    }
+
+    glProgramBinary(program, format, binary.data(), size);
+    // drivers may still reject a binary, e.g. after an update that kept the version string
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    // clears the error a rejected format raises
+    glGetError();
+    return status == GL_TRUE;
+}
+
+void ProgramCache::prepare(uint32_t program) const {
+    if (supported_) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+}
+
+bool ProgramCache::save(uint32_t program, size_t key) const {
+    if (!supported_) {
+        return false;
+    }
+
+    GLint size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0) {
+        return false;
+    }
+    std::vector<char> binary(size);
+    GLenum format = 0;
+    glGetProgramBinary(program, size, nullptr, &format, binary.data());
+
+#ifdef DEBUG
+    check_gl_error();
+#endif
+
+    std::error_code error;
+    std::filesystem::create_directories(dir_path_, error);
+    if (error) {
+        return false;
+    }
+
+    std::string path = get_path(key);
+    // written next to the binary and renamed over it, so that an interrupted write never leaves a truncated binary behind
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream f(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!f) {
+            return false;
+        }
+        uint32_t driver_size = static_cast<uint32_t>(driver_.size());
+        uint32_t binary_format = format;
+        uint32_t binary_size = static_cast<uint32_t>(size);
+        uint32_t sum = checksum(binary);
+        f.write(reinterpret_cast<const char*>(&PROGRAM_CACHE_MAGIC), sizeof(PROGRAM_CACHE_MAGIC));
+        f.write(reinterpret_cast<const char*>(&key), sizeof(key));
+        f.write(reinterpret_cast<const char*>(&driver_size), sizeof(driver_size));
+        f.write(driver_.data(), driver_size);
+        f.write(reinterpret_cast<const char*>(&binary_format), sizeof(binary_format));
+        f.write(reinterpret_cast<const char*>(&binary_size), sizeof(binary_size));
+        f.write(reinterpret_cast<const char*>(&sum), sizeof(sum));
+        f.write(binary.data(), binary.size());
+        if (!f) {
+            return false;
+        }
+    }
+    return replace_file(tmp_path, path);
+}
+
+void ProgramCache::clear() const {
+    std::error_code error;
+    std::filesystem::remove_all(dir_path_, error);
+}
+
+bool ProgramCache::is_supported() const {
+    return supported_;
+}
+size_t ProgramCache::get_hits() const {
+    return hits_;
+}
+size_t ProgramCache::get_misses() const {
+    return misses_;
+}
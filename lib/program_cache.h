@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+const std::string PROGRAM_CACHE_PATH = "../data/programs.cache/";
+
+// linked program binaries stored on disk, so that later runs can skip compiling and linking the shaders
+// binaries are keyed by the sources and the driver, a driver update or an edited shader compiles the program again
+class ProgramCache {
+    std::string dir_path_;
+    // vendor, renderer and version strings, binaries are only valid for the driver that produced them
+    std::string driver_;
+    bool supported_;
+
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+
+    std::string get_path(size_t key) const;
+    bool read_binary(uint32_t program, size_t key) const;
+
+public:
+    // requires a current context
+    ProgramCache(std::string dir_path);
+
+    size_t get_key(const std::string& vertex_shader_string,
+        const std::string& geometry_shader_string,
+        const std::string& fragment_shader_string,
+        const std::string& fragment_data_name) const;
+
+    // loads the binary into the program. returns false if it is missing, stale, corrupt or rejected by the driver,
+    // in which case the program has to be linked from source
+    bool load(uint32_t program, size_t key);
+    // call prior to linking a program that will be saved
+    void prepare(uint32_t program) const;
+    // returns false if the binary couldn't be written, which only costs the next run a compile
+    bool save(uint32_t program, size_t key) const;
+    // removes every stored binary, the next run starts cold
+    void clear() const;
+
+    bool is_supported() const;
+    size_t get_hits() const;
+    size_t get_misses() const;
+};
+
+// shared cache of the renderers' programs
+inline ProgramCache& program_cache() {
+    static ProgramCache cache{ PROGRAM_CACHE_PATH };
+    return cache;
+}
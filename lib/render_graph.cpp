@@ -0,0 +1,185 @@
+#include "render_graph.h"
+#include "cpu_profiler.h"
+
+#include <stdexcept>
+
+void RenderGraph::PassBuilder::read(Resource resource) {
+    graph_.passes_[pass_].reads.push_back(resource);
+}
+void RenderGraph::PassBuilder::write(Resource resource, LoadOp load) {
+    graph_.passes_[pass_].writes.push_back({ resource, load });
+}
+void RenderGraph::PassBuilder::side_effect() {
+    graph_.passes_[pass_].side_effect = true;
+}
+
+void RenderGraph::reset() {
+    resources_.clear();
+    passes_.clear();
+}
+
+RenderGraph::Resource RenderGraph::import(const std::string& name, FBO& fbo, bool output) {
+    ResourceNode node;
+    node.name = name;
+    node.fbo = &fbo;
+    node.output = output;
+    resources_.push_back(node);
+    return resources_.size() - 1;
+}
+
+RenderGraph::Resource RenderGraph::create(const std::string& name, const RenderTargetKey& key) {
+    ResourceNode node;
+    node.name = name;
+    node.key = key;
+    resources_.push_back(node);
+    return resources_.size() - 1;
+}
+
+void RenderGraph::add_pass(const std::string& name, std::function<void(PassBuilder&)> setup, std::function<void()> execute) {
+    passes_.push_back({ name, {}, {}, std::move(execute) });
+    PassBuilder builder{ *this, passes_.size() - 1 };
+    setup(builder);
+}
+
+FBO& RenderGraph::get(Resource resource) {
+    FBO* fbo = resources_.at(resource).fbo;
+    if (fbo == nullptr) {
+        throw std::runtime_error("Render target " + resources_[resource].name + " is not allocated");
+    }
+    return *fbo;
+}
+
+void RenderGraph::compile() {
+    // walks the passes backwards, a pass is live if a later live pass or an output needs one of its writes
+    std::vector<bool> needed(resources_.size());
+    for (size_t i = 0; i < resources_.size(); i++) {
+        needed[i] = resources_[i].output;
+    }
+    for (size_t i = passes_.size(); i-- > 0;) {
+        Pass& pass = passes_[i];
+        bool live = pass.side_effect;
+        for (auto& write : pass.writes) {
+            live = live || needed[write.resource];
+        }
+        pass.culled = !live;
+        if (pass.culled) {
+            continue;
+        }
+        // a discarding write doesn't need what was written before it
+        for (auto& write : pass.writes) {
+            if (write.load == DISCARD && !resources_[write.resource].output) {
+                needed[write.resource] = false;
+            }
+        }
+        for (auto& write : pass.writes) {
+            if (write.load == LOAD) {
+                needed[write.resource] = true;
+            }
+        }
+        for (Resource read : pass.reads) {
+            needed[read] = true;
+        }
+    }
+
+    for (size_t i = 0; i < passes_.size(); i++) {
+        if (passes_[i].culled) {
+            continue;
+        }
+        auto use = [&](Resource resource) {
+            ResourceNode& node = resources_[resource];
+            if (!node.used) {
+                node.first_use = i;
+                node.used = true;
+            }
+            node.last_use = i;
+        };
+        for (Resource read : passes_[i].reads) {
+            use(read);
+        }
+        for (auto& write : passes_[i].writes) {
+            use(write.resource);
+        }
+    }
+}
+
+void RenderGraph::clear(Resource resource) {
+    get(resource).bind();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+#ifdef DEBUG
+    check_gl_error();
+#endif
+}
+
+void RenderGraph::execute(RenderTargetPool& render_targets) {
+    compile();
+
+    // whether the target holds anything yet, pooled targets come with the last user's contents
+    std::vector<bool> defined(resources_.size());
+    for (size_t i = 0; i < resources_.size(); i++) {
+        defined[i] = !resources_[i].key.has_value();
+    }
+
+    for (size_t i = 0; i < passes_.size(); i++) {
+        Pass& pass = passes_[i];
+        if (pass.culled) {
+            continue;
+        }
+
+        for (size_t r = 0; r < resources_.size(); r++) {
+            ResourceNode& node = resources_[r];
+            if (node.used && node.first_use == i && node.key.has_value()) {
+                const RenderTargetKey& key = node.key.value();
+                if (key.format == DEPTH) {
+                    node.fbo = &render_targets.acquire_depth(key.width, key.height);
+                }
+                else if (key.samples > 0) {
+                    node.fbo = &render_targets.acquire_offscreen_msaa(key.width, key.height, key.samples);
+                }
+                else {
+                    node.fbo = &render_targets.acquire_offscreen(key.width, key.height);
+                }
+            }
+        }
+
+        for (auto& write : pass.writes) {
+            // drawing over a target that holds nothing yet starts from a cleared one
+            bool needs_clear = write.load == CLEAR || (write.load == LOAD && !defined[write.resource]);
+            if (needs_clear) {
+                clear(write.resource);
+            }
+            defined[write.resource] = true;
+        }
+
+        if (on_pass_begin_) {
+            on_pass_begin_(pass.name);
+        }
+        {
+            ProfileZone zone(pass.name);
+            pass.execute();
+        }
+        if (on_pass_end_) {
+            on_pass_end_(pass.name);
+        }
+
+        // released targets may be handed to a later pass in this frame
+        for (auto& node : resources_) {
+            if (node.used && node.last_use == i && node.key.has_value()) {
+                render_targets.release(*node.fbo);
+                node.fbo = nullptr;
+            }
+        }
+    }
+}
+
+size_t RenderGraph::get_num_passes() const {
+    return passes_.size();
+}
+
+size_t RenderGraph::get_num_culled() const {
+    size_t culled = 0;
+    for (auto& pass : passes_) {
+        culled += pass.culled;
+    }
+    return culled;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "framebuffer.h"
+#include "render_target_pool.h"
+
+// what a pass needs from the previous contents of a target it writes
+enum LoadOp {
+    LOAD,  // draws over the contents
+    CLEAR,  // clears color, depth and stencil first
+    DISCARD,  // overwrites every pixel, e.g. with a blit, so the contents are never cleared
+    NUM_LOAD_OPS = 3
+};
+
+// frame graph rebuilt every frame. passes declare the targets they read and write and are executed in the order they were added
+// passes whose writes are never read by a later pass or an output are culled. transient targets are acquired from the pool on their first use
+// and released after their last, and clears are only issued where a pass needs one
+class RenderGraph {
+public:
+    using Resource = size_t;
+
+    class PassBuilder {
+        friend class RenderGraph;
+        RenderGraph& graph_;
+        size_t pass_;
+
+        PassBuilder(RenderGraph& graph, size_t pass) : graph_(graph), pass_(pass) {}
+
+    public:
+        void read(Resource resource);
+        void write(Resource resource, LoadOp load = LOAD);
+        // the pass has effects outside of the graph and is never culled
+        void side_effect();
+    };
+
+private:
+    struct ResourceNode {
+        std::string name;
+        // empty for imported targets
+        std::optional<RenderTargetKey> key;
+        FBO* fbo = nullptr;
+        bool output = false;
+        // pass indices of the first and last live use
+        size_t first_use = 0;
+        size_t last_use = 0;
+        bool used = false;
+    };
+
+    struct Write {
+        Resource resource;
+        LoadOp load;
+    };
+
+    struct Pass {
+        std::string name;
+        std::vector<Resource> reads;
+        std::vector<Write> writes;
+        std::function<void()> execute;
+        bool side_effect = false;
+        bool culled = false;
+    };
+
+    std::vector<ResourceNode> resources_;
+    std::vector<Pass> passes_;
+
+    // culls the passes that don't contribute to an output and finds the lifetime of each target
+    void compile();
+    void clear(Resource resource);
+
+public:
+    // called around each executed pass with its name, for profiling
+    std::function<void(const std::string&)> on_pass_begin_;
+    std::function<void(const std::string&)> on_pass_end_;
+
+    // removes every pass and resource of the last frame, the hooks are kept
+    void reset();
+
+    // a target owned outside of the graph. outputs keep the passes writing to them alive
+    Resource import(const std::string& name, FBO& fbo, bool output = false);
+    // a target allocated from the pool for the passes that use it this frame
+    Resource create(const std::string& name, const RenderTargetKey& key);
+    void add_pass(const std::string& name, std::function<void(PassBuilder&)> setup, std::function<void()> execute);
+
+    // only valid while a pass using the resource executes
+    FBO& get(Resource resource);
+    template <typename T>
+    T& get(Resource resource) {
+        return static_cast<T&>(get(resource));
+    }
+
+    void execute(RenderTargetPool& render_targets);
+
+    size_t get_num_passes() const;
+    size_t get_num_culled() const;
+};
@@ -0,0 +1,102 @@
+#include "render_stats.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "utilities.h"
+
+void RenderStats::set_enabled(bool enabled) {
+    if (enabled && !is_enabled()) {
+        history_.clear();
+        next_ = 0;
+    }
+    for (auto& counter : counters_) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void RenderStats::end_frame() {
+    frame_++;
+    if (!is_enabled()) {
+        return;
+    }
+    RenderStatsFrame snapshot;
+    snapshot.frame = frame_;
+    for (size_t i = 0; i < counters_.size(); i++) {
+        snapshot.counters[i] = counters_[i].exchange(0, std::memory_order_relaxed);
+    }
+    if (history_.size() < max_history_) {
+        history_.push_back(snapshot);
+    }
+    else {
+        history_[next_ % history_.size()] = snapshot;
+    }
+    next_++;
+}
+
+RenderStatsFrame RenderStats::get_current() const {
+    RenderStatsFrame current;
+    current.frame = frame_ + 1;
+    for (size_t i = 0; i < counters_.size(); i++) {
+        current.counters[i] = counters_[i].load(std::memory_order_relaxed);
+    }
+    return current;
+}
+
+RenderStatsFrame RenderStats::get_last() const {
+    if (history_.empty()) {
+        return {};
+    }
+    return history_[(next_ - 1) % history_.size()];
+}
+
+std::vector<RenderStatsFrame> RenderStats::get_history() const {
+    std::vector<RenderStatsFrame> history;
+    size_t size = history_.size();
+    for (size_t i = next_ - size; i < next_; i++) {
+        history.push_back(history_[i % size]);
+    }
+    return history;
+}
+
+void RenderStats::print_last() const {
+    RenderStatsFrame last = get_last();
+    std::cout << "render stats of frame " << last.frame << ":" << std::endl;
+    for (int i = 0; i < RenderCounter::NUM_RENDER_COUNTERS; i++) {
+        std::cout << "  " << RENDER_COUNTER_NAMES[i] << ": " << last.counters[i] << std::endl;
+    }
+}
+
+bool RenderStats::export_csv(const std::string& path) const {
+    std::error_code error;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, error);
+    }
+
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream f(tmp_path, std::ios::trunc);
+        if (!f) {
+            return false;
+        }
+        f << "frame";
+        for (auto name : RENDER_COUNTER_NAMES) {
+            f << "," << name;
+        }
+        f << "\n";
+        for (auto& frame : get_history()) {
+            f << frame.frame;
+            for (auto counter : frame.counters) {
+                f << "," << counter;
+            }
+            f << "\n";
+        }
+        if (!f) {
+            return false;
+        }
+    }
+    return replace_file(tmp_path, path);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const std::string RENDER_STATS_PATH = "../data/render_stats.csv";
+
+enum RenderCounter {
+    DRAW_CALLS,
+    TRIANGLES,
+    PROGRAM_BINDS,
+    // through Uniform::buffer, raw glUniform calls aren't counted
+    UNIFORM_UPLOADS,
+    TEXTURE_BINDS,
+    FBO_BINDS,
+
+    NUM_RENDER_COUNTERS = 6,
+};
+
+const char* const RENDER_COUNTER_NAMES[RenderCounter::NUM_RENDER_COUNTERS] = {
+    "draw_calls", "triangles", "program_binds", "uniform_uploads", "texture_binds", "fbo_binds"
+};
+
+// the counters of one frame
+struct RenderStatsFrame {
+    uint64_t frame = 0;
+    std::array<uint64_t, RenderCounter::NUM_RENDER_COUNTERS> counters{};
+
+    uint64_t get(RenderCounter counter) const {
+        return counters[counter];
+    }
+};
+
+// counts the gl work of each frame. the counters are relaxed atomics, so they can be incremented from any thread without a lock
+// disabled a count is one relaxed load, so the calls stay in release builds
+class RenderStats {
+    std::atomic<bool> enabled_{ false };
+    std::array<std::atomic<uint64_t>, RenderCounter::NUM_RENDER_COUNTERS> counters_{};
+    uint64_t frame_ = 0;
+
+    // ring of the last max_history_ frames
+    std::vector<RenderStatsFrame> history_;
+    size_t next_ = 0;
+
+public:
+    // frames kept in the history
+    size_t max_history_ = 600;
+
+    bool is_enabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+    // a disabled registry drops the current frame's counts, enabling it starts a new history
+    void set_enabled(bool enabled);
+
+    void count(RenderCounter counter, uint64_t n = 1) {
+        if (is_enabled()) {
+            counters_[counter].fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+    // snapshots the frame's counters into the history and resets them. call once per frame after drawing
+    void end_frame();
+
+    // the counters of the frame being drawn so far
+    RenderStatsFrame get_current() const;
+    // the last completed frame, zeroed if there is none
+    RenderStatsFrame get_last() const;
+    // oldest first
+    std::vector<RenderStatsFrame> get_history() const;
+
+    void print_last() const;
+    // a row per frame of the history with a column per counter
+    bool export_csv(const std::string& path) const;
+};
+
+// shared counters of every renderer
+inline RenderStats& render_stats() {
+    static RenderStats stats;
+    return stats;
+}
@@ -0,0 +1,80 @@
+#include "render_target_pool.h"
+
+#include <algorithm>
+
+bool RenderTargetKey::operator==(const RenderTargetKey& other) const {
+    return format == other.format && width == other.width && height == other.height && samples == other.samples;
+}
+
+std::unique_ptr<FBO> RenderTargetPool::make_target(const RenderTargetKey& key) {
+    if (key.format == DEPTH) {
+        return std::make_unique<Depth_FBO>(key.width, key.height);
+    }
+    if (key.samples > 0) {
+        return std::make_unique<Offscreen_FBO_Multisample>(key.width, key.height, key.samples);
+    }
+    return std::make_unique<Offscreen_FBO>(key.width, key.height);
+}
+
+size_t RenderTargetPool::get_bytes(const RenderTargetKey& key) {
+    size_t texels = static_cast<size_t>(key.width) * key.height * std::max(key.samples, 1);
+    // rgba8 color and a packed depth stencil, or a depth map drivers store in four bytes
+    return texels * (key.format == DEPTH ? 4 : 8);
+}
+
+FBO& RenderTargetPool::acquire(const RenderTargetKey& key) {
+    frame_stats_.acquires++;
+    auto slot = std::find_if(slots_.begin(), slots_.end(), [&key](const Slot& slot) {
+        return !slot.in_use && slot.key == key;
+    });
+    if (slot == slots_.end()) {
+        frame_stats_.allocations++;
+        slots_.push_back({ key, make_target(key) });
+        slot = slots_.end() - 1;
+    }
+    slot->in_use = true;
+    slot->last_used = frame_;
+    return *slot->fbo;
+}
+
+Offscreen_FBO& RenderTargetPool::acquire_offscreen(int width, int height) {
+    return static_cast<Offscreen_FBO&>(acquire({ COLOR_DEPTH_STENCIL, width, height, 0 }));
+}
+Offscreen_FBO_Multisample& RenderTargetPool::acquire_offscreen_msaa(int width, int height, int samples) {
+    return static_cast<Offscreen_FBO_Multisample&>(acquire({ COLOR_DEPTH_STENCIL, width, height, samples }));
+}
+Depth_FBO& RenderTargetPool::acquire_depth(int width, int height) {
+    return static_cast<Depth_FBO&>(acquire({ DEPTH, width, height, 0 }));
+}
+
+void RenderTargetPool::release(FBO& fbo) {
+    for (auto& slot : slots_) {
+        if (slot.fbo.get() == &fbo) {
+            slot.in_use = false;
+            return;
+        }
+    }
+}
+
+void RenderTargetPool::begin_frame() {
+    frame_++;
+    frame_stats_ = {};
+    auto idle = std::remove_if(slots_.begin(), slots_.end(), [&](const Slot& slot) {
+        return frame_ - slot.last_used > max_idle_frames_;
+    });
+    frame_stats_.frees = slots_.end() - idle;
+    slots_.erase(idle, slots_.end());
+    for (auto& slot : slots_) {
+        slot.in_use = false;
+    }
+}
+
+RenderTargetStats RenderTargetPool::get_stats() const {
+    RenderTargetStats stats = frame_stats_;
+    stats.targets = slots_.size();
+    for (auto& slot : slots_) {
+        stats.in_use += slot.in_use;
+        stats.bytes += get_bytes(slot.key);
+    }
+    return stats;
+}
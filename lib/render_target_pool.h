@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "framebuffer.h"
+
+enum RenderTargetFormat {
+    COLOR_DEPTH_STENCIL,  // rgba8 color with a depth24 stencil8 attachment
+    DEPTH,  // depth only, sampled as a shadow map
+    NUM_RENDER_TARGET_FORMATS = 2
+};
+
+struct RenderTargetKey {
+    RenderTargetFormat format;
+    int width;
+    int height;
+    int samples;  // 0 for single sampled targets
+
+    bool operator==(const RenderTargetKey& other) const;
+};
+
+struct RenderTargetStats {
+    size_t targets = 0;
+    size_t in_use = 0;
+    // estimated vram of every allocated target
+    size_t bytes = 0;
+    // counted since the start of the frame
+    size_t acquires = 0;
+    size_t allocations = 0;
+    size_t frees = 0;
+};
+
+// hands out render targets by format, size and samples. a released target is handed to the next pass that asks for the same key,
+// so passes that don't overlap share the same memory. targets are allocated on first request, so disabled features cost no vram
+class RenderTargetPool {
+    struct Slot {
+        RenderTargetKey key;
+        std::unique_ptr<FBO> fbo;
+        bool in_use = false;
+        uint64_t last_used = 0;
+    };
+
+    std::vector<Slot> slots_;
+    uint64_t frame_ = 0;
+    RenderTargetStats frame_stats_;
+
+    FBO& acquire(const RenderTargetKey& key);
+    static std::unique_ptr<FBO> make_target(const RenderTargetKey& key);
+    static size_t get_bytes(const RenderTargetKey& key);
+
+public:
+    // targets that go unused for this many frames are freed, which drops the old sizes after a window resize
+    uint64_t max_idle_frames_ = 2;
+
+    Offscreen_FBO& acquire_offscreen(int width, int height);
+    Offscreen_FBO_Multisample& acquire_offscreen_msaa(int width, int height, int samples = 4);
+    Depth_FBO& acquire_depth(int width, int height);
+    // returns the target to the pool, it must not be used again this frame
+    void release(FBO& fbo);
+
+    // releases every target and frees those that have been idle for longer than max_idle_frames_. call prior to drawing
+    void begin_frame();
+
+    RenderTargetStats get_stats() const;
+};
@@ -1,12 +1,49 @@
 #pragma once
 
+#include <memory>
+
 #include "renderer.h"
 
+// how often a dynamic reflection's cubemap is re-captured
+enum ProbeUpdate {
+    // all six faces every frame
+    EVERY_FRAME,
+    // one face per frame
+    ROUND_ROBIN,
+    // all six faces only when the probe or a mesh within its radius moved
+    ON_CHANGE,
+    // all six faces once, then only when invalidated explicitly
+    BAKED,
+
+    NUM_PROBE_UPDATES = 4,
+};
+
+// the probe update policies that will be cycled through
+class ProbeUpdateCycler : public Cycler<ProbeUpdate> { using Cycler::Cycler; };
+
+// how a dynamic env map is projected
+enum EnvProjection {
+    // six faces, captured in up to six passes
+    CUBE_MAP,
+    // two hemispheres, captured in one or two passes at lower quality
+    DUAL_PARABOLOID,
+
+    NUM_ENV_PROJECTIONS = 2,
+};
+
+class EnvProbe;
 
 class ShaderObject {
     ShaderPrograms shader_ = ShaderPrograms::PHONG;
+    // compile time keys of the shader, the keys that depend on the scene are set when drawing
+    ShaderVariant variant_;
     DrawMode draw_mode_ = DrawMode::DEF_DRAW_MODE;
     bool dynamic_refl_ = true;
+    ProbeUpdate probe_update_ = ProbeUpdate::ON_CHANGE;
+    EnvProjection env_projection_ = EnvProjection::CUBE_MAP;
+
+    // cached dynamic env map, created by the Environment the first time it is captured
+    std::shared_ptr<EnvProbe> probe_;
 
 public:
     DrawMode get_draw_mode() {
@@ -21,12 +58,44 @@ public:
     virtual void set_shader(ShaderPrograms shader) {
         shader_ = shader;
     }
+    const ShaderVariant& get_variant() {
+        return variant_;
+    }
+    virtual void set_variant(const ShaderVariant& variant) {
+        variant_ = variant;
+    }
     virtual void set_dyn_reflections(bool state) {
         dynamic_refl_ = state;
     }
     bool get_dyn_reflections() {
         return dynamic_refl_;
     }
+    // whether the shader samples an env map
+    bool is_env_mapped() {
+        return shader_ == ShaderPrograms::REFLECT || shader_ == ShaderPrograms::REFRACT;
+    }
+    // whether the env map is captured from the scene rather than the static cubemap
+    bool is_dyn_env_mapped() {
+        return dynamic_refl_ && is_env_mapped();
+    }
+    virtual void set_probe_update(ProbeUpdate probe_update) {
+        probe_update_ = probe_update;
+    }
+    ProbeUpdate get_probe_update() {
+        return probe_update_;
+    }
+    virtual void set_env_projection(EnvProjection env_projection) {
+        env_projection_ = env_projection;
+    }
+    EnvProjection get_env_projection() {
+        return env_projection_;
+    }
+    void set_probe(std::shared_ptr<EnvProbe> probe) {
+        probe_ = std::move(probe);
+    }
+    EnvProbe* get_probe() {
+        return probe_.get();
+    }
 
     virtual void draw() = 0;
-};
\ No newline at end of file
+};
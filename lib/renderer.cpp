@@ -1,6 +1,11 @@
 #include "renderer.h"
+#include "cpu_profiler.h"
 
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
 #include <iostream>
+#include <sstream>
 
 ShaderProgramFile::ShaderProgramFile(const std::string& vertex_path,
     const Optional<std::string> geometry_path,
@@ -8,8 +13,12 @@ ShaderProgramFile::ShaderProgramFile(const std::string& vertex_path,
     const std::string& fragment_data_name) :
     ShaderProgram(),
     vert_path_(vertex_path),
-    frag_path_(fragment_path) {
-    init(vertex_path, geometry_path, fragment_path, fragment_data_name);
+    frag_path_(fragment_path),
+    fragment_data_name_(fragment_data_name) {
+    if (geometry_path.has_value()) {
+        geom_path_ = geometry_path->get();
+        has_geom_ = true;
+    }
 }
 
 ShaderProgramFile::ShaderProgramFile(const std::string& vertex_path,
@@ -17,29 +26,183 @@ ShaderProgramFile::ShaderProgramFile(const std::string& vertex_path,
     const std::string& fragment_path,
     const std::string& fragment_data_name,
     FileWatcher& file_watcher) :
+    ShaderProgramFile(vertex_path, geometry_path, fragment_path, fragment_data_name, {}, &file_watcher) {}
+
+ShaderProgramFile::ShaderProgramFile(const std::string& vertex_path,
+    const Optional<std::string> geometry_path,
+    const std::string& fragment_path,
+    const std::string& fragment_data_name,
+    std::vector<std::string> defines,
+    FileWatcher* file_watcher) :
     ShaderProgramFile(vertex_path, geometry_path, fragment_path, fragment_data_name) {
-    file_watcher.add_path(get_vert_path(), {});
-    if (get_geom_path().size() > 0) file_watcher.add_path(get_geom_path(), {});
-    file_watcher.add_path(get_frag_path(), {});
+    defines_ = std::move(defines);
+    file_watcher_ = file_watcher;
+    if (file_watcher_) {
+        // the includes are watched from the start, so that an edit to one before the program is compiled isn't missed
+        std::string vert, geom, frag;
+        read_sources(vert, geom, frag);
+    }
+}
+
+std::string ShaderProgramFile::get_source(const std::string& path) const {
+    return get_source(path, defines_);
+}
+
+void ShaderProgramFile::read_sources(std::string& vertex_shader_string, std::string& geometry_shader_string, std::string& fragment_shader_string) {
+    std::vector<std::string> dependencies;
+    vertex_shader_string = get_source(vert_path_, defines_, &dependencies);
+    geometry_shader_string = has_geom() ? get_source(geom_path_, defines_, &dependencies) : "";
+    fragment_shader_string = get_source(frag_path_, defines_, &dependencies);
+    dependencies_ = std::move(dependencies);
+    if (file_watcher_) {
+        // files included since the last read are watched from now on. add_path ignores the ones already watched
+        for (auto& path : dependencies_) {
+            file_watcher_->add_path(path, {});
+        }
+    }
+}
+
+std::string ShaderProgramFile::expand_includes(const std::string& path, std::vector<std::string>& included) {
+    if (std::find(included.begin(), included.end(), path) != included.end()) {
+        return "";
+    }
+    included.push_back(path);
+
+    std::istringstream file(get_file_str(path));
+    std::string source;
+    std::string line;
+    for (int line_num = 1; std::getline(file, line); line_num++) {
+        size_t directive = line.find_first_not_of(" \t");
+        if (directive == std::string::npos || line.compare(directive, 8, "#include") != 0) {
+            source += line + "\n";
+            continue;
+        }
+        size_t begin = line.find('"', directive);
+        size_t end = begin == std::string::npos ? std::string::npos : line.find('"', begin + 1);
+        if (end == std::string::npos) {
+            throw std::runtime_error("Error including, expected #include \"path\" in " + path + ":" + std::to_string(line_num));
+        }
+        std::filesystem::path include_path = std::filesystem::path(path).parent_path() / line.substr(begin + 1, end - begin - 1);
+        source += expand_includes(include_path.lexically_normal().generic_string(), included);
+    }
+    return source;
+}
+
+std::string ShaderProgramFile::get_source(const std::string& path, const std::vector<std::string>& defines, std::vector<std::string>* dependencies) {
+    // each stage includes a file once, though the stages of a program may include the same files
+    std::vector<std::string> included;
+    std::string source = expand_includes(path, included);
+    if (dependencies) {
+        for (auto& file : included) {
+            if (std::find(dependencies->begin(), dependencies->end(), file) == dependencies->end()) {
+                dependencies->push_back(file);
+            }
+        }
+    }
+    if (defines.empty()) {
+        return source;
+    }
+    // the #version directive has to come first, comments before it are allowed
+    size_t version = source.find("#version");
+    size_t line_end = version == std::string::npos ? std::string::npos : source.find('\n', version);
+    if (line_end == std::string::npos) {
+        throw std::runtime_error("Error adding defines, no #version line in " + path);
+    }
+    std::string lines;
+    for (auto& define : defines) {
+        lines += "#define " + define + "\n";
+    }
+    return source.insert(line_end + 1, lines);
 }
 
 bool ShaderProgramFile::init(const std::string& vertex_path,
     const Optional<std::string> geometry_path,
     const std::string& fragment_path,
     const std::string& fragment_data_name) {
-    std::string vertex_shader_string = get_file_str(vertex_path);
+    std::string vertex_shader_string = get_source(vertex_path);
 
     std::string geometry_shader_string = "";
     if (geometry_path.has_value()) {
         geom_path_ = geometry_path->get();
-        geometry_shader_string = get_file_str(geometry_path->get());
+        geometry_shader_string = get_source(geometry_path->get());
     }
 
-    std::string fragment_shader_string = get_file_str(fragment_path);
+    std::string fragment_shader_string = get_source(fragment_path);
 
     return ShaderProgram::init(vertex_shader_string, geometry_shader_string, fragment_shader_string, fragment_data_name);
 }
 
+void ShaderProgramFile::compile() {
+    if (get_state() != PROGRAM_UNCOMPILED) {
+        return;
+    }
+    std::string vert, geom, frag;
+    read_sources(vert, geom, frag);
+    begin_init(vert, geom, frag, fragment_data_name_);
+}
+
+bool ShaderProgramFile::is_changed(const FileWatcher& file_watcher) const {
+    return std::any_of(dependencies_.begin(), dependencies_.end(), [&file_watcher](const std::string& path) {
+        return file_watcher.check_change(path);
+    });
+}
+
+void ShaderProgramFile::begin_reload() {
+    std::string vert, geom, frag;
+    try {
+        read_sources(vert, geom, frag);
+    }
+    catch (const std::exception& e) {
+        // e.g. a missing include, or the file is caught mid save
+        std::cout << "Shader reload failed, keeping the last program: " << e.what() << std::endl;
+        return;
+    }
+    // a reload that is still compiling is superseded
+    reloaded_ = std::make_unique<ShaderProgram>();
+    reloaded_->begin_init(vert, geom, frag, fragment_data_name_);
+}
+
+bool ShaderProgramFile::end_reload(bool wait) {
+    if (!reloaded_) {
+        return true;
+    }
+    if (!wait && !reloaded_->is_ready()) {
+        return false;
+    }
+    if (reloaded_->end_init()) {
+        swap(*reloaded_);
+        // the old program's shaders are detached before it is deleted
+        reloaded_->free();
+        glDeleteProgram(reloaded_->program_shader);
+    }
+    else {
+        // end_init has already deleted the failed program
+        std::cout << "Shader reload failed, keeping the last program: " << frag_path_ << std::endl;
+    }
+    reloaded_.reset();
+    return true;
+}
+
+bool ShaderProgramFile::link() {
+    compile();
+    return end_init();
+}
+
+void ShaderProgramFile::compile_stages() {
+    if (!vertex_shader) {
+        vertex_shader = create_shader_helper(GL_VERTEX_SHADER, get_source(get_vert_path()));
+        glAttachShader(program_shader, vertex_shader);
+    }
+    if (has_geom() && !geometry_shader) {
+        geometry_shader = create_shader_helper(GL_GEOMETRY_SHADER, get_source(get_geom_path()));
+        glAttachShader(program_shader, geometry_shader);
+    }
+    if (!fragment_shader) {
+        fragment_shader = create_shader_helper(GL_FRAGMENT_SHADER, get_source(get_frag_path()));
+        glAttachShader(program_shader, fragment_shader);
+    }
+}
+
 void ShaderProgram::attach_link(uint32_t shader_id) {
     glAttachShader(program_shader, shader_id);
     glLinkProgram(program_shader);
@@ -60,9 +223,10 @@ void ShaderProgram::attach_link(uint32_t shader_id) {
 }
 
 void ShaderProgramFile::reload_vert() {
+    compile_stages();
     free_vert();
 
-    std::string vert_str = get_file_str(get_vert_path());
+    std::string vert_str = get_source(get_vert_path());
     // #ifdef DEBUG
     //     std::cout << "true vert" << std::endl;
     // #endif
@@ -78,9 +242,10 @@ void ShaderProgramFile::reload_vert(const std::string& f_path) {
 }
 
 void ShaderProgramFile::reload_geom() {
+    compile_stages();
     free_geom();
 
-    std::string geom_str = get_file_str(get_geom_path());
+    std::string geom_str = get_source(get_geom_path());
 #ifdef DEBUG
     std::cout << "true geom" << std::endl;
 #endif
@@ -96,9 +261,10 @@ void ShaderProgramFile::reload_geom(const std::string& f_path) {
 }
 
 void ShaderProgramFile::reload_frag() {
+    compile_stages();
     free_frag();
 
-    std::string frag_str = get_file_str(get_frag_path());
+    std::string frag_str = get_source(get_frag_path());
     // #ifdef DEBUG
     //     std::cout << "true" << std::endl;
     // #endif
@@ -119,27 +285,69 @@ bool ShaderProgram::init(
     const std::string& fragment_shader_string,
     const std::string& fragment_data_name)
 {
-    using namespace std;
-    vertex_shader = create_shader_helper(GL_VERTEX_SHADER, vertex_shader_string);
-    fragment_shader = create_shader_helper(GL_FRAGMENT_SHADER, fragment_shader_string);
-    if (geometry_shader_string.size() > 0) {
-        geometry_shader = create_shader_helper(GL_GEOMETRY_SHADER, geometry_shader_string);
-    }
-
-    if (!vertex_shader || !fragment_shader || (geometry_shader_string.size() > 0 && !geometry_shader))
-        return false;
+    begin_init(vertex_shader_string, geometry_shader_string, fragment_shader_string, fragment_data_name);
+    return end_init();
+}
 
+void ShaderProgram::begin_init(
+    const std::string& vertex_shader_string,
+    const std::string& geometry_shader_string,
+    const std::string& fragment_shader_string,
+    const std::string& fragment_data_name)
+{
+    has_geom_ = geometry_shader_string.size() > 0;
     program_shader = glCreateProgram();
 
+    // a binary linked by an earlier run skips compiling and linking. its stages are only compiled if it is relinked on reload
+    size_t key = program_cache().get_key(vertex_shader_string, geometry_shader_string, fragment_shader_string, fragment_data_name);
+    if (program_cache().load(program_shader, key)) {
+        state_ = PROGRAM_LINKED;
+        return;
+    }
+
+    // the statuses are only queried by end_init, so that drivers with KHR_parallel_shader_compile don't block here
+    vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_shader_string);
+    fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_shader_string);
     glAttachShader(program_shader, vertex_shader);
     glAttachShader(program_shader, fragment_shader);
-    if (geometry_shader_string.size() > 0) {
+    if (has_geom_) {
+        geometry_shader = compile_shader(GL_GEOMETRY_SHADER, geometry_shader_string);
         glAttachShader(program_shader, geometry_shader);
     }
 
     glBindFragDataLocation(program_shader, 0, fragment_data_name.c_str());
+    program_cache().prepare(program_shader);
     glLinkProgram(program_shader);
 
+    pending_ = PendingLink{ key, vertex_shader_string, geometry_shader_string, fragment_shader_string };
+    state_ = PROGRAM_COMPILING;
+
+#ifdef DEBUG
+    check_gl_error();
+#endif
+}
+
+bool ShaderProgram::end_init()
+{
+    using namespace std;
+    if (state_ != PROGRAM_COMPILING) {
+        return state_ == PROGRAM_LINKED;
+    }
+    PendingLink pending = std::move(pending_.value());
+    pending_.reset();
+
+    bool compiled = check_shader(vertex_shader, GL_VERTEX_SHADER, pending.vertex_shader_string)
+        && check_shader(fragment_shader, GL_FRAGMENT_SHADER, pending.fragment_shader_string)
+        && (!has_geom_ || check_shader(geometry_shader, GL_GEOMETRY_SHADER, pending.geometry_shader_string));
+    if (!compiled) {
+        // the shaders are detached while the program still exists, and the program isn't leaked
+        free();
+        glDeleteProgram(program_shader);
+        program_shader = 0;
+        state_ = PROGRAM_FAILED;
+        return false;
+    }
+
     int32_t status;
     glGetProgramiv(program_shader, GL_LINK_STATUS, &status);
 
@@ -148,17 +356,19 @@ bool ShaderProgram::init(
         char buffer[512];
         glGetProgramInfoLog(program_shader, 512, NULL, buffer);
         cerr << "Linker error: " << endl << buffer << endl;
+        free();
+        glDeleteProgram(program_shader);
         program_shader = 0;
+        state_ = PROGRAM_FAILED;
         return false;
     }
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_LINE_SMOOTH);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-    glFrontFace(GL_CCW);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    if (!program_cache().save(program_shader, pending.cache_key) && program_cache().is_supported()) {
+#ifdef DEBUG
+        cout << "Program binary could not be cached" << endl;
+#endif
+    }
+    state_ = PROGRAM_LINKED;
 
 #ifdef DEBUG
     check_gl_error();
@@ -167,6 +377,25 @@ bool ShaderProgram::init(
     return true;
 }
 
+bool ShaderProgram::is_ready() const
+{
+    if (state_ != PROGRAM_COMPILING) {
+        return state_ != PROGRAM_UNCOMPILED;
+    }
+    // without the extension there is no way to tell without blocking
+    if (!GLEW_KHR_parallel_shader_compile) {
+        return false;
+    }
+    int32_t done = GL_FALSE;
+    glGetProgramiv(program_shader, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+ProgramState ShaderProgram::get_state() const
+{
+    return state_;
+}
+
 void ShaderProgram::bind()
 {
     glUseProgram(program_shader);
@@ -175,6 +404,17 @@ void ShaderProgram::bind()
 #endif
 }
 
+void ShaderProgram::swap(ShaderProgram& other)
+{
+    std::swap(vertex_shader, other.vertex_shader);
+    std::swap(fragment_shader, other.fragment_shader);
+    std::swap(geometry_shader, other.geometry_shader);
+    std::swap(program_shader, other.program_shader);
+    std::swap(has_geom_, other.has_geom_);
+    std::swap(pending_, other.pending_);
+    std::swap(state_, other.state_);
+}
+
 int32_t ShaderProgram::attrib(const std::string& name) const
 {
     return glGetAttribLocation(program_shader, name.c_str());
@@ -219,15 +459,28 @@ void ShaderProgram::free()
 
 uint32_t ShaderProgram::create_shader_helper(int32_t type, const std::string& shader_string)
 {
-    using namespace std;
     if (shader_string.empty())
         return (uint32_t)0;
 
+    uint32_t id = compile_shader(type, shader_string);
+    if (!check_shader(id, type, shader_string))
+        return (uint32_t)0;
+
+    return id;
+}
+
+uint32_t ShaderProgram::compile_shader(int32_t type, const std::string& shader_string)
+{
     uint32_t id = glCreateShader(type);
     const char* shader_string_const = shader_string.c_str();
     glShaderSource(id, 1, &shader_string_const, NULL);
     glCompileShader(id);
+    return id;
+}
 
+bool ShaderProgram::check_shader(uint32_t id, int32_t type, const std::string& shader_string)
+{
+    using namespace std;
     int32_t status;
     glGetShaderiv(id, GL_COMPILE_STATUS, &status);
 
@@ -243,13 +496,13 @@ uint32_t ShaderProgram::create_shader_helper(int32_t type, const std::string& sh
         cerr << shader_string << endl << endl;
         glGetShaderInfoLog(id, 512, NULL, buffer);
         cerr << "Error: " << endl << buffer << endl;
-        return (uint32_t)0;
+        return false;
     }
 #ifdef DEBUG
     check_gl_error();
 #endif
 
-    return id;
+    return true;
 }
 
 bool _check_gl_error(const char* file, int line)
@@ -284,6 +537,40 @@ void Renderer::set_selected_idx(int n) {
     selected_ = n;
 }
 
+LightClass get_light_class(size_t num_point_lights) {
+    for (int i = 0; i < LightClass::NUM_LIGHT_CLASSES; i++) {
+        if (num_point_lights <= static_cast<size_t>(LIGHT_CLASS_SIZES[i])) {
+            return static_cast<LightClass>(i);
+        }
+    }
+    return LightClass::MANY_POINT_LIGHTS;
+}
+
+std::vector<std::string> ShaderVariant::get_defines() const {
+    ShaderVariant def;
+    std::vector<std::string> defines;
+    if (shadows != def.shadows) {
+        defines.push_back("SHADOWS " + std::to_string(shadows));
+    }
+    if (pcf_size != def.pcf_size) {
+        defines.push_back("PCF_SIZE " + std::to_string(pcf_size));
+    }
+    if (light_class != def.light_class) {
+        defines.push_back("MAX_POINT_LIGHTS " + std::to_string(LIGHT_CLASS_SIZES[light_class]));
+    }
+    if (debug_shadows != def.debug_shadows) {
+        defines.push_back("DEBUG_SHADOWS " + std::to_string(debug_shadows));
+    }
+    if (post_features & POST_FXAA) defines.push_back("FXAA");
+    if (post_features & POST_FOG) defines.push_back("FOG");
+    if (post_features & POST_VIGNETTE) defines.push_back("VIGNETTE");
+    if (post_features & POST_BW) defines.push_back("BW");
+    return defines;
+}
+bool ShaderVariant::operator==(const ShaderVariant& other) const {
+    return shadows == other.shadows && pcf_size == other.pcf_size && light_class == other.light_class && debug_shadows == other.debug_shadows && post_features == other.post_features;
+}
+
 DefRenderer::DefRenderer() {
     push_back(std::unique_ptr<ShaderProgramFile>(new ShaderProgramFile{ SHADER_PATH + "def_vert.glsl", {}, SHADER_PATH + "def_frag.glsl", "out_color", file_watcher_ }));
     push_back(std::unique_ptr<ShaderProgramFile>(new ShaderProgramFile{ SHADER_PATH + "def_vert.glsl", {}, SHADER_PATH + "flat_frag.glsl", "out_color", file_watcher_ }));
@@ -298,7 +585,25 @@ DefRenderer::DefRenderer() {
     push_back(std::unique_ptr<ShaderProgramFile>(new ShaderProgramFile{ SHADER_PATH + "outline_vert.glsl", {}, SHADER_PATH + "def_frag.glsl", "out_color", file_watcher_ }));
     push_back(std::unique_ptr<ShaderProgramFile>(new ShaderProgramFile{ SHADER_PATH + "def_vert.glsl", {}, SHADER_PATH + "grid_frag.glsl", "out_color", file_watcher_ }));
     push_back(std::unique_ptr<ShaderProgramFile>(new ShaderProgramFile{ SHADER_PATH + "offscreen_vert.glsl", {}, SHADER_PATH + "offscreen_frag.glsl", "out_color", file_watcher_ }));
-    push_back(std::unique_ptr<ShaderProgramFile>(new ShaderProgramFile{ SHADER_PATH + "offscreen_vert.glsl", {}, SHADER_PATH + "fxaa_frag.glsl", "out_color", file_watcher_ }));
+    std::string cubemap_geom = std::string(SHADER_PATH + "cubemap_geom.glsl");
+    std::string cubemap_env_geom = std::string(SHADER_PATH + "cubemap_env_geom.glsl");
+    push_back(std::unique_ptr<ShaderProgramFile>(new ShaderProgramFile{ SHADER_PATH + "cubemap_vert.glsl", { cubemap_geom }, SHADER_PATH + "def_frag.glsl", "out_color", file_watcher_ }));
+    push_back(std::unique_ptr<ShaderProgramFile>(new ShaderProgramFile{ SHADER_PATH + "cubemap_vert.glsl", { cubemap_geom }, SHADER_PATH + "flat_frag.glsl", "out_color", file_watcher_ }));
+    push_back(std::unique_ptr<ShaderProgramFile>(new ShaderProgramFile{ SHADER_PATH + "cubemap_vert.glsl", { cubemap_geom }, SHADER_PATH + "phong_frag.glsl", "out_color", file_watcher_ }));
+    push_back(std::unique_ptr<ShaderProgramFile>(new ShaderProgramFile{ SHADER_PATH + "cubemap_vert.glsl", { cubemap_env_geom }, SHADER_PATH + "env_frag.glsl", "out_color", file_watcher_ }));
+    push_back(std::unique_ptr<ShaderProgramFile>(new ShaderProgramFile{ SHADER_PATH + "cubemap_vert.glsl", { cubemap_geom }, SHADER_PATH + "reflect_frag.glsl", "out_color", file_watcher_ }));
+    push_back(std::unique_ptr<ShaderProgramFile>(new ShaderProgramFile{ SHADER_PATH + "cubemap_vert.glsl", { cubemap_geom }, SHADER_PATH + "refract_frag.glsl", "out_color", file_watcher_ }));
+    std::string paraboloid_env_geom = std::string(SHADER_PATH + "paraboloid_env_geom.glsl");
+    push_back(std::unique_ptr<ShaderProgramFile>(new ShaderProgramFile{ SHADER_PATH + "offscreen_vert.glsl", { paraboloid_env_geom }, SHADER_PATH + "paraboloid_env_frag.glsl", "out_color", file_watcher_ }));
+
+    // default pipeline state, set once here rather than by each program as it is compiled, which now happens mid frame
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_LINE_SMOOTH);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glFrontFace(GL_CCW);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     bind(ShaderPrograms::PHONG);
 }
@@ -315,69 +620,258 @@ size_t Renderer::get(int n) {
 }
 
 void Renderer::bind(ShaderPrograms n) {
-    // #ifdef DEBUG
-    // std::cout << "n1: " << n << std::endl;
-    // #endif
-
-    // #ifdef DEBUG
-    // std::cout << "n2: " << n << std::endl;
-    // #endif
+    bind(n, variant_);
+}
+void Renderer::bind(ShaderPrograms n, const ShaderVariant& variant) {
+    if (layered_) {
+        n = get_layered(n, paraboloid_);
+    }
     selected_ = get(n);
-    (*this)[selected_]->bind();
+    selected_program_ = variant == ShaderVariant{} ? (*this)[selected_].get() : &get_variant(selected_, variant);
+    selected_program_->link();
+    selected_program_->bind();
+    render_stats().count(RenderCounter::PROGRAM_BINDS);
+    if (layered_) {
+        // not found for programs without a layered variant, in which case this is a noop
+        glUniform1i(uniform("u_face_mask"), face_mask_);
+        glUniform1i(uniform("u_paraboloid"), paraboloid_);
+    }
 };
 ShaderProgram& Renderer::get_selected_program() {
-    return *(*this)[selected_];
+    return *selected_program_;
 }
 ShaderProgram& Renderer::get_selected_program() const {
-    return *(*this)[selected_];
+    return *selected_program_;
 }
 ShaderPrograms Renderer::get_selected() {
     return static_cast<ShaderPrograms>(selected_ - +static_cast<int>(ShaderPrograms::NUM_SHADERS));
 }
-void Renderer::reload() {
-    // reload all that were changed
-    for (auto& shader : *this) {
-        // TODO: currently the errored shader will be loaded and gl will print errors though the program wont crash. drawing can then be resumed by fixing the error in the source
-        // a more graceful solution is to load the original program. do not free the original shader then
-        // auto clone(*shader);
-        ShaderType errored;
-        try {
-            if (file_watcher_.check_change(shader->get_vert_path())) {
-                errored = ShaderType::VERT;
-                shader->reload_vert();
-            }
-            if (shader->has_geom() && file_watcher_.check_change(shader->get_geom_path())) {
-                errored = ShaderType::GEOM;
-                shader->reload_geom();
-            }
-            if (file_watcher_.check_change(shader->get_frag_path())) {
-                errored = ShaderType::FRAG;
-                shader->reload_frag();
+ShaderPrograms Renderer::get_layered(ShaderPrograms n, bool paraboloid) {
+    switch (n) {
+    case ShaderPrograms::DEF_SHADER:
+        return ShaderPrograms::LAYERED_DEF;
+    case ShaderPrograms::FLAT:
+        return ShaderPrograms::LAYERED_FLAT;
+    case ShaderPrograms::PHONG:
+        return ShaderPrograms::LAYERED_PHONG;
+    case ShaderPrograms::ENV:
+        // the cube's straight edges don't survive the paraboloid projection, the env is resolved per pixel instead
+        return paraboloid ? ShaderPrograms::PARABOLOID_ENV : ShaderPrograms::LAYERED_ENV;
+    case ShaderPrograms::REFLECT:
+        return ShaderPrograms::LAYERED_REFLECT;
+    case ShaderPrograms::REFRACT:
+        return ShaderPrograms::LAYERED_REFRACT;
+    default:
+        return n;
+    }
+}
+bool Renderer::is_layered(ShaderPrograms n) {
+    return n >= ShaderPrograms::LAYERED_DEF && n <= ShaderPrograms::PARABOLOID_ENV;
+}
+void Renderer::set_layered(bool layered) {
+    layered_ = layered;
+}
+bool Renderer::get_layered() const {
+    return layered_;
+}
+void Renderer::set_face_mask(int face_mask) {
+    face_mask_ = face_mask;
+    if (layered_) {
+        glUniform1i(uniform("u_face_mask"), face_mask_);
+    }
+}
+void Renderer::set_paraboloid(bool paraboloid) {
+    paraboloid_ = paraboloid;
+}
+bool Renderer::get_paraboloid() const {
+    return paraboloid_;
+}
+
+void Renderer::set_variant(const ShaderVariant& variant) {
+    variant_ = variant;
+}
+const ShaderVariant& Renderer::get_variant() const {
+    return variant_;
+}
+void Renderer::set_post_features(int features) {
+    variant_.post_features = features;
+}
+int Renderer::get_post_features() const {
+    return variant_.post_features;
+}
+
+// whether the source mentions the name as a whole identifier
+static bool uses_identifier(const std::string& source, const std::string& name) {
+    auto is_identifier = [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    };
+    for (size_t pos = source.find(name); pos != std::string::npos; pos = source.find(name, pos + 1)) {
+        bool starts = pos == 0 || !is_identifier(source[pos - 1]);
+        bool ends = pos + name.size() == source.size() || !is_identifier(source[pos + name.size()]);
+        if (starts && ends) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ShaderProgramFile& Renderer::get_variant(size_t n, const ShaderVariant& variant) {
+    auto& bound = variants_[n];
+    for (auto& [key, program] : bound) {
+        if (key == variant) {
+            return *program;
+        }
+    }
+
+    ShaderProgramFile& base = *(*this)[n];
+    std::vector<std::string> paths{ base.get_vert_path(), base.get_frag_path() };
+    if (base.has_geom()) {
+        paths.push_back(base.get_geom_path());
+    }
+    std::vector<std::string> sources;
+    for (auto& path : paths) {
+        sources.push_back(ShaderProgramFile::get_source(path, {}));
+    }
+
+    // keys the sources don't use would only compile a duplicate of an existing program
+    std::vector<std::string> defines;
+    for (auto& define : variant.get_defines()) {
+        std::string name = define.substr(0, define.find(' '));
+        bool used = std::any_of(sources.begin(), sources.end(), [&name](const std::string& source) {
+            return uses_identifier(source, name);
+        });
+        if (used) {
+            defines.push_back(define);
+        }
+    }
+
+    ShaderProgramFile* program = &base;
+    if (!defines.empty()) {
+        size_t seed = 0;
+        for (auto& path : paths) {
+            hash_combine(seed, ShaderProgramFile::get_source(path, defines));
+        }
+        std::unique_ptr<ShaderProgramFile>& compiled = variant_programs_[seed];
+        if (!compiled) {
+            std::string geom_path = base.has_geom() ? base.get_geom_path() : "";
+            Optional<std::string> geom;
+            if (base.has_geom()) {
+                geom = geom_path;
             }
+            compiled = std::make_unique<ShaderProgramFile>(base.get_vert_path(), geom, base.get_frag_path(), "out_color", std::move(defines), &file_watcher_);
+        }
+        program = compiled.get();
+    }
+    bound.push_back({ variant, program });
+    return *program;
+}
+
+void Renderer::begin_prewarm(const std::vector<std::pair<ShaderPrograms, ShaderVariant>>& variants) {
+    prewarm_.clear();
+    prewarmed_ = false;
+    auto add = [this](ShaderProgramFile* program) {
+        if (std::find(prewarm_.begin(), prewarm_.end(), program) == prewarm_.end()) {
+            prewarm_.push_back(program);
+        }
+    };
+    // the base programs that are only bound as variants aren't compiled
+    std::vector<bool> replaced(size(), false);
+    for (auto& [n, variant] : variants) {
+        size_t idx = get(n);
+        ShaderProgramFile* program = variant == ShaderVariant{} ? (*this)[idx].get() : &get_variant(idx, variant);
+        replaced[idx] = replaced[idx] || program != (*this)[idx].get();
+        add(program);
+    }
+    for (size_t i = 0; i < size(); i++) {
+        if (!replaced[i]) {
+            add((*this)[i].get());
+        }
+    }
+
+    if (!GLEW_KHR_parallel_shader_compile) {
+        return;
+    }
+    // as many threads as the driver allows
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    for (ShaderProgramFile* program : prewarm_) {
+        program->compile();
+    }
+
+#ifdef DEBUG
+    check_gl_error();
+#endif
+}
+
+void Renderer::prewarm() {
+    if (prewarmed_) {
+        return;
+    }
+    prewarmed_ = true;
+    int linked = 0;
+    for (ShaderProgramFile* program : prewarm_) {
+        ProgramState state = program->get_state();
+        if (state == PROGRAM_LINKED || state == PROGRAM_FAILED) {
+            continue;
+        }
+        if (program->is_ready()) {
+            program->link();
         }
-        catch (const std::runtime_error& e) {
-            std::cout << e.what() << std::endl;
-            // *shader = clone;
-
-            // switch (errored) {
-            // case ShaderType::VERT:
-            //     shader->reload_vert();
-            //     break;
-            // case ShaderType::GEOM:
-            //     shader->reload_geom();
-            //     break;
-            // case ShaderType::FRAG:
-            //     shader->reload_frag();
-            //     break;
-            // }
+        // without the extension a compile blocks, so only a few are done per frame
+        else if (!GLEW_KHR_parallel_shader_compile && linked < prewarm_per_frame_) {
+            program->link();
+            linked++;
+        }
+        state = program->get_state();
+        if (state != PROGRAM_LINKED && state != PROGRAM_FAILED) {
+            prewarmed_ = false;
+        }
+    }
+}
+
+std::vector<ShaderProgramFile*> Renderer::get_programs() {
+    std::vector<ShaderProgramFile*> programs;
+    for (auto& program : *this) {
+        programs.push_back(program.get());
+    }
+    for (auto& [key, program] : variant_programs_) {
+        programs.push_back(program.get());
+    }
+    return programs;
+}
+
+void Renderer::reload() {
+    PROFILE_ZONE("Renderer::reload");
+    // reloads compiling on the driver's threads are swapped in once they are done
+    if (reloading_) {
+        reloading_ = false;
+        for (ShaderProgramFile* program : get_programs()) {
+            if (!program->end_reload(false)) {
+                reloading_ = true;
+            }
         }
     }
-    // mark all as unchanged
-    for (auto& shader : *this) {
-        file_watcher_.set_unchanged(shader->get_vert_path());
-        if (shader->has_geom()) {
-            file_watcher_.set_unchanged(shader->get_geom_path());
+
+    // drains the watcher's queue, nothing else is done on frames without changes
+    if (!file_watcher_.update()) {
+        return;
+    }
+
+    // only the programs built from a changed file are rebuilt, a change to an included file rebuilds every program that includes it
+    for (ShaderProgramFile* program : get_programs()) {
+        // programs that weren't compiled yet read the changed sources when they are
+        if (!program->is_changed(file_watcher_) || program->get_state() == PROGRAM_UNCOMPILED) {
+            continue;
+        }
+        // the first build has to finish before it can be replaced
+        program->link();
+        program->begin_reload();
+        // without the extension the compile blocks either way
+        if (!GLEW_KHR_parallel_shader_compile) {
+            program->end_reload(true);
+        }
+        else if (program->is_reloading()) {
+            reloading_ = true;
         }
-        file_watcher_.set_unchanged(shader->get_frag_path());
     }
+    file_watcher_.set_unchanged();
 }
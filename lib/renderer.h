@@ -46,11 +46,15 @@ bool _check_gl_error(const char* file, int line);
 
 #include "definitions.h"
 #include "filewatcher.h"
+#include "program_cache.h"
+#include "render_stats.h"
 #include "utilities.h"
 
 #include <exception>
 #include <iostream>
 #include <limits>
+#include <optional>
+#include <unordered_map>
 #include <vector>
 
 enum ShaderType {
@@ -59,9 +63,29 @@ enum ShaderType {
     VERT
 };
 
+enum ProgramState {
+    PROGRAM_UNCOMPILED,
+    // compiling and linking, on the driver's threads with KHR_parallel_shader_compile
+    PROGRAM_COMPILING,
+    PROGRAM_LINKED,
+    PROGRAM_FAILED,
+
+    NUM_PROGRAM_STATES = 4,
+};
+
 // This class wraps an OpenGL program
 class ShaderProgram
 {
+    // what end_init needs of a link started by begin_init, the sources are printed on errors
+    struct PendingLink {
+        size_t cache_key;
+        std::string vertex_shader_string;
+        std::string geometry_shader_string;
+        std::string fragment_shader_string;
+    };
+    std::optional<PendingLink> pending_;
+    ProgramState state_ = PROGRAM_UNCOMPILED;
+
 public:
     uint32_t vertex_shader;
     uint32_t fragment_shader;
@@ -76,9 +100,21 @@ public:
         const std::string& geometry_shader_string,
         const std::string& fragment_shader_string,
         const std::string& fragment_data_name);
+    // starts compiling and linking without waiting for the driver
+    void begin_init(const std::string& vertex_shader_string,
+        const std::string& geometry_shader_string,
+        const std::string& fragment_shader_string,
+        const std::string& fragment_data_name);
+    // waits for the link started by begin_init and reports its errors. returns false if the program failed
+    bool end_init();
+    // whether end_init won't block
+    bool is_ready() const;
+    ProgramState get_state() const;
 
     // Select this shader for subsequent draw calls
     void bind();
+    // exchanges the gl objects and states of the two programs
+    void swap(ShaderProgram& other);
 
     void free_vert();
     void free_geom();
@@ -88,6 +124,10 @@ public:
     void free();
 
     uint32_t create_shader_helper(int32_t type, const std::string& shader_string);
+    // starts compiling a shader without querying its status
+    static uint32_t compile_shader(int32_t type, const std::string& shader_string);
+    // prints the errors of a failed shader
+    static bool check_shader(uint32_t id, int32_t type, const std::string& shader_string);
 
     void attach_link(uint32_t shader_id);
 
@@ -97,8 +137,11 @@ public:
     int32_t uniform(const std::string& name) const;
 
     bool has_geom() {
-        return geometry_shader > 0;
+        return has_geom_;
     }
+
+protected:
+    bool has_geom_ = false;
 };
 
 // Shader source code saved on the filesystem
@@ -106,8 +149,31 @@ class ShaderProgramFile : public ShaderProgram {
     std::string vert_path_;
     std::string geom_path_;
     std::string frag_path_;
+    std::string fragment_data_name_;
+    // macros defined after the #version line of every stage, selects a permutation of the sources
+    std::vector<std::string> defines_;
+    // the stages' files and every file they include, the program is rebuilt when one of them changes
+    std::vector<std::string> dependencies_;
+    // watches the dependencies, null if the program isn't hot reloaded
+    FileWatcher* file_watcher_ = nullptr;
+    // the rebuilt program of a reload, swapped in once it links so that a failed reload keeps the last good program
+    std::unique_ptr<ShaderProgram> reloaded_;
+
+    // the source of the file with the defines inserted
+    std::string get_source(const std::string& path) const;
+    // reads the sources of every stage and records the files they include as dependencies
+    void read_sources(std::string& vertex_shader_string, std::string& geometry_shader_string, std::string& fragment_shader_string);
+    // programs loaded from a binary have no shaders attached, relinking one needs all of its stages
+    void compile_stages();
 
 public:
+    // the source of the file with its includes expanded and a "#define <define>" line for each define inserted after the #version line
+    // the paths of the file and of the files it includes are appended to dependencies
+    static std::string get_source(const std::string& path, const std::vector<std::string>& defines, std::vector<std::string>* dependencies = nullptr);
+    // the source of the file with each #include "path" line replaced by the source of that file, relative to the including file
+    // a file is only included once, later includes of it are dropped like with #pragma once. included holds the files seen so far
+    static std::string expand_includes(const std::string& path, std::vector<std::string>& included);
+
     ShaderProgramFile(const std::string& vertex_path,
         const Optional<std::string> geometry_path,
         const std::string& fragment_path,
@@ -117,6 +183,12 @@ public:
         const std::string& fragment_path,
         const std::string& fragment_data_name,
         FileWatcher& file_watcher);
+    ShaderProgramFile(const std::string& vertex_path,
+        const Optional<std::string> geometry_path,
+        const std::string& fragment_path,
+        const std::string& fragment_data_name,
+        std::vector<std::string> defines,
+        FileWatcher* file_watcher = nullptr);
 
 
     // Create a new shader from the specified file paths
@@ -124,6 +196,10 @@ public:
         const Optional<std::string> geometry_path,
         const std::string& fragment_path,
         const std::string& fragment_data_name);
+    // the constructors only register the sources, this starts compiling them unless it was started already
+    void compile();
+    // compiles the program if it wasn't and waits for it to link, called on bind
+    bool link();
 
     const std::string& get_vert_path() {
         return vert_path_;
@@ -134,6 +210,23 @@ public:
     const std::string& get_frag_path() {
         return frag_path_;
     }
+    const std::vector<std::string>& get_defines() const {
+        return defines_;
+    }
+    const std::vector<std::string>& get_dependencies() const {
+        return dependencies_;
+    }
+    // whether one of the files the program is built from changed
+    bool is_changed(const FileWatcher& file_watcher) const;
+
+    // starts building the program again from its changed sources. the current program stays bound until end_reload swaps it out
+    void begin_reload();
+    // swaps in the rebuilt program once it linked, unless wait is set it returns false if the driver isn't done with it yet
+    // a reload that fails to compile or link is dropped and the last good program is kept
+    bool end_reload(bool wait);
+    bool is_reloading() const {
+        return reloaded_ != nullptr;
+    }
 
     // reload vert shader
     void reload_vert();
@@ -154,7 +247,7 @@ const std::string SHADER_PATH = "../shaders/";
 // default available programs. enumerations use negative values so that user extensions can be 0 based
 // these enumerations represent indices
 enum ShaderPrograms {
-    NUM_SHADERS = 13,
+    NUM_SHADERS = 19,
 
     DEF_SHADER = -ShaderPrograms::NUM_SHADERS,
     FLAT,
@@ -167,8 +260,58 @@ enum ShaderPrograms {
     SHADOW_MAP,
     OUTLINE,
     GRID,
+    // post processing of the offscreen target, its variants enable the PostFeatures
     OFFSCREEN,
-    FXAA,
+
+    // variants that render to the faces of a layered cubemap in one pass
+    LAYERED_DEF,
+    LAYERED_FLAT,
+    LAYERED_PHONG,
+    LAYERED_ENV,
+    LAYERED_REFLECT,
+    LAYERED_REFRACT,
+    // draws the static env into the hemispheres of a dual paraboloid map
+    PARABOLOID_ENV,
+};
+
+// effects of the post processing program. each set of enabled effects is compiled as its own variant, so disabled ones cost nothing
+enum PostFeature {
+    POST_FXAA = 1 << 0,
+    POST_FOG = 1 << 1,
+    POST_VIGNETTE = 1 << 2,
+    POST_BW = 1 << 3,
+
+    NUM_POST_PERMUTATIONS = 1 << 4,
+};
+
+// upper bound of the point light loop of the lit programs, the smallest class that fits the scene's lights is compiled
+enum LightClass {
+    NO_POINT_LIGHTS,
+    FEW_POINT_LIGHTS,
+    MANY_POINT_LIGHTS,
+
+    NUM_LIGHT_CLASSES = 3,
+};
+
+const int LIGHT_CLASS_SIZES[LightClass::NUM_LIGHT_CLASSES] = { 0, 8, 30 };
+
+LightClass get_light_class(size_t num_point_lights);
+
+// compile time keys of a program. a program is compiled once for each set of keys its sources use
+// the defaults match the defaults in the shader sources and select the base program
+struct ShaderVariant {
+    bool shadows = true;
+    // width of the pcf kernel in shadow map texels, odd
+    int pcf_size = 3;
+    LightClass light_class = LightClass::MANY_POINT_LIGHTS;
+    // shadowed fragments are drawn red
+    bool debug_shadows = false;
+    // PostFeatures of the post processing program
+    int post_features = 0;
+
+    // a "NAME value" define for each key that differs from its default
+    std::vector<std::string> get_defines() const;
+    bool operator==(const ShaderVariant& other) const;
 };
 
 // extra modes for drawing. mostly for debug purposes, such as wireframe.
@@ -186,6 +329,35 @@ class Renderer : public std::vector<std::unique_ptr<ShaderProgramFile>> {
 protected:
     int selected_ = -1;
 
+    // when set, programs are swapped for their layered variants on bind
+    bool layered_ = false;
+    // bit i set when cubemap face i is rendered to by the layered variants
+    int face_mask_ = 0;
+    // when set with layered_, the layered variants render to the two hemispheres of a dual paraboloid map instead
+    bool paraboloid_ = false;
+
+    // keys of the binds that don't pass their own
+    ShaderVariant variant_;
+    // the bound variant of the selected program
+    ShaderProgramFile* selected_program_ = nullptr;
+    // compiled variants by the hash of their preprocessed sources, variants that differ in keys their sources don't use share a program
+    std::unordered_map<size_t, std::unique_ptr<ShaderProgramFile>> variant_programs_;
+    // the variants each program was bound with, so that the sources are only read and hashed on the first bind of a variant
+    std::unordered_map<size_t, std::vector<std::pair<ShaderVariant, ShaderProgramFile*>>> variants_;
+
+    // the variant of the program at index n, compiled on first use
+    ShaderProgramFile& get_variant(size_t n, const ShaderVariant& variant);
+
+    // the programs prewarm links, the base programs and the variants they are bound as
+    std::vector<ShaderProgramFile*> prewarm_;
+    // set once every program in prewarm_ has been linked
+    bool prewarmed_ = false;
+    // set while reloads are compiling on the driver's threads
+    bool reloading_ = false;
+
+    // the base programs and the compiled variants
+    std::vector<ShaderProgramFile*> get_programs();
+
     int get_selected_idx() const;
     void set_selected_idx(int n);
 
@@ -195,6 +367,9 @@ protected:
     Renderer(Renderer&&) = default;
 
 public:
+    // programs prewarm links per frame when the driver can't compile them in parallel
+    int prewarm_per_frame_ = 1;
+
     Renderer(const Renderer&) = delete;
 
     static size_t get(int n);
@@ -202,10 +377,33 @@ public:
         return *(*this)[get(n)];
     }
     void bind(ShaderPrograms n);
+    void bind(ShaderPrograms n, const ShaderVariant& variant);
     ShaderProgram& get_selected_program();
     ShaderProgram& get_selected_program() const;
     ShaderPrograms get_selected();
     void reload();
+    // starts compiling every program on the driver's threads where KHR_parallel_shader_compile is available
+    // a program listed in variants is compiled as those variants, its base program only if it is listed with the default keys
+    void begin_prewarm(const std::vector<std::pair<ShaderPrograms, ShaderVariant>>& variants = {});
+    // links the programs that finished compiling, or without the extension compiles prewarm_per_frame_ of them
+    // programs are otherwise compiled on their first bind. call after drawing so that a first use never waits on a prewarm
+    void prewarm();
+
+    // the layered variant of a program, or the program itself if it has none
+    static ShaderPrograms get_layered(ShaderPrograms n, bool paraboloid = false);
+    // whether the program renders to a layered cubemap target
+    static bool is_layered(ShaderPrograms n);
+    void set_layered(bool layered);
+    bool get_layered() const;
+    // sets the faces that layered variants render to
+    void set_face_mask(int face_mask);
+    void set_paraboloid(bool paraboloid);
+    bool get_paraboloid() const;
+    void set_variant(const ShaderVariant& variant);
+    const ShaderVariant& get_variant() const;
+    // selects the post processing variant bound by OFFSCREEN
+    void set_post_features(int features);
+    int get_post_features() const;
 
     // Return the OpenGL handle of a named shader attribute (-1 if it does not exist)
     int32_t attrib(const std::string& name) const {
@@ -273,6 +471,7 @@ struct Uniform : public RenderObj {
         check_error(id);
 
         glUniform1f(id, val);
+        render_stats().count(RenderCounter::UNIFORM_UPLOADS);
 #ifdef DEBUG
         check_gl_error();
 #endif
@@ -282,6 +481,7 @@ struct Uniform : public RenderObj {
         check_error(id);
 
         glUniformMatrix4fv(id, 1, GL_FALSE, (float*)&val[0][0]);
+        render_stats().count(RenderCounter::UNIFORM_UPLOADS);
 #ifdef DEBUG
         check_gl_error();
 #endif
@@ -291,6 +491,7 @@ struct Uniform : public RenderObj {
         check_error(id);
 
         glUniform3f(id, val[0], val[1], val[2]);
+        render_stats().count(RenderCounter::UNIFORM_UPLOADS);
 #ifdef DEBUG
         check_gl_error();
 #endif
@@ -300,6 +501,7 @@ struct Uniform : public RenderObj {
         check_error(id);
 
         glUniform1ui(id, static_cast<unsigned int>(val));
+        render_stats().count(RenderCounter::UNIFORM_UPLOADS);
 #ifdef DEBUG
         check_gl_error();
 #endif
@@ -309,6 +511,7 @@ struct Uniform : public RenderObj {
         check_error(id);
 
         glUniform1i(id, val);
+        render_stats().count(RenderCounter::UNIFORM_UPLOADS);
 #ifdef DEBUG
         check_gl_error();
 #endif
@@ -322,6 +525,50 @@ private:
     }
 };
 
+// a uniform buffer shared by every program that declares the named block at the same binding point
+class UniformBlock {
+    uint32_t ubo_ = 0;
+    uint32_t binding_;
+    size_t size_;
+
+public:
+    UniformBlock(uint32_t binding, size_t size) : binding_(binding), size_(size) {
+        glGenBuffers(1, &ubo_);
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo_);
+        glBufferData(GL_UNIFORM_BUFFER, size_, NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+#ifdef DEBUG
+        check_gl_error();
+#endif
+    }
+    UniformBlock(const UniformBlock&) = delete;
+    ~UniformBlock() {
+        glDeleteBuffers(1, &ubo_);
+    }
+
+    void buffer(const void* data, size_t size, size_t offset = 0) {
+        if (offset + size > size_) {
+            throw std::runtime_error("Error buffering uniform block: out of range");
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo_);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+#ifdef DEBUG
+        check_gl_error();
+#endif
+    }
+    // attaches the buffer to its binding point
+    void bind() {
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding_, ubo_);
+
+#ifdef DEBUG
+        check_gl_error();
+#endif
+    }
+};
+
 class Canvas {
 protected:
     int width_ = 0;
@@ -0,0 +1,221 @@
+#include "scene_file.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  undef max
+#  undef min
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#include "cpu_profiler.h"
+#include "utilities.h"
+
+constexpr uint32_t SCENE_MAGIC = 0x53434E45; // "SCNE"
+// bumped whenever a record or the layout below changes
+constexpr uint32_t SCENE_VERSION = 2;
+
+// arrays start at multiples of this, so that the mapped records are aligned
+constexpr uint64_t SCENE_ALIGNMENT = 16;
+
+struct SceneSection {
+    uint64_t offset;
+    uint64_t count;
+};
+
+// the header, followed by the prototypes, entities, point lights and probes, each at its section's offset
+struct SceneHeader {
+    uint32_t magic;
+    uint32_t version;
+    // sizes of the records, a file written by a build with another layout is rejected rather than misread
+    uint32_t entity_size;
+    uint32_t point_light_size;
+    SceneSection prototypes;
+    SceneSection entities;
+    SceneSection point_lights;
+    SceneSection probes;
+    SceneCamera camera;
+    SceneEnvironment environment;
+};
+
+// read only view of a whole file, unmapped when destroyed
+class MappedFile {
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+
+public:
+    MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER size;
+        if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size)) {
+            throw std::runtime_error("Error opening scene " + path);
+        }
+        size_ = static_cast<size_t>(size.QuadPart);
+        if (size_ == 0) {
+            return;
+        }
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        data_ = mapping_ == nullptr ? nullptr : static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Error opening scene " + path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0) {
+            close(fd);
+            return;
+        }
+#ifdef MAP_POPULATE
+        // faults the whole file in with one call rather than page by page while copying
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+#else
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+#endif
+        // the mapping holds its own reference to the file
+        close(fd);
+        if (data != MAP_FAILED) {
+            data_ = static_cast<const uint8_t*>(data);
+        }
+#endif
+        if (data_ == nullptr) {
+            throw std::runtime_error("Error mapping scene " + path);
+        }
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data_ != nullptr) {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_ != nullptr) {
+            CloseHandle(mapping_);
+        }
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+#else
+        if (data_ != nullptr) {
+            munmap(const_cast<uint8_t*>(data_), size_);
+        }
+#endif
+    }
+
+    const uint8_t* data() const {
+        return data_;
+    }
+    size_t size() const {
+        return size_;
+    }
+};
+
+static uint64_t align(uint64_t offset) {
+    return (offset + SCENE_ALIGNMENT - 1) / SCENE_ALIGNMENT * SCENE_ALIGNMENT;
+}
+
+// copies the section's records out of the mapping, after checking that they lie within it
+template<typename T>
+static void copy_section(const MappedFile& file, const SceneSection& section, std::vector<T>& out) {
+    if (section.offset > file.size() || section.count > (file.size() - section.offset) / sizeof(T)) {
+        throw std::runtime_error("Error reading scene, truncated");
+    }
+    // sections are aligned within the page aligned mapping, so the records can be copied straight out of it
+    const T* records = reinterpret_cast<const T*>(file.data() + section.offset);
+    out.assign(records, records + section.count);
+}
+
+SceneData read_scene(const std::string& path) {
+    PROFILE_ZONE("read_scene");
+    MappedFile file(path);
+
+    SceneHeader header;
+    if (file.size() < sizeof(header)) {
+        throw std::runtime_error("Error reading scene " + path + ", not a scene");
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != SCENE_MAGIC) {
+        throw std::runtime_error("Error reading scene " + path + ", not a scene");
+    }
+    if (header.version != SCENE_VERSION || header.entity_size != sizeof(SceneEntity) || header.point_light_size != sizeof(ScenePointLight)) {
+        throw std::runtime_error("Error reading scene " + path + ", version " + std::to_string(header.version) + " isn't supported");
+    }
+
+    SceneData scene;
+    copy_section(file, header.prototypes, scene.prototypes);
+    copy_section(file, header.entities, scene.entities);
+    copy_section(file, header.point_lights, scene.point_lights);
+    copy_section(file, header.probes, scene.probes);
+    scene.camera = header.camera;
+    scene.environment = header.environment;
+
+    for (const SceneEntity& entity : scene.entities) {
+        if (entity.prototype >= scene.prototypes.size()) {
+            throw std::runtime_error("Error reading scene " + path + ", an entity references a missing prototype");
+        }
+    }
+    return scene;
+}
+
+template<typename T>
+static void write_section(std::ofstream& f, uint64_t& offset, SceneSection& section, const std::vector<T>& records) {
+    // zero padding up to the section's alignment
+    static const char padding[SCENE_ALIGNMENT] = {};
+    uint64_t aligned = align(offset);
+    f.write(padding, aligned - offset);
+
+    section.offset = aligned;
+    section.count = records.size();
+    f.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T));
+    offset = aligned + records.size() * sizeof(T);
+}
+
+bool write_scene(const std::string& path, const SceneData& scene) {
+    PROFILE_ZONE("write_scene");
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream f(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!f) {
+            return false;
+        }
+
+        // the offsets are only known once the sections are written, the header is written again with them at the end
+        SceneHeader header{};
+        header.magic = SCENE_MAGIC;
+        header.version = SCENE_VERSION;
+        header.entity_size = sizeof(SceneEntity);
+        header.point_light_size = sizeof(ScenePointLight);
+        header.camera = scene.camera;
+        header.environment = scene.environment;
+        f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        uint64_t offset = sizeof(header);
+        write_section(f, offset, header.prototypes, scene.prototypes);
+        write_section(f, offset, header.entities, scene.entities);
+        write_section(f, offset, header.point_lights, scene.point_lights);
+        write_section(f, offset, header.probes, scene.probes);
+
+        f.seekp(0);
+        f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!f) {
+            return false;
+        }
+    }
+    return replace_file(tmp_path, path);
+}
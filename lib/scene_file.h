@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <glm/vec3.hpp> // glm::vec3
+#include <glm/mat4x4.hpp> // glm::mat4
+
+const std::string SCENE_PATH = "../data/scene.bin";
+
+// the camera a scene was saved with
+enum SceneCameraKind {
+    TRACKBALL_CAMERA,
+    FREE_CAMERA,
+    NUM_SCENE_CAMERA_KINDS = 2,
+};
+
+// the records below are stored as they are laid out in memory, so that each array of a file is copied in one go
+
+// a mesh entity, referencing its prototype by index into SceneData::prototypes
+struct SceneEntity {
+    glm::mat4 trans;
+    glm::vec3 color;
+    uint32_t prototype;
+    int32_t shader;
+    int32_t draw_mode;
+    int32_t probe_update;
+    int32_t env_projection;
+    uint32_t dyn_reflections;
+    // keys of the entity's shader variant
+    uint32_t shadows;
+    int32_t pcf_size;
+};
+
+struct ScenePointLight {
+    glm::mat4 trans;
+    // color of the light's sphere
+    glm::vec3 mesh_color;
+    // color and strength of the ambient, diffuse and specular traits
+    glm::vec3 ambient_color;
+    float ambient;
+    glm::vec3 diffuse_color;
+    float diffuse;
+    glm::vec3 specular_color;
+    float specular;
+    float shininess;
+    float constant;
+    float linear;
+    float quadratic;
+    // whether the light's sphere is in the mesh list and can be selected
+    uint32_t selectable;
+};
+
+struct SceneProbe {
+    glm::vec3 position;
+    float influence_radius;
+};
+
+struct SceneCamera {
+    glm::mat4 trans;
+    // radius, theta and phi of a trackball camera, which rebuilds its transform from them
+    glm::vec3 orbit;
+    float up;
+    float fov;
+    uint32_t kind;
+    uint32_t projection;
+};
+
+struct SceneEnvironment {
+    glm::mat4 dir_light_trans;
+    // index into the environment library
+    uint32_t cube_map;
+};
+
+static_assert(std::is_trivially_copyable_v<SceneEntity> && std::is_trivially_copyable_v<ScenePointLight> && std::is_trivially_copyable_v<SceneProbe>
+    && std::is_trivially_copyable_v<SceneCamera> && std::is_trivially_copyable_v<SceneEnvironment>, "scene records are copied as bytes");
+
+// everything a scene file holds
+struct SceneData {
+    // content hashes of the prototypes the entities reference, see Mesh::calc_hash
+    std::vector<uint64_t> prototypes;
+    std::vector<SceneEntity> entities;
+    std::vector<ScenePointLight> point_lights;
+    std::vector<SceneProbe> probes;
+    SceneCamera camera{};
+    SceneEnvironment environment{};
+};
+
+// maps the file and copies its arrays out of the mapping. throws if the file is missing, from another version or truncated
+SceneData read_scene(const std::string& path);
+// written next to the file and renamed over it. returns false if the file couldn't be written
+bool write_scene(const std::string& path, const SceneData& scene);
@@ -0,0 +1,601 @@
+#include "scene_journal.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+#include "context.h"
+#include "cpu_profiler.h"
+
+constexpr uint32_t JOURNAL_MAGIC = 0x534A4E31; // "SJN1"
+// bumped whenever a record changes
+constexpr uint32_t JOURNAL_VERSION = 2;
+
+constexpr uint32_t NO_ID = std::numeric_limits<uint32_t>::max();
+
+struct JournalHeader {
+    uint32_t magic;
+    uint32_t version;
+    // the generation of the snapshot the journal applies to
+    uint64_t generation;
+};
+
+// a byte of this followed by its fields
+enum JournalRecord {
+    // id, prototype hash, SceneEntity
+    SPAWN_ENTITY,
+    // id, transform
+    SET_TRANSFORM,
+    // id, color
+    SET_COLOR,
+    // id, shader, draw mode, probe update, env projection, dynamic reflections, shadows, pcf size
+    SET_SHADING,
+    // id
+    REMOVE_ENTITY,
+    // id, ScenePointLight, spawns the light if the id is new
+    SET_POINT_LIGHT,
+    // id
+    REMOVE_POINT_LIGHT,
+    // count, SceneProbe of each
+    SET_PROBES,
+    // SceneCamera
+    SET_CAMERA,
+    // SceneEnvironment
+    SET_ENVIRONMENT,
+
+    NUM_JOURNAL_RECORDS = 10,
+};
+
+class RecordWriter {
+    std::vector<uint8_t> data_;
+
+public:
+    RecordWriter(JournalRecord type) {
+        put(static_cast<uint8_t>(type));
+    }
+    template<typename T>
+    RecordWriter& put(const T& value) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        data_.insert(data_.end(), bytes, bytes + sizeof(T));
+        return *this;
+    }
+    const std::vector<uint8_t>& get_data() const {
+        return data_;
+    }
+};
+
+class RecordReader {
+    const uint8_t* data_;
+    size_t size_;
+    size_t offset_ = 0;
+
+public:
+    RecordReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+    // false if the record ends before the value
+    template<typename T>
+    bool get(T& value) {
+        if (size_ - offset_ < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, data_ + offset_, sizeof(T));
+        offset_ += sizeof(T);
+        return true;
+    }
+    size_t get_remaining() const {
+        return size_ - offset_;
+    }
+    size_t get_offset() const {
+        return offset_;
+    }
+};
+
+static std::string snapshot_path(const std::string& path, uint64_t generation) {
+    return path + "." + std::to_string(generation) + ".bin";
+}
+static std::string journal_path(const std::string& path, uint64_t generation) {
+    return path + "." + std::to_string(generation) + ".journal";
+}
+
+// generations of the files at path with the extension, e.g. 3 for autosave.3.bin
+static std::vector<uint64_t> find_generations(const std::string& path, const std::string& extension) {
+    std::filesystem::path base(path);
+    std::filesystem::path dir = base.has_parent_path() ? base.parent_path() : std::filesystem::path(".");
+    std::string prefix = base.filename().string() + ".";
+
+    std::vector<uint64_t> generations;
+    std::error_code error;
+    for (auto& entry : std::filesystem::directory_iterator(dir, error)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() <= prefix.size() + extension.size() || name.compare(0, prefix.size(), prefix) != 0
+            || name.compare(name.size() - extension.size(), extension.size(), extension) != 0) {
+            continue;
+        }
+        std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - extension.size());
+        if (std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; }) && digits.size() < 20) {
+            generations.push_back(std::stoull(digits));
+        }
+    }
+    std::sort(generations.begin(), generations.end());
+    return generations;
+}
+
+// once a snapshot is written, the files of the generations before it are no longer needed for recovery
+static void remove_generations_before(const std::string& path, uint64_t generation) {
+    for (uint64_t old : find_generations(path, ".bin")) {
+        if (old < generation) {
+            std::remove(snapshot_path(path, old).c_str());
+        }
+    }
+    for (uint64_t old : find_generations(path, ".journal")) {
+        if (old < generation) {
+            std::remove(journal_path(path, old).c_str());
+        }
+    }
+}
+
+JournalScene::JournalScene(const SceneData& scene) :
+    prototypes(scene.prototypes),
+    entities(scene.entities.begin(), scene.entities.end()),
+    point_lights(scene.point_lights.begin(), scene.point_lights.end()),
+    probes(scene.probes),
+    camera(scene.camera),
+    environment(scene.environment) {}
+
+size_t JournalScene::apply(const uint8_t* data, size_t size) {
+    RecordReader reader(data, size);
+    uint8_t type;
+    uint32_t id;
+    if (!reader.get(type)) {
+        return 0;
+    }
+    auto has_entity = [this](uint32_t id) {
+        return id < entities.size() && entities[id].has_value();
+    };
+
+    switch (type) {
+    case SPAWN_ENTITY:
+        {
+            uint64_t hash;
+            SceneEntity entity;
+            // ids are handed out in order, a later id means the record is damaged
+            if (!reader.get(id) || !reader.get(hash) || !reader.get(entity) || id > entities.size()) {
+                return 0;
+            }
+            auto itr = std::find(prototypes.begin(), prototypes.end(), hash);
+            entity.prototype = static_cast<uint32_t>(itr - prototypes.begin());
+            if (itr == prototypes.end()) {
+                prototypes.push_back(hash);
+            }
+            if (id == entities.size()) {
+                entities.emplace_back();
+            }
+            entities[id] = entity;
+        }
+        break;
+    case SET_TRANSFORM:
+        {
+            glm::mat4 trans;
+            if (!reader.get(id) || !reader.get(trans) || !has_entity(id)) {
+                return 0;
+            }
+            entities[id]->trans = trans;
+        }
+        break;
+    case SET_COLOR:
+        {
+            glm::vec3 color;
+            if (!reader.get(id) || !reader.get(color) || !has_entity(id)) {
+                return 0;
+            }
+            entities[id]->color = color;
+        }
+        break;
+    case SET_SHADING:
+        {
+            int32_t shader, draw_mode, probe_update, env_projection, pcf_size;
+            uint32_t dyn_reflections, shadows;
+            if (!reader.get(id) || !reader.get(shader) || !reader.get(draw_mode) || !reader.get(probe_update) || !reader.get(env_projection)
+                || !reader.get(dyn_reflections) || !reader.get(shadows) || !reader.get(pcf_size) || !has_entity(id)) {
+                return 0;
+            }
+            SceneEntity& entity = *entities[id];
+            entity.shader = shader;
+            entity.draw_mode = draw_mode;
+            entity.probe_update = probe_update;
+            entity.env_projection = env_projection;
+            entity.dyn_reflections = dyn_reflections;
+            entity.shadows = shadows;
+            entity.pcf_size = pcf_size;
+        }
+        break;
+    case REMOVE_ENTITY:
+        if (!reader.get(id) || !has_entity(id)) {
+            return 0;
+        }
+        entities[id].reset();
+        break;
+    case SET_POINT_LIGHT:
+        {
+            ScenePointLight point_light;
+            if (!reader.get(id) || !reader.get(point_light) || id > point_lights.size()) {
+                return 0;
+            }
+            if (id == point_lights.size()) {
+                point_lights.emplace_back();
+            }
+            point_lights[id] = point_light;
+        }
+        break;
+    case REMOVE_POINT_LIGHT:
+        if (!reader.get(id) || id >= point_lights.size() || !point_lights[id].has_value()) {
+            return 0;
+        }
+        point_lights[id].reset();
+        break;
+    case SET_PROBES:
+        {
+            uint32_t count;
+            if (!reader.get(count) || count > reader.get_remaining() / sizeof(SceneProbe)) {
+                return 0;
+            }
+            probes.resize(count);
+            for (SceneProbe& probe : probes) {
+                reader.get(probe);
+            }
+        }
+        break;
+    case SET_CAMERA:
+        if (!reader.get(camera)) {
+            return 0;
+        }
+        break;
+    case SET_ENVIRONMENT:
+        if (!reader.get(environment)) {
+            return 0;
+        }
+        break;
+    default:
+        return 0;
+    }
+    return reader.get_offset();
+}
+
+SceneData JournalScene::compact(std::vector<uint32_t>* entity_remap, std::vector<uint32_t>* light_remap) const {
+    SceneData scene;
+    scene.prototypes = prototypes;
+    if (entity_remap != nullptr) {
+        entity_remap->assign(entities.size(), NO_ID);
+    }
+    if (light_remap != nullptr) {
+        light_remap->assign(point_lights.size(), NO_ID);
+    }
+
+    scene.entities.reserve(entities.size());
+    for (size_t i = 0; i < entities.size(); i++) {
+        if (entities[i].has_value()) {
+            if (entity_remap != nullptr) {
+                (*entity_remap)[i] = static_cast<uint32_t>(scene.entities.size());
+            }
+            scene.entities.push_back(*entities[i]);
+        }
+    }
+    for (size_t i = 0; i < point_lights.size(); i++) {
+        if (point_lights[i].has_value()) {
+            if (light_remap != nullptr) {
+                (*light_remap)[i] = static_cast<uint32_t>(scene.point_lights.size());
+            }
+            scene.point_lights.push_back(*point_lights[i]);
+        }
+    }
+    scene.probes = probes;
+    scene.camera = camera;
+    scene.environment = environment;
+    return scene;
+}
+
+SceneJournal::SceneJournal(std::string path) : path_(std::move(path)) {}
+
+SceneJournal::~SceneJournal() {
+    wait_compaction();
+}
+
+void SceneJournal::wait_compaction() {
+    if (compaction_.valid()) {
+        if (!compaction_.get()) {
+            std::cout << "Autosave snapshot could not be written to " << snapshot_path(path_, generation_) << std::endl;
+        }
+    }
+}
+
+void SceneJournal::push(const std::vector<uint8_t>& record) {
+    pending_.insert(pending_.end(), record.begin(), record.end());
+    scene_.apply(record.data(), record.size());
+}
+
+void SceneJournal::open_journal() {
+    journal_.close();
+    journal_.open(journal_path(path_, generation_), std::ios::binary | std::ios::trunc);
+    JournalHeader header{ JOURNAL_MAGIC, JOURNAL_VERSION, generation_ };
+    journal_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    journal_.flush();
+    journal_bytes_ = 0;
+}
+
+void SceneJournal::start_generation(SceneData snapshot) {
+    wait_compaction();
+    generation_++;
+    open_journal();
+
+    // until the snapshot is written, recovery replays the previous generation's snapshot and journals, which end in the same scene
+    compaction_ = std::async(std::launch::async, [path = path_, generation = generation_, snapshot = std::move(snapshot)] {
+        PROFILE_ZONE("SceneJournal::compaction");
+        if (!write_scene(snapshot_path(path, generation), snapshot)) {
+            return false;
+        }
+        remove_generations_before(path, generation);
+        return true;
+    });
+}
+
+void SceneJournal::reset(Context& ctx, uint32_t cube_map) {
+    PROFILE_ZONE("SceneJournal::reset");
+    dirty_.clear();
+    entity_ids_.clear();
+    light_ids_.clear();
+
+    SceneData snapshot = ctx.capture_scene();
+    snapshot.environment.cube_map = cube_map;
+    // in the order capture_scene stores them
+    uint32_t id = 0;
+    for (auto& mesh_entity : ctx.mesh_list) {
+        if (dynamic_cast<PointLight*>(mesh_entity.get()) == nullptr) {
+            entity_ids_[mesh_entity.get()] = id++;
+        }
+    }
+    id = 0;
+    for (auto& point_light : ctx.env->point_lights_) {
+        light_ids_[point_light.get()] = id++;
+    }
+    reset(snapshot);
+}
+
+void SceneJournal::reset(const SceneData& snapshot) {
+    wait_compaction();
+    journal_.close();
+    pending_.clear();
+    scene_ = JournalScene(snapshot);
+
+    // past the previous files, and written before they are removed, so that a crash meanwhile still recovers the previous autosave
+    std::vector<uint64_t> snapshots = find_generations(path_, ".bin");
+    std::vector<uint64_t> journals = find_generations(path_, ".journal");
+    generation_ = std::max(snapshots.empty() ? 0 : snapshots.back(), journals.empty() ? 0 : journals.back()) + 1;
+    if (!write_scene(snapshot_path(path_, generation_), snapshot)) {
+        std::cout << "Autosave snapshot could not be written to " << snapshot_path(path_, generation_) << std::endl;
+    }
+    // even without the snapshot, the previous journals would be replayed onto the ids of this one
+    remove_generations_before(path_, generation_);
+    open_journal();
+    last_save_ = std::chrono::steady_clock::now();
+}
+
+void SceneJournal::touch(MeshEntity& mesh_entity) {
+    dirty_.insert(&mesh_entity);
+}
+
+void SceneJournal::remove(MeshEntity& mesh_entity) {
+    dirty_.erase(&mesh_entity);
+    auto light = light_ids_.find(&mesh_entity);
+    if (light != light_ids_.end()) {
+        remove_point_light(light->second);
+        light_ids_.erase(light);
+        return;
+    }
+    // entities spawned since the last autosave have no id yet, and nothing to remove
+    auto entity = entity_ids_.find(&mesh_entity);
+    if (entity != entity_ids_.end()) {
+        remove_entity(entity->second);
+        entity_ids_.erase(entity);
+    }
+}
+
+void SceneJournal::record_entity(uint32_t id, uint64_t prototype, const SceneEntity& entity) {
+    // a record the replay would reject would end it there
+    if (id > scene_.entities.size()) {
+        throw std::runtime_error("Error journaling entity " + std::to_string(id) + ", ids are handed out in order");
+    }
+    if (id == scene_.entities.size()) {
+        push(RecordWriter(SPAWN_ENTITY).put(id).put(prototype).put(entity).get_data());
+        return;
+    }
+    if (!scene_.entities[id].has_value()) {
+        return;
+    }
+    const SceneEntity& saved = *scene_.entities[id];
+    if (std::memcmp(&entity.trans, &saved.trans, sizeof(entity.trans)) != 0) {
+        push(RecordWriter(SET_TRANSFORM).put(id).put(entity.trans).get_data());
+    }
+    if (std::memcmp(&entity.color, &saved.color, sizeof(entity.color)) != 0) {
+        push(RecordWriter(SET_COLOR).put(id).put(entity.color).get_data());
+    }
+    if (entity.shader != saved.shader || entity.draw_mode != saved.draw_mode || entity.probe_update != saved.probe_update
+        || entity.env_projection != saved.env_projection || entity.dyn_reflections != saved.dyn_reflections
+        || entity.shadows != saved.shadows || entity.pcf_size != saved.pcf_size) {
+        push(RecordWriter(SET_SHADING).put(id).put(entity.shader).put(entity.draw_mode).put(entity.probe_update)
+            .put(entity.env_projection).put(entity.dyn_reflections).put(entity.shadows).put(entity.pcf_size).get_data());
+    }
+}
+
+void SceneJournal::record_point_light(uint32_t id, const ScenePointLight& point_light) {
+    if (id > scene_.point_lights.size()) {
+        throw std::runtime_error("Error journaling point light " + std::to_string(id) + ", ids are handed out in order");
+    }
+    if (id < scene_.point_lights.size() && scene_.point_lights[id].has_value()
+        && std::memcmp(&point_light, &*scene_.point_lights[id], sizeof(point_light)) == 0) {
+        return;
+    }
+    push(RecordWriter(SET_POINT_LIGHT).put(id).put(point_light).get_data());
+}
+
+void SceneJournal::remove_entity(uint32_t id) {
+    if (id >= scene_.entities.size() || !scene_.entities[id].has_value()) {
+        return;
+    }
+    push(RecordWriter(REMOVE_ENTITY).put(id).get_data());
+}
+
+void SceneJournal::remove_point_light(uint32_t id) {
+    if (id >= scene_.point_lights.size() || !scene_.point_lights[id].has_value()) {
+        return;
+    }
+    push(RecordWriter(REMOVE_POINT_LIGHT).put(id).get_data());
+}
+
+void SceneJournal::record_probes(const std::vector<SceneProbe>& probes) {
+    if (probes.size() == scene_.probes.size() && (probes.empty() || std::memcmp(probes.data(), scene_.probes.data(), probes.size() * sizeof(SceneProbe)) == 0)) {
+        return;
+    }
+    RecordWriter record(SET_PROBES);
+    record.put(static_cast<uint32_t>(probes.size()));
+    for (const SceneProbe& probe : probes) {
+        record.put(probe);
+    }
+    push(record.get_data());
+}
+
+void SceneJournal::record_camera(const SceneCamera& camera) {
+    if (std::memcmp(&camera, &scene_.camera, sizeof(camera)) != 0) {
+        push(RecordWriter(SET_CAMERA).put(camera).get_data());
+    }
+}
+
+void SceneJournal::record_environment(const SceneEnvironment& environment) {
+    if (std::memcmp(&environment, &scene_.environment, sizeof(environment)) != 0) {
+        push(RecordWriter(SET_ENVIRONMENT).put(environment).get_data());
+    }
+}
+
+void SceneJournal::diff(Context& ctx, uint32_t cube_map) {
+    const std::vector<uint64_t>& hashes = MESH_FACTORY->get_hashes();
+    for (MeshEntity* mesh_entity : dirty_) {
+        if (auto point_light = dynamic_cast<PointLight*>(mesh_entity)) {
+            auto itr = light_ids_.find(mesh_entity);
+            // lights spawned by the editor are in the mesh list
+            bool selectable = itr == light_ids_.end() || scene_.point_lights[itr->second]->selectable != 0;
+            if (itr == light_ids_.end()) {
+                itr = light_ids_.emplace(mesh_entity, static_cast<uint32_t>(scene_.point_lights.size())).first;
+            }
+            record_point_light(itr->second, Context::capture_point_light(*point_light, selectable));
+            continue;
+        }
+
+        auto itr = entity_ids_.find(mesh_entity);
+        if (itr == entity_ids_.end()) {
+            itr = entity_ids_.emplace(mesh_entity, static_cast<uint32_t>(scene_.entities.size())).first;
+        }
+        record_entity(itr->second, hashes[mesh_entity->get_id()], Context::capture_entity(*mesh_entity));
+    }
+    dirty_.clear();
+
+    record_probes(ctx.capture_probes());
+    record_camera(ctx.capture_camera());
+    record_environment({ ctx.env->dir_light_.get_trans(), cube_map });
+}
+
+void SceneJournal::update(Context& ctx, uint32_t cube_map) {
+    if (std::chrono::steady_clock::now() - last_save_ >= save_interval_) {
+        save(ctx, cube_map);
+    }
+}
+
+void SceneJournal::save(Context& ctx, uint32_t cube_map) {
+    PROFILE_ZONE("SceneJournal::save");
+    last_save_ = std::chrono::steady_clock::now();
+    diff(ctx, cube_map);
+    write();
+}
+
+void SceneJournal::write() {
+    if (pending_.empty()) {
+        return;
+    }
+
+    journal_.write(reinterpret_cast<const char*>(pending_.data()), pending_.size());
+    journal_.flush();
+    journal_bytes_ += pending_.size();
+    pending_.clear();
+
+    // skipped while the previous snapshot is still being written, the journal grows a little longer meanwhile
+    bool compacting = compaction_.valid() && compaction_.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+    if (journal_bytes_ >= compact_bytes_ && !compacting) {
+        std::vector<uint32_t> entity_remap, light_remap;
+        SceneData snapshot = scene_.compact(&entity_remap, &light_remap);
+        for (auto& [mesh_entity, id] : entity_ids_) {
+            id = entity_remap[id];
+        }
+        for (auto& [point_light, id] : light_ids_) {
+            id = light_remap[id];
+        }
+        scene_ = JournalScene(snapshot);
+        start_generation(std::move(snapshot));
+    }
+}
+
+const JournalScene& SceneJournal::get_scene() const {
+    return scene_;
+}
+
+size_t SceneJournal::get_journal_bytes() const {
+    return journal_bytes_;
+}
+
+uint64_t SceneJournal::get_generation() const {
+    return generation_;
+}
+
+SceneData SceneJournal::recover(const std::string& path) {
+    PROFILE_ZONE("SceneJournal::recover");
+    std::vector<uint64_t> snapshots = find_generations(path, ".bin");
+    if (snapshots.empty()) {
+        throw std::runtime_error("Error recovering scene, there is no autosave at " + path);
+    }
+    uint64_t generation = snapshots.back();
+    JournalScene scene(read_scene(snapshot_path(path, generation)));
+
+    for (;; generation++) {
+        std::ifstream f(journal_path(path, generation), std::ios::binary);
+        if (!f) {
+            break;
+        }
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        JournalHeader header;
+        if (data.size() < sizeof(header)) {
+            break;
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (header.magic != JOURNAL_MAGIC || header.version != JOURNAL_VERSION || header.generation != generation) {
+            break;
+        }
+
+        size_t offset = sizeof(header);
+        while (offset < data.size()) {
+            size_t size = scene.apply(data.data() + offset, data.size() - offset);
+            if (size == 0) {
+                break;
+            }
+            offset += size;
+        }
+        // a cut off journal is the last one, the next generation is only started once a journal is complete
+        if (offset < data.size()) {
+            break;
+        }
+        // the next journal's ids are those of the compacted scene, as they were when it was started
+        scene = JournalScene(scene.compact());
+    }
+    return scene.compact();
+}
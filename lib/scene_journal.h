@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "scene_file.h"
+
+class Context;
+class MeshEntity;
+
+const std::string AUTOSAVE_PATH = "../data/autosave";
+
+// the scene a snapshot and the journal after it describe. entities and point lights are kept by id, and removed ones are left empty until compacted
+struct JournalScene {
+    std::vector<uint64_t> prototypes;
+    std::vector<std::optional<SceneEntity>> entities;
+    std::vector<std::optional<ScenePointLight>> point_lights;
+    std::vector<SceneProbe> probes;
+    SceneCamera camera{};
+    SceneEnvironment environment{};
+
+    JournalScene() = default;
+    // ids of the scene's entities and point lights are their indexes
+    JournalScene(const SceneData& scene);
+
+    // applies the record at data, returns its size or 0 if it is cut off or malformed
+    size_t apply(const uint8_t* data, size_t size);
+    // the scene without the removed entities and lights. ids are handed out again in order, remap maps an old entity id to its new one
+    SceneData compact(std::vector<uint32_t>* entity_remap = nullptr, std::vector<uint32_t>* light_remap = nullptr) const;
+};
+
+// autosaves the scene as a snapshot followed by an append only journal of the edits since
+// each edit is a delta record of its entity, light, the probes, the camera or the environment, so that an autosave writes only what changed.
+// once the journal has grown past compact_bytes_, the scene is written out as the next generation's snapshot on a background thread and a new journal is started.
+// files are named <path>.<generation>.bin and <path>.<generation>.journal, a journal applies to the snapshot of its generation or to the scene its previous journal ended with
+class SceneJournal {
+    std::string path_;
+    uint64_t generation_ = 0;
+
+    JournalScene scene_;
+    // ids of the live entities and point lights, point lights are told apart by their entry in light_ids_
+    std::unordered_map<const MeshEntity*, uint32_t> entity_ids_;
+    std::unordered_map<const MeshEntity*, uint32_t> light_ids_;
+    // entities spawned or edited since the last autosave
+    std::unordered_set<MeshEntity*> dirty_;
+
+    // records not yet written to the journal
+    std::vector<uint8_t> pending_;
+    std::ofstream journal_;
+    size_t journal_bytes_ = 0;
+    std::chrono::steady_clock::time_point last_save_ = std::chrono::steady_clock::now();
+
+    // writes the snapshot of the current generation and then removes the files of the previous generations
+    std::future<bool> compaction_;
+
+    // appends the record to pending_ and applies it to scene_
+    void push(const std::vector<uint8_t>& record);
+    // records the differences of the dirty entities, the probes, the camera and the environment
+    void diff(Context& ctx, uint32_t cube_map);
+    // truncates the journal of the current generation to its header
+    void open_journal();
+    // opens the journal of the next generation, and writes snapshot as its base in the background
+    void start_generation(SceneData snapshot);
+    void wait_compaction();
+
+public:
+    // autosaves are at most this often, edits in between are coalesced
+    std::chrono::milliseconds save_interval_{ 1000 };
+    // journal size past which it is compacted into a snapshot
+    size_t compact_bytes_ = 4 << 20;
+
+    SceneJournal(std::string path);
+    // waits for a compaction in progress, the journal is left for the next run to recover
+    ~SceneJournal();
+
+    // starts over from a snapshot of the whole scene, e.g. after a scene is loaded. the previous files are removed once it is written
+    void reset(Context& ctx, uint32_t cube_map);
+    // the entity was spawned or may have changed
+    void touch(MeshEntity& mesh_entity);
+    // the entity is about to be removed
+    void remove(MeshEntity& mesh_entity);
+    // records the edits and appends them to the journal once save_interval_ has passed since the last autosave. call once per update
+    void update(Context& ctx, uint32_t cube_map);
+    // records and writes the edits right away
+    void save(Context& ctx, uint32_t cube_map);
+
+    // the edits by id rather than by entity, which the functions above are built on. the snapshot's entities and point lights take their indexes as ids
+    void reset(const SceneData& snapshot);
+    // records what differs from the journaled entity or light. the id after the last spawns one, a later id throws
+    void record_entity(uint32_t id, uint64_t prototype, const SceneEntity& entity);
+    void record_point_light(uint32_t id, const ScenePointLight& point_light);
+    void remove_entity(uint32_t id);
+    void remove_point_light(uint32_t id);
+    void record_probes(const std::vector<SceneProbe>& probes);
+    void record_camera(const SceneCamera& camera);
+    void record_environment(const SceneEnvironment& environment);
+    // appends the recorded edits to the journal. a compaction hands the ids out again in order, see JournalScene::compact
+    void write();
+
+    const JournalScene& get_scene() const;
+    size_t get_journal_bytes() const;
+    uint64_t get_generation() const;
+
+    // the latest snapshot at path with its journals replayed onto it. a record cut off by a crash ends the replay. throws if there is no snapshot
+    static SceneData recover(const std::string& path);
+};
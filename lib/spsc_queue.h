@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+
+// bounded lock free queue for exactly one producer thread and one consumer thread
+// tail_ is only written by the producer and head_ only by the consumer, each acquires the other's index to see the slots it released
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+    std::array<T, N> slots_;
+    // on separate cache lines so that the two threads don't keep invalidating each other's index
+    alignas(64) std::atomic<size_t> head_{ 0 };
+    alignas(64) std::atomic<size_t> tail_{ 0 };
+
+public:
+    // producer only. returns false if the queue is full
+    bool push(T value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        slots_[tail & (N - 1)] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only. empty if nothing was pushed
+    std::optional<T> pop() {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return std::nullopt;
+        }
+        std::optional<T> value = std::move(slots_[head & (N - 1)]);
+        head_.store(head + 1, std::memory_order_release);
+        return value;
+    }
+
+    // consumer only
+    bool empty() const {
+        return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire);
+    }
+};
@@ -27,6 +27,7 @@ public:
     virtual void bind(uint32_t tex_unit) {
         glActiveTexture(tex_unit);
         glBindTexture(target_, tex_id_);
+        render_stats().count(RenderCounter::TEXTURE_BINDS);
 #ifdef DEBUG
         check_gl_error();
 #endif
@@ -43,3 +44,20 @@ public:
         return tex_id_;
     }
 };
+
+// a stack of 2d textures of the same size, allocated when constructed
+class TextureArray : public Texture {
+public:
+    TextureArray(int width, int height, int layers, GLenum internal_format, GLenum format, GLenum type) : Texture(GL_TEXTURE_2D_ARRAY, width, height) {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internal_format, width, height, layers, 0, format, type, NULL);
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+#ifdef DEBUG
+        check_gl_error();
+#endif
+    }
+};
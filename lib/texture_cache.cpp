@@ -0,0 +1,128 @@
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include "block_compress.h"
+#include "utilities.h"
+
+// bumped whenever the layout below changes
+constexpr uint32_t CACHE_MAGIC = 0x43424D32; // "CBM2"
+
+int CubeMapImage::get_levels() const {
+    return static_cast<int>(faces[0].size());
+}
+int CubeMapImage::get_level_width(int level) const {
+    return std::max(width >> level, 1);
+}
+size_t CubeMapImage::get_level_size(int level) const {
+    size_t level_width = get_level_width(level);
+    if (format == BC1) {
+        size_t blocks_wide = (level_width + BC1_BLOCK_WIDTH - 1) / BC1_BLOCK_WIDTH;
+        return blocks_wide * blocks_wide * BC1_BLOCK_SIZE;
+    }
+    return level_width * level_width * 3;
+}
+size_t CubeMapImage::get_size() const {
+    size_t size = 0;
+    for (auto& face : faces) {
+        for (auto& level : face) {
+            size += level.size();
+        }
+    }
+    return size;
+}
+
+size_t CubeMapImage::get_vram() const {
+    return format == RGB8 ? get_size() / 3 * 4 : get_size();
+}
+
+void gen_mips(CubeMapImage& image) {
+    for (auto& face : image.faces) {
+        face.resize(1);
+        for (int src_width = image.width; src_width > 1; src_width = std::max(src_width / 2, 1)) {
+            int width = std::max(src_width / 2, 1);
+            const std::vector<uint8_t>& src = face.back();
+            std::vector<uint8_t> level(width * width * 3);
+            for (int y = 0; y < width; y++) {
+                for (int x = 0; x < width; x++) {
+                    // clamped so that odd widths reuse the last row and column
+                    int x0 = std::min(x * 2, src_width - 1), x1 = std::min(x * 2 + 1, src_width - 1);
+                    int y0 = std::min(y * 2, src_width - 1), y1 = std::min(y * 2 + 1, src_width - 1);
+                    for (int c = 0; c < 3; c++) {
+                        int sum = src[(y0 * src_width + x0) * 3 + c] + src[(y0 * src_width + x1) * 3 + c] + src[(y1 * src_width + x0) * 3 + c] + src[(y1 * src_width + x1) * 3 + c];
+                        level[(y * width + x) * 3 + c] = static_cast<uint8_t>((sum + 2) / 4);
+                    }
+                }
+            }
+            face.push_back(std::move(level));
+        }
+    }
+}
+
+std::optional<CubeMapImage> TextureCache::load() const {
+    std::ifstream f(path_, std::ios::binary);
+    if (!f) {
+        return std::nullopt;
+    }
+
+    uint32_t magic = 0;
+    size_t key = 0;
+    int32_t width = 0;
+    int32_t format = 0;
+    int32_t levels = 0;
+    f.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    f.read(reinterpret_cast<char*>(&key), sizeof(key));
+    f.read(reinterpret_cast<char*>(&width), sizeof(width));
+    f.read(reinterpret_cast<char*>(&format), sizeof(format));
+    f.read(reinterpret_cast<char*>(&levels), sizeof(levels));
+    if (!f || magic != CACHE_MAGIC || key != key_ || width <= 0 || format < 0 || format >= NUM_TEXEL_FORMATS || levels <= 0 || levels > 32) {
+        return std::nullopt;
+    }
+
+    CubeMapImage image;
+    image.width = width;
+    image.format = static_cast<TexelFormat>(format);
+    for (auto& face : image.faces) {
+        for (int level = 0; level < levels; level++) {
+            std::vector<uint8_t>& texels = face.emplace_back(image.get_level_size(level));
+            f.read(reinterpret_cast<char*>(texels.data()), texels.size());
+        }
+    }
+    if (!f) {
+        return std::nullopt;
+    }
+    return image;
+}
+
+bool TextureCache::save(const CubeMapImage& image) const {
+    // written next to the cache and renamed over it, so that an interrupted write never leaves a truncated cache behind
+    std::string tmp_path = path_ + ".tmp";
+    {
+        std::ofstream f(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!f) {
+            return false;
+        }
+        int32_t width = image.width;
+        int32_t format = image.format;
+        int32_t levels = image.get_levels();
+        f.write(reinterpret_cast<const char*>(&CACHE_MAGIC), sizeof(CACHE_MAGIC));
+        f.write(reinterpret_cast<const char*>(&key_), sizeof(key_));
+        f.write(reinterpret_cast<const char*>(&width), sizeof(width));
+        f.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        f.write(reinterpret_cast<const char*>(&levels), sizeof(levels));
+        for (auto& face : image.faces) {
+            for (auto& level : face) {
+                f.write(reinterpret_cast<const char*>(level.data()), level.size());
+            }
+        }
+        if (!f) {
+            return false;
+        }
+    }
+    return replace_file(tmp_path, path_);
+}
+
+const std::string& TextureCache::get_path() const {
+    return path_;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+constexpr size_t NUM_CUBE_FACES = 6;
+
+enum TexelFormat {
+    RGB8,
+    BC1,  // 4x4 blocks of 8 bytes, EXT_texture_compression_s3tc
+    NUM_TEXEL_FORMATS = 2
+};
+
+// decoded texels of a cubemap in gl face order. faces[face][level], level 0 being the full size image
+struct CubeMapImage {
+    int width = 0;
+    TexelFormat format = RGB8;
+    std::array<std::vector<std::vector<uint8_t>>, NUM_CUBE_FACES> faces;
+
+    int get_levels() const;
+    int get_level_width(int level) const;
+    // bytes of one face's level in the image's format
+    size_t get_level_size(int level) const;
+    // total bytes across all faces and levels
+    size_t get_size() const;
+    // bytes the image takes up once uploaded, drivers pad rgb8 texels out to four bytes
+    size_t get_vram() const;
+};
+
+// appends the mip chain of each face down to 1x1 with a box filter. the image must be rgb8
+void gen_mips(CubeMapImage& image);
+
+// decoded texels of one environment stored on disk, so that later runs can skip image decoding
+// key identifies the sources the texels were decoded from, a cache with a different key is stale
+class TextureCache {
+    std::string path_;
+    size_t key_;
+
+public:
+    TextureCache(std::string path, size_t key) : path_(std::move(path)), key_(key) {}
+
+    // empty if the cache is missing, stale or truncated
+    std::optional<CubeMapImage> load() const;
+    // returns false if the cache couldn't be written, which only costs the next run a decode
+    bool save(const CubeMapImage& image) const;
+
+    const std::string& get_path() const;
+};
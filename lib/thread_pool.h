@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads consuming a shared task queue
+class ThreadPool {
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+
+    // stops the workers once the queue is drained
+    bool destroy_ = false;
+
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [&] { return destroy_ || !tasks_.empty(); });
+                if (tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+            task();
+        }
+    }
+
+public:
+    ThreadPool(size_t num_threads = std::max(std::thread::hardware_concurrency(), 1u)) {
+        for (size_t i = 0; i < num_threads; i++) {
+            workers_.emplace_back([&] { work(); });
+        }
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            destroy_ = true;
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    // queues f, exceptions it throws are rethrown by the future's get
+    template <typename F>
+    std::future<std::invoke_result_t<F>> submit(F&& f) {
+        auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(f));
+        std::future<std::invoke_result_t<F>> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace([task] { (*task)(); });
+        }
+        cv_.notify_one();
+        return result;
+    }
+
+    size_t size() const {
+        return workers_.size();
+    }
+};
+
+// shared pool for cpu side asset work, such as decoding textures
+inline ThreadPool& worker_pool() {
+    static ThreadPool pool;
+    return pool;
+}
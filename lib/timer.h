@@ -12,11 +12,11 @@ public:
     Timer() {}
 
     virtual void start() {
-        start_ = high_resolution_clock::now();
+        start_ = steady_clock::now();
     }
 
     Duration get_duration() {
-        auto durr = duration_cast<Duration>(high_resolution_clock::now() - start_);
+        auto durr = duration_cast<Duration>(steady_clock::now() - start_);
 
         return durr;
     }
@@ -1,5 +1,7 @@
 #include "utilities.h"
 
+#include <cstdio>
+
 std::string get_file_str(const std::string& fpath) {
     std::ifstream f;
     f.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -8,4 +10,12 @@ std::string get_file_str(const std::string& fpath) {
     stream << f.rdbuf();
     f.close();
     return stream.str();
-}
\ No newline at end of file
+}
+
+bool replace_file(const std::string& tmp_path, const std::string& path) {
+#ifdef _WIN32
+    // rename doesn't replace an existing file on windows. elsewhere it replaces it atomically, and removing it first would lose both files to a crash in between
+    std::remove(path.c_str());
+#endif
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
@@ -3,5 +3,14 @@
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <functional>
 
-std::string get_file_str(const std::string& fpath);
\ No newline at end of file
+std::string get_file_str(const std::string& fpath);
+// renames tmp_path over path, so that readers see either the old file or the new one and an interrupted write leaves the old one in place
+bool replace_file(const std::string& tmp_path, const std::string& path);
+
+// mixes the hash of val into seed
+template <typename T>
+void hash_combine(size_t& seed, const T& val) {
+    seed ^= std::hash<T>{}(val) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
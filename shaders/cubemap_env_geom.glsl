@@ -0,0 +1,42 @@
+#version 330 core
+
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 18) out;
+
+in VS_OUT {
+    vec3 frag_pos;
+    vec3 normal;
+    vec4 frag_pos_light;
+    vec2 uv;
+} gs_in[];
+
+out vec3 frag_pos;
+
+// rotation of each cubemap face in gl face order. bound to binding point 0
+layout (std140) uniform CubeFaces {
+    mat4 u_face_views[6];
+};
+
+uniform mat4 u_projection;
+uniform mat4 u_view_trans;
+// bit i is set when face i is rendered to
+uniform int u_face_mask;
+
+void main()
+{
+    for (int face = 0; face < 6; face++) {
+        if ((u_face_mask & (1 << face)) == 0) {
+            continue;
+        }
+        gl_Layer = face;
+        // the env is centered on the viewer, drop the translation
+        mat4 face_vp = u_projection * u_face_views[face] * mat4(mat3(u_view_trans));
+        for (int i = 0; i < 3; i++) {
+            frag_pos = gs_in[i].frag_pos;
+            vec4 pos = face_vp * gl_in[i].gl_Position;
+            gl_Position = pos.xyzz;
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+}
@@ -0,0 +1,86 @@
+#version 330 core
+
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 18) out;
+
+in VS_OUT {
+    vec3 frag_pos;
+    vec3 normal;
+    vec4 frag_pos_light;
+    vec2 uv;
+} gs_in[];
+
+out vec3 frag_pos;
+out vec3 normal;
+out vec4 frag_pos_light;
+out vec2 uv;
+
+// rotation of each cubemap face in gl face order. bound to binding point 0
+layout (std140) uniform CubeFaces {
+    mat4 u_face_views[6];
+};
+
+uniform mat4 u_projection;
+// translation to the probe origin
+uniform mat4 u_view_trans;
+// bit i is set when face i is rendered to
+uniform int u_face_mask;
+// render to the two hemispheres of a dual paraboloid map instead, the -z hemisphere in layer 0
+uniform bool u_paraboloid;
+
+// projects a position relative to the probe onto the paraboloid of a hemisphere
+vec4 paraboloid_project(vec3 pos, int hemisphere)
+{
+    // the +z hemisphere is rotated half a turn around y so that both face -z
+    if (hemisphere == 1) {
+        pos = vec3(-pos.x, pos.y, -pos.z);
+    }
+    float dist = length(pos);
+    vec3 dir = pos / dist;
+    // the capture's near and far planes
+    float near = u_projection[3][2] / (u_projection[2][2] - 1.0);
+    float far = u_projection[3][2] / (u_projection[2][2] + 1.0);
+    // clip what is behind the hemisphere
+    gl_ClipDistance[0] = -dir.z;
+    return vec4(dir.xy / (1.0 - dir.z), (dist - near) / (far - near) * 2.0 - 1.0, 1.0);
+}
+
+void main()
+{
+    if (u_paraboloid) {
+        for (int hemisphere = 0; hemisphere < 2; hemisphere++) {
+            if ((u_face_mask & (1 << hemisphere)) == 0) {
+                continue;
+            }
+            gl_Layer = hemisphere;
+            for (int i = 0; i < 3; i++) {
+                frag_pos = gs_in[i].frag_pos;
+                normal = gs_in[i].normal;
+                frag_pos_light = gs_in[i].frag_pos_light;
+                uv = gs_in[i].uv;
+                gl_Position = paraboloid_project(vec3(u_view_trans * gl_in[i].gl_Position), hemisphere);
+                EmitVertex();
+            }
+            EndPrimitive();
+        }
+        return;
+    }
+
+    for (int face = 0; face < 6; face++) {
+        if ((u_face_mask & (1 << face)) == 0) {
+            continue;
+        }
+        gl_Layer = face;
+        mat4 face_vp = u_projection * u_face_views[face] * u_view_trans;
+        for (int i = 0; i < 3; i++) {
+            frag_pos = gs_in[i].frag_pos;
+            normal = gs_in[i].normal;
+            frag_pos_light = gs_in[i].frag_pos_light;
+            uv = gs_in[i].uv;
+            gl_Position = face_vp * gl_in[i].gl_Position;
+            gl_ClipDistance[0] = 1.0;
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+}
@@ -0,0 +1,29 @@
+#version 330 core
+
+layout (location=0) in vec3 a_pos;
+layout (location=1) in vec3 a_normal;
+
+// world space outputs, projected to each cubemap face in cubemap_geom.glsl
+out VS_OUT {
+    vec3 frag_pos;
+    vec3 normal;
+    vec4 frag_pos_light;
+    vec2 uv;
+} vs_out;
+
+uniform mat4 u_model_trans;
+uniform mat4 u_light_vp;
+
+void main()
+{
+    vs_out.frag_pos = vec3(u_model_trans * vec4(a_pos, 1.0));
+    vs_out.frag_pos_light = u_light_vp * vec4(vs_out.frag_pos, 1.0);
+    
+    vs_out.normal = mat3(transpose(inverse(u_model_trans))) * a_normal;
+    
+    float x = float((uint(gl_VertexID) << 1u) & uint(2)) / uint(2); 
+    float y = float(uint(gl_VertexID) & uint(2)) / uint(2); 
+    vs_out.uv = vec2(x, y);
+
+    gl_Position = vec4(vs_out.frag_pos, 1.0); 
+}
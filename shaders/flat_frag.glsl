@@ -1,4 +1,16 @@
 #version 330 core
+
+// variant keys. the renderer defines the ones that differ from these defaults when it compiles a variant
+#ifndef SHADOWS
+#define SHADOWS 1
+#endif
+#ifndef MAX_POINT_LIGHTS
+#define MAX_POINT_LIGHTS 30
+#endif
+#ifndef DEBUG_SHADOWS
+#define DEBUG_SHADOWS 0
+#endif
+
 in vec3 frag_pos;
 in vec3 normal;
 
@@ -9,7 +21,6 @@ uniform mat4 u_view_trans;
 
 in vec4 frag_pos_light;
 uniform sampler2D u_shadow_map;
-uniform uint u_debug_shadows;
 
 out vec4 out_color;
 
@@ -79,9 +90,10 @@ struct PointLight {
     float linear;
     float quadratic;  
 };  
-#define NR_POINT_LIGHTS 30
+#if MAX_POINT_LIGHTS > 0
 uniform int u_num_point_lights;
-uniform PointLight point_lights[NR_POINT_LIGHTS];
+uniform PointLight point_lights[MAX_POINT_LIGHTS];
+#endif
 
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 frag_pos, vec3 view_dir)
 {
@@ -127,23 +139,24 @@ void main()
     
     vec3 view_dir = normalize(vec3(inverse(u_view_trans)[3]) - frag_pos);
 
+#if SHADOWS
     float shadow = ShadowCalculation(frag_pos_light);
+#else
+    float shadow = 0.0;
+#endif
 
     vec3 lighting = CalcDirLight(dir_light, norm, camera_pos, shadow);
     // point lights
+#if MAX_POINT_LIGHTS > 0
     for(int i = 0; i < u_num_point_lights; i++)
         lighting += CalcPointLight(point_lights[i], norm, frag_pos, camera_pos);
+#endif
 
-    vec3 shadow_result;
-    if (bool(u_debug_shadows)) {
-        if (shadow > 0.0) {
-            shadow_result = vec3(shadow, 0.0, 0.0);
-        } else {
-            shadow_result = lighting;
-        }
-    } else {
-        shadow_result = lighting;
-    }
+#if DEBUG_SHADOWS
+    vec3 shadow_result = shadow > 0.0 ? vec3(shadow, 0.0, 0.0) : lighting;
+#else
+    vec3 shadow_result = lighting;
+#endif
 
     out_color = vec4(shadow_result, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,21 @@
+// environment map lookups of the reflective and refractive programs
+
+uniform samplerCube u_skybox;
+// second env map mixed in between two reflection probes
+uniform samplerCube u_skybox_blend;
+uniform float u_skybox_blend_weight;
+// set when the env map is a dual paraboloid map instead of a cubemap
+uniform bool u_env_paraboloid;
+uniform sampler2DArray u_paraboloid_map;
+
+vec3 SampleEnv(vec3 dir)
+{
+    if (u_env_paraboloid) {
+        // layer 0 holds the -z hemisphere, layer 1 the +z hemisphere rotated half a turn around y
+        float hemisphere = dir.z > 0.0 ? 1.0 : 0.0;
+        vec3 d = dir.z > 0.0 ? vec3(-dir.x, dir.y, -dir.z) : dir;
+        vec2 uv = d.xy / (1.0 - d.z) * 0.5 + 0.5;
+        return texture(u_paraboloid_map, vec3(uv, hemisphere)).rgb;
+    }
+    return mix(texture(u_skybox, dir).rgb, texture(u_skybox_blend, dir).rgb, u_skybox_blend_weight);
+}
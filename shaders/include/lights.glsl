@@ -0,0 +1,80 @@
+// directional and point lights, shared by the lit programs
+// the results are the light's color, the including shader multiplies in the object's color
+
+#ifndef MAX_POINT_LIGHTS
+#define MAX_POINT_LIGHTS 30
+#endif
+
+struct DirLight {
+    vec3 direction;
+  
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+uniform DirLight dir_light;
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 view_dir, float shadow) {
+    vec3 ambient = light.ambient;
+
+    float diff = max(dot(normal, light.direction), 0.0);
+    vec3 diffuse = light.diffuse * diff;
+
+    // // phong
+    // vec3 reflect_dir = reflect(-light.direction, normal);
+    // float spec = pow(max(dot(view_dir, reflect_dir), 0.0), light.shininess);
+    
+    // blinn-phong
+    vec3 half_dir = normalize(light.direction + view_dir);
+    float spec = pow(max(dot(half_dir, normal), 0.0), light.shininess);
+    vec3 specular = light.specular * spec;
+        
+    vec3 result = (ambient + (1.0 - shadow) * (diffuse + specular));
+    //vec3 result = max(vec3(1.0 - shadow), vec3(1, 0, 0)) * (ambient + (1.0 - shadow) * (diffuse + specular));
+    //vec3 result = vec3(shadow, 0.0, 0.0);
+
+    return result;
+}
+
+struct PointLight {   
+    vec3 position;
+    
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+
+    float constant;
+    float linear;
+    float quadratic;  
+};  
+#if MAX_POINT_LIGHTS > 0
+uniform int u_num_point_lights;
+uniform PointLight point_lights[MAX_POINT_LIGHTS];
+#endif
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 frag_pos, vec3 view_dir)
+{
+    vec3 light_dir = normalize(light.position - frag_pos);
+    // diffuse shading
+    float diff = max(dot(normal, light_dir), 0.0);
+    // specular shading
+    vec3 reflect_dir = reflect(-light_dir, normal);
+    float spec = pow(max(dot(view_dir, reflect_dir), 0.0), light.shininess);
+    // attenuation
+    float distance = length(light.position - frag_pos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + 
+  			     light.quadratic * (distance * distance));    
+    // combine results
+    vec3 ambient  = light.ambient;
+    vec3 diffuse  = light.diffuse * diff;
+    vec3 specular = light.specular * spec;
+    ambient  *= attenuation;
+    diffuse  *= attenuation;
+    specular *= attenuation;
+    
+    vec3 result = (ambient + diffuse + specular);
+    
+    return result;
+}
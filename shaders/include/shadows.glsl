@@ -0,0 +1,46 @@
+// shadow mapping of the directional light, shared by the lit programs
+// the including shader declares the fragment's normal as `normal`
+
+#ifndef SHADOWS
+#define SHADOWS 1
+#endif
+#ifndef PCF_SIZE
+#define PCF_SIZE 3
+#endif
+
+in vec4 frag_pos_light;
+uniform sampler2D u_shadow_map;
+
+float ShadowCalculation(vec4 fragPosLightSpace)
+{
+    // perform perspective divide
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+    // transform to [0,1] range
+    projCoords = projCoords * 0.5 + 0.5;
+    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
+    float closestDepth = texture(u_shadow_map, projCoords.xy).r; 
+    // get depth of current fragment from light's perspective
+    float currentDepth = projCoords.z;
+    // check whether current frag pos is in shadow
+    float base_bias = 0.03;
+    float dir_light = (1.0 - dot(normal, vec3(fragPosLightSpace)));
+    float bias = max(base_bias * dir_light, base_bias);
+    float shadow = 0.0;
+
+    vec2 texelSize = 1.0 / textureSize(u_shadow_map, 0) * 2.0;
+    const int pcf_radius = PCF_SIZE / 2;
+    for(int x = -pcf_radius; x <= pcf_radius; ++x)
+    {
+        for(int y = -pcf_radius; y <= pcf_radius; ++y)
+        {
+            float pcfDepth = texture(u_shadow_map, projCoords.xy + vec2(x, y) * texelSize).r; 
+            shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;        
+        }    
+    }
+    shadow /= float(PCF_SIZE * PCF_SIZE);
+
+    if (currentDepth > 1.0)
+        shadow = 0.0;
+
+    return shadow;
+}
@@ -1,12 +1,20 @@
+// single pass post processing of the offscreen target into the window
+// the renderer compiles a permutation per set of enabled effects by prepending their #defines: FXAA, FOG, VIGNETTE, BW
+// fxaa from: http://blog.simonrodriguez.fr/articles/30-07-2016_implementing_fxaa.html
+
 #version 330 core
 
 in vec2 uv;
 
 uniform sampler2D u_offscreen_tex;
+#ifdef FOG
 uniform sampler2D u_depth_map;
+#endif
 
 out vec4 out_color;
 
+const float GAMMA = 1.9;
+
 // vignette
 const float ellipse_factor = 0.8;
 const float min_vignette_radius = 0.4;
@@ -17,8 +25,245 @@ const float vignette_intensity = 0.92;
 // fog
 const vec3 fog_base = vec3(0.7);
 
+vec3 gamma_correct(vec3 color) {
+    return pow(color, vec3(1.0 / GAMMA));
+}
+
+#ifdef FXAA
+struct InverseScreenSize {
+    float x;
+    float y;
+};
+uniform InverseScreenSize inverseScreenSize;
+
+float rgb2luma(vec3 rgb){
+    return dot(rgb, vec3(0.299, 0.587, 0.114));
+}
+
+// edges are found on the gamma corrected colors, as they were when fxaa was a separate pass after the gamma correction
+vec3 fetch(vec2 tex_uv) {
+    return gamma_correct(texture(u_offscreen_tex, tex_uv).rgb);
+}
+// textureOffset needs a constant offset, hence the macro
+#define fetch_offset(offset) gamma_correct(textureOffset(u_offscreen_tex, uv, offset).rgb)
+
+const float EDGE_THRESHOLD_MIN = 0.0312;
+const float EDGE_THRESHOLD_MAX = 0.125;
+const float SUBPIXEL_QUALITY = 0.75;
+
+const int ITERATIONS = 12;
+const float QUALITY[7] = float[](1.5, 2.0, 2.0, 2.0, 2.0, 4.0, 8.0);
+
+// the uv to read the anti-aliased color from
+vec2 fxaa_uv()
+{
+    vec3 colorCenter = fetch(uv);
+
+    // Luma at the current fragment
+    float lumaCenter = rgb2luma(colorCenter);
+
+    // Luma at the four direct neighbours of the current fragment.
+    float lumaDown = rgb2luma(fetch_offset(ivec2(0,-1)));
+    float lumaUp = rgb2luma(fetch_offset(ivec2(0,1)));
+    float lumaLeft = rgb2luma(fetch_offset(ivec2(-1,0)));
+    float lumaRight = rgb2luma(fetch_offset(ivec2(1,0)));
+
+    // Find the maximum and minimum luma around the current fragment.
+    float lumaMin = min(lumaCenter,min(min(lumaDown,lumaUp),min(lumaLeft,lumaRight)));
+    float lumaMax = max(lumaCenter,max(max(lumaDown,lumaUp),max(lumaLeft,lumaRight)));
+
+    // Compute the delta.
+    float lumaRange = lumaMax - lumaMin;
+
+    // If the luma variation is lower that a threshold (or if we are in a really dark area), we are not on an edge, don't perform any AA.
+    if(lumaRange < max(EDGE_THRESHOLD_MIN,lumaMax*EDGE_THRESHOLD_MAX)){
+        return uv;
+    }
+
+    // Query the 4 remaining corners lumas.
+    float lumaDownLeft = rgb2luma(fetch_offset(ivec2(-1,-1)));
+    float lumaUpRight = rgb2luma(fetch_offset(ivec2(1,1)));
+    float lumaUpLeft = rgb2luma(fetch_offset(ivec2(-1,1)));
+    float lumaDownRight = rgb2luma(fetch_offset(ivec2(1,-1)));
+
+    // Combine the four edges lumas (using intermediary variables for future computations with the same values).
+    float lumaDownUp = lumaDown + lumaUp;
+    float lumaLeftRight = lumaLeft + lumaRight;
+
+    // Same for corners
+    float lumaLeftCorners = lumaDownLeft + lumaUpLeft;
+    float lumaDownCorners = lumaDownLeft + lumaDownRight;
+    float lumaRightCorners = lumaDownRight + lumaUpRight;
+    float lumaUpCorners = lumaUpRight + lumaUpLeft;
+
+    // Compute an estimation of the gradient along the horizontal and vertical axis.
+    float edgeHorizontal =  abs(-2.0 * lumaLeft + lumaLeftCorners)  + abs(-2.0 * lumaCenter + lumaDownUp ) * 2.0    + abs(-2.0 * lumaRight + lumaRightCorners);
+    float edgeVertical =    abs(-2.0 * lumaUp + lumaUpCorners)      + abs(-2.0 * lumaCenter + lumaLeftRight) * 2.0  + abs(-2.0 * lumaDown + lumaDownCorners);
+
+    // Is the local edge horizontal or vertical ?
+    bool isHorizontal = (edgeHorizontal >= edgeVertical);
+
+    // Select the two neighboring texels lumas in the opposite direction to the local edge.
+    float luma1 = isHorizontal ? lumaDown : lumaLeft;
+    float luma2 = isHorizontal ? lumaUp : lumaRight;
+    // Compute gradients in this direction.
+    float gradient1 = luma1 - lumaCenter;
+    float gradient2 = luma2 - lumaCenter;
+
+    // Which direction is the steepest ?
+    bool is1Steepest = abs(gradient1) >= abs(gradient2);
+
+    // Gradient in the corresponding direction, normalized.
+    float gradientScaled = 0.25*max(abs(gradient1),abs(gradient2));
+
+    // Choose the step size (one pixel) according to the edge direction.
+    float stepLength = isHorizontal ? inverseScreenSize.y : inverseScreenSize.x;
+
+    // Average luma in the correct direction.
+    float lumaLocalAverage = 0.0;
+
+    if(is1Steepest){
+        // Switch the direction
+        stepLength = - stepLength;
+        lumaLocalAverage = 0.5*(luma1 + lumaCenter);
+    } else {
+        lumaLocalAverage = 0.5*(luma2 + lumaCenter);
+    }
+
+    // Shift UV in the correct direction by half a pixel.
+    vec2 currentUv = uv;
+    if(isHorizontal){
+        currentUv.y += stepLength * 0.5;
+    } else {
+        currentUv.x += stepLength * 0.5;
+    }
+
+    // Compute offset (for each iteration step) in the right direction.
+    vec2 offset = isHorizontal ? vec2(inverseScreenSize.x,0.0) : vec2(0.0,inverseScreenSize.y);
+    // Compute UVs to explore on each side of the edge, orthogonally. The QUALITY allows us to step faster.
+    vec2 uv1 = currentUv - offset;
+    vec2 uv2 = currentUv + offset;
+
+    // Read the lumas at both current extremities of the exploration segment, and compute the delta wrt to the local average luma.
+    float lumaEnd1 = rgb2luma(fetch(uv1));
+    float lumaEnd2 = rgb2luma(fetch(uv2));
+    lumaEnd1 -= lumaLocalAverage;
+    lumaEnd2 -= lumaLocalAverage;
+
+    // If the luma deltas at the current extremities are larger than the local gradient, we have reached the side of the edge.
+    bool reached1 = abs(lumaEnd1) >= gradientScaled;
+    bool reached2 = abs(lumaEnd2) >= gradientScaled;
+    bool reachedBoth = reached1 && reached2;
+
+    // If the side is not reached, we continue to explore in this direction.
+    if(!reached1){
+        uv1 -= offset;
+    }
+    if(!reached2){
+        uv2 += offset;
+    }
+
+    // If both sides have not been reached, continue to explore.
+    if(!reachedBoth){
+
+        for(int i = 2; i < ITERATIONS; i++){
+            // If needed, read luma in 1st direction, compute delta.
+            if(!reached1){
+                lumaEnd1 = rgb2luma(fetch(uv1));
+                lumaEnd1 = lumaEnd1 - lumaLocalAverage;
+            }
+            // If needed, read luma in opposite direction, compute delta.
+            if(!reached2){
+                lumaEnd2 = rgb2luma(fetch(uv2));
+                lumaEnd2 = lumaEnd2 - lumaLocalAverage;
+            }
+            // If the luma deltas at the current extremities is larger than the local gradient, we have reached the side of the edge.
+            reached1 = abs(lumaEnd1) >= gradientScaled;
+            reached2 = abs(lumaEnd2) >= gradientScaled;
+            reachedBoth = reached1 && reached2;
+
+            // If the side is not reached, we continue to explore in this direction, with a variable quality.
+            if(!reached1){
+                uv1 -= offset * QUALITY[i];
+            }
+            if(!reached2){
+                uv2 += offset * QUALITY[i];
+            }
+
+            // If both sides have been reached, stop the exploration.
+            if(reachedBoth){ break;}
+        }
+    }
+
+    // Compute the distances to each extremity of the edge.
+    float distance1 = isHorizontal ? (uv.x - uv1.x) : (uv.y - uv1.y);
+    float distance2 = isHorizontal ? (uv2.x - uv.x) : (uv2.y - uv.y);
+
+    // In which direction is the extremity of the edge closer ?
+    bool isDirection1 = distance1 < distance2;
+    float distanceFinal = min(distance1, distance2);
+
+    // Length of the edge.
+    float edgeThickness = (distance1 + distance2);
+
+    // UV offset: read in the direction of the closest side of the edge.
+    float pixelOffset = - distanceFinal / edgeThickness + 0.5;
+
+    // Is the luma at center smaller than the local average ?
+    bool isLumaCenterSmaller = lumaCenter < lumaLocalAverage;
+
+    // If the luma at center is smaller than at its neighbour, the delta luma at each end should be positive (same variation).
+    // (in the direction of the closer side of the edge.)
+    bool correctVariation = ((isDirection1 ? lumaEnd1 : lumaEnd2) < 0.0) != isLumaCenterSmaller;
+
+    // If the luma variation is incorrect, do not offset.
+    float finalOffset = correctVariation ? pixelOffset : 0.0;
+
+    // Sub-pixel shifting
+    // Full weighted average of the luma over the 3x3 neighborhood.
+    float lumaAverage = (1.0/12.0) * (2.0 * (lumaDownUp + lumaLeftRight) + lumaLeftCorners + lumaRightCorners);
+    // Ratio of the delta between the global average and the center luma, over the luma range in the 3x3 neighborhood.
+    float subPixelOffset1 = clamp(abs(lumaAverage - lumaCenter)/lumaRange,0.0,1.0);
+    float subPixelOffset2 = (-2.0 * subPixelOffset1 + 3.0) * subPixelOffset1 * subPixelOffset1;
+    // Compute a sub-pixel offset based on this delta.
+    float subPixelOffsetFinal = subPixelOffset2 * subPixelOffset2 * SUBPIXEL_QUALITY;
+
+    // Pick the biggest of the two offsets.
+    finalOffset = max(finalOffset,subPixelOffsetFinal);
+
+    // Compute the final UV coordinates.
+    vec2 finalUv = uv;
+    if(isHorizontal){
+        finalUv.y += finalOffset * stepLength;
+    } else {
+        finalUv.x += finalOffset * stepLength;
+    }
+
+    // The color is read at the new UV coordinates.
+    return finalUv;
+}
+#endif
+
 void main()
-{ 
+{
+#ifdef FXAA
+    vec3 tex_color = texture(u_offscreen_tex, fxaa_uv()).rgb;
+#else
+    vec3 tex_color = texture(u_offscreen_tex, uv).rgb;
+#endif
+    out_color = vec4(tex_color, 1.0);
+
+    // b & w
+#ifdef BW
+    vec3 avg = vec3(0.2126 * out_color.r + 0.7152 * out_color.g + 0.0722 * out_color.b);
+    out_color.rgb = avg;
+#endif
+
+    // gamma correction
+    out_color.rgb = gamma_correct(out_color.rgb);
+
+    // fog
+#ifdef FOG
     float n = 0.00001;
     float f = 100.0;
 
@@ -27,36 +272,18 @@ void main()
     float z_ndc = 2.0 * depth - 1.0;
     // use for perspective
     float z_eye = 2.0 * n * f / (f + n - z_ndc * (f - n));
-    
-    vec3 tex_color = texture(u_offscreen_tex, uv).rgb;
-    out_color = vec4(tex_color, 1.0);
-    
-    // fog
-    /*
+
     float fog_level = clamp(smoothstep(0.7, 1.0, 1.0 - z_eye), 0.1, 1.0);
     if (z_eye >= f) {
         fog_level = 0.1;
-    } 
-    */
-    // b & w
-    /*
-    vec3 avg = vec3(0.2126 * out_color.r + 0.7152 * out_color.g + 0.0722 * out_color.b);
-    out_color.rgb = avg;
-    */
+    }
+    out_color.rgb = mix(out_color.rgb, fog_base, 1.0 - fog_level);
+#endif
+
     // vignette
-    /*
+#ifdef VIGNETTE
     vec2 uv_2 = (uv * 2) - 1;
     vec3 vignette = 1.0 - vec3(smoothstep(outer_radius - gradient_fade_inner_radius, outer_radius, length(uv_2) - min_vignette_radius));
-    */
-    // gamma correction
-    out_color.rgb = pow(out_color.rgb, vec3(1 / 1.9));
-
-    // fog mix
-    //out_color.rgb = mix(out_color.rgb, fog_base, 1.0 - fog_level);
-    // vignette mix
-    // out_color.rgb = mix(out_color.rgb, out_color.rgb * vignette, vignette_intensity);
-
-    // write to depth from tex
-    // ! not necessary due to blitting
-    //gl_FragDepth = depth;
+    out_color.rgb = mix(out_color.rgb, out_color.rgb * vignette, vignette_intensity);
+#endif
 }
@@ -0,0 +1,19 @@
+#version 330 core
+
+in vec2 paraboloid_pos;
+flat in int side;
+
+uniform samplerCube u_skybox;
+
+out vec4 out_color;
+
+void main()
+{
+    // inverse of the paraboloid projection in cubemap_geom.glsl
+    float len2 = dot(paraboloid_pos, paraboloid_pos);
+    vec3 dir = vec3(2.0 * paraboloid_pos, len2 - 1.0) / (1.0 + len2);
+    if (side == 1) {
+        dir = vec3(-dir.x, dir.y, -dir.z);
+    }
+    out_color = texture(u_skybox, dir);
+}
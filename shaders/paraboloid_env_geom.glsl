@@ -0,0 +1,30 @@
+#version 330 core
+
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 6) out;
+
+in vec2 uv[];
+
+// position on the paraboloid, the screen covering triangle spans the whole hemisphere
+out vec2 paraboloid_pos;
+flat out int side;
+
+// bit i is set when hemisphere i is rendered to
+uniform int u_face_mask;
+
+void main()
+{
+    for (int hemisphere = 0; hemisphere < 2; hemisphere++) {
+        if ((u_face_mask & (1 << hemisphere)) == 0) {
+            continue;
+        }
+        gl_Layer = hemisphere;
+        for (int i = 0; i < 3; i++) {
+            paraboloid_pos = gl_in[i].gl_Position.xy;
+            side = hemisphere;
+            gl_Position = gl_in[i].gl_Position;
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+}
@@ -19,6 +19,7 @@
 
 #include <memory>
 #include <chrono>
+#include <string>
 
 #ifdef DEBUG
 #include <iostream>
@@ -27,10 +28,8 @@
 #include "mesh.h"
 #include "my_context.h"
 #include "camera.h"
-
-#ifdef TIMER
-#include "timer.h"
-#endif
+#include "cpu_profiler.h"
+#include "input_log.h"
 
 #include "mesh_data.h"
 
@@ -48,6 +47,9 @@ constexpr int FPS = 60;
 const std::chrono::nanoseconds TIMESTEP(std::chrono::duration_cast<std::chrono::nanoseconds>(1000ms / FPS));
 
 std::unique_ptr<MyContext> ctx;
+// input passed to the context is written to the recorder. while replaying, the replayer's input replaces the window's
+std::unique_ptr<InputRecorder> input_recorder;
+std::unique_ptr<InputReplayer> input_replayer;
 
 glm::vec2 get_cursor_pos(GLFWwindow* window) {
     int width, height;
@@ -65,36 +67,19 @@ glm::vec2 get_cursor_pos(GLFWwindow* window) {
     return ray_nds;
 }
 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+void on_resize(int width, int height)
 {
     // ctx->base_width_ = width;
     // std::cout << width << std::endl;
     ctx->set_viewport(width, height);
 }
 
-void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+// cursor_pos in nds, width and height of the window
+void on_mouse_button(int button, int action, glm::vec2 cursor_pos, int width, int height)
 {
-    // Get the size of the window
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-
-    // Get the position of the mouse in the window
-    double xpos, ypos;
-    glfwGetCursorPos(window, &xpos, &ypos);
-
-    // Convert screen position to nds
-    float x_nds = (2.0f * xpos) / width - 1.0f;
-    float y_nds = 1.0f - (2.0f * ypos) / height;
-
-
     // Update the position of the first vertex if the left button is pressed
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
         ctx->mouse_ctx.hold();
-
-        int width, height;
-        glfwGetWindowSize(window, &width, &height);
-
-        glm::vec2 cursor_pos = get_cursor_pos(window);
         ctx->select(cursor_pos, width, height);
     }
     else if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE) {
@@ -102,7 +87,7 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
     }
 }
 
-void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+void on_key(int key, int action, int mods)
 {
     if (action == GLFW_PRESS) {
         float window_size_factor = 2 * 0.1;
@@ -139,8 +124,18 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
                 auto point_light = std::make_shared<PointLight>(glm::vec3(0.f));
                 ctx->env->point_lights_.push_back(point_light);
                 ctx->mesh_list.push_back(point_light);
+                if (ctx->journal_) {
+                    ctx->journal_->touch(*point_light);
+                }
             }
             break;
+            // reflection probes
+        case GLFW_KEY_9:
+            ctx->place_reflection_probe();
+            break;
+        case GLFW_KEY_0:
+            ctx->env->clear_reflection_probes();
+            break;
             // mode
         case GLFW_KEY_M:
             ctx->switch_draw_mode();
@@ -189,6 +184,70 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         case GLFW_KEY_SLASH:
             ctx->fxaa_use_ = !ctx->fxaa_use_;
             break;
+        case GLFW_KEY_F1:
+            ctx->print_render_target_stats();
+            break;
+        case GLFW_KEY_F2:
+            ctx->fog_use_ = !ctx->fog_use_;
+            break;
+        case GLFW_KEY_F3:
+            ctx->vignette_use_ = !ctx->vignette_use_;
+            break;
+        case GLFW_KEY_F4:
+            ctx->bw_use_ = !ctx->bw_use_;
+            break;
+        case GLFW_KEY_F7:
+            // the next launch compiles every program from source
+            program_cache().clear();
+            std::cout << "Program binary cache cleared" << std::endl;
+            break;
+        case GLFW_KEY_F8:
+            ctx->print_gpu_stats();
+            break;
+        case GLFW_KEY_F9:
+            ctx->gpu_overlay_ = !ctx->gpu_overlay_;
+            break;
+        case GLFW_KEY_F10:
+            cpu_profiler().set_enabled(!cpu_profiler().is_enabled());
+            std::cout << "CPU profiler " << (cpu_profiler().is_enabled() ? "enabled" : "disabled") << std::endl;
+            break;
+        case GLFW_KEY_F12:
+            // stopping prints the last frame and writes the frames counted since starting
+            if (render_stats().is_enabled()) {
+                render_stats().print_last();
+                if (render_stats().export_csv(RENDER_STATS_PATH)) {
+                    std::cout << "Render stats written to " << RENDER_STATS_PATH << std::endl;
+                }
+            }
+            render_stats().set_enabled(!render_stats().is_enabled());
+            break;
+        case GLFW_KEY_SEMICOLON:
+            std::cout << "last second:" << std::endl;
+            FrameMonitor::print(ctx->frame_monitor_.get_last_report());
+            std::cout << "since launch:" << std::endl;
+            FrameMonitor::print(ctx->frame_monitor_.get_total_report());
+            break;
+        case GLFW_KEY_LEFT_BRACKET:
+            if (ctx->save_scene(SCENE_PATH)) {
+                std::cout << "Scene written to " << SCENE_PATH << std::endl;
+            }
+            else {
+                std::cout << "Scene could not be written to " << SCENE_PATH << std::endl;
+            }
+            break;
+        case GLFW_KEY_RIGHT_BRACKET:
+            try {
+                ctx->load_scene(SCENE_PATH);
+            }
+            catch (const std::exception& e) {
+                std::cout << e.what() << std::endl;
+            }
+            break;
+        case GLFW_KEY_F11:
+            if (!cpu_profiler().export_trace(TRACE_PATH)) {
+                std::cout << "CPU trace could not be written to " << TRACE_PATH << std::endl;
+            }
+            break;
         default:
             // model
             if (selected.has_value()) {
@@ -198,6 +257,9 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
                     {
                         auto pos = ctx->mesh_list.begin() + ctx->mouse_ctx.get_selected();
                         auto& mesh_ptr = *pos;
+                        if (ctx->journal_) {
+                            ctx->journal_->remove(*mesh_ptr);
+                        }
                         ctx->mesh_list.erase(pos);
                         // TODO: make this more efficient
                         if (dynamic_cast<PointLight*>(mesh_ptr.get())) {
@@ -268,14 +330,42 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
                 case GLFW_KEY_Z:
                     selected->get().set_dyn_reflections(!selected->get().get_dyn_reflections());
                     break;
+                case GLFW_KEY_Q:
+                    ctx->switch_probe_update();
+                    break;
+                case GLFW_KEY_E:
+                    selected->get().set_env_projection(selected->get().get_env_projection() == EnvProjection::CUBE_MAP ? EnvProjection::DUAL_PARABOLOID : EnvProjection::CUBE_MAP);
+                    break;
+                    // receive shadows
+                case GLFW_KEY_F5:
+                    {
+                        ShaderVariant variant = selected->get().get_variant();
+                        variant.shadows = !variant.shadows;
+                        selected->get().set_variant(variant);
+                    }
+                    break;
+                    // cycle the pcf kernel through 1, 3, 5 and 7 texels
+                case GLFW_KEY_F6:
+                    {
+                        ShaderVariant variant = selected->get().get_variant();
+                        variant.pcf_size = (variant.pcf_size + 2) % 8;
+                        selected->get().set_variant(variant);
+                    }
+                    break;
                 }
             }
             break;
         }
+
+        // the selected mesh may have been moved, recolored or reshaded. the journal records only what differs once it saves
+        Optional<MeshEntity> edited = ctx->get_selected();
+        if (ctx->journal_ && edited.has_value()) {
+            ctx->journal_->touch(edited.value().get());
+        }
     }
 }
 
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+void on_scroll(double yoffset) {
     ctx->mouse_ctx.set_scroll(ctx->mouse_ctx.get_scroll() + yoffset);
     double scroll_diff = ctx->mouse_ctx.get_scroll() - ctx->mouse_ctx.get_prev_scroll();
 
@@ -287,8 +377,128 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
     ctx->env->camera->zoom_protected(yoffset > 0 ? Camera::ScaleDir::In : Camera::ScaleDir::Out, glm::abs(scroll_diff / 20.f));
 }
 
-int main(void)
+// everything that changes the context goes through here, so that recording it and replaying the log reproduces a run
+void apply_input(const InputEvent& event)
+{
+    if (input_recorder) {
+        input_recorder->push(event);
+    }
+    switch (event.type) {
+    case InputEventType::INPUT_TICK:
+        // setting the position happens per tick instead of in a callback because the callback didnt update frequently enough which caused drift
+        ctx->mouse_ctx.set_position(glm::vec2(event.x, event.y));
+        ctx->update(TIMESTEP);
+        break;
+    case InputEventType::INPUT_FRAME:
+        // drawn by the main loop
+        break;
+    case InputEventType::INPUT_KEY:
+        // saving and loading the scene, clearing the program cache and exporting a trace depend on the files at the time rather than on the log
+        if (input_replayer && (event.code == GLFW_KEY_LEFT_BRACKET || event.code == GLFW_KEY_RIGHT_BRACKET || event.code == GLFW_KEY_F7 || event.code == GLFW_KEY_F11)) {
+            break;
+        }
+        on_key(event.code, event.action, event.mods);
+        break;
+    case InputEventType::INPUT_MOUSE_BUTTON:
+        on_mouse_button(event.code, event.action, glm::vec2(event.x, event.y), event.width, event.height);
+        break;
+    case InputEventType::INPUT_SCROLL:
+        on_scroll(event.y);
+        break;
+    case InputEventType::INPUT_RESIZE:
+        on_resize(event.width, event.height);
+        break;
+    default:
+        break;
+    }
+}
+
+// the window's input is ignored while replaying
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    if (!input_replayer) {
+        apply_input(InputEvent::resize(width, height));
+    }
+}
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
+    if (!input_replayer) {
+        int width, height;
+        glfwGetWindowSize(window, &width, &height);
+        glm::vec2 cursor_pos = get_cursor_pos(window);
+        apply_input(InputEvent::mouse_button(button, action, mods, cursor_pos.x, cursor_pos.y, width, height));
+    }
+}
+
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (!input_replayer) {
+        apply_input(InputEvent::key(key, action, mods));
+    }
+}
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+    if (!input_replayer) {
+        apply_input(InputEvent::scroll(xoffset, yoffset));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    // --record <path> writes the input of the run to a log, --replay <path> plays a log back in place of the window's input
+    // at the recorded pace, or as fast as possible in a hidden window with --headless. --scene <path> starts from a saved scene
+    // --autosave journals the edits to data/autosave, --recover starts from that autosave and continues it
+    std::string scene_path;
+    bool autosave = false;
+    bool recover = false;
+    std::string record_path;
+    std::string replay_path;
+    bool headless = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) {
+            record_path = argv[++i];
+        }
+        else if (arg == "--replay" && i + 1 < argc) {
+            replay_path = argv[++i];
+        }
+        else if (arg == "--scene" && i + 1 < argc) {
+            scene_path = argv[++i];
+        }
+        else if (arg == "--autosave") {
+            autosave = true;
+        }
+        else if (arg == "--recover") {
+            recover = true;
+        }
+        else if (arg == "--headless") {
+            headless = true;
+        }
+        else {
+            std::cout << "usage: " << argv[0] << " [--scene <path>] [--autosave] [--recover] [--record <path>] [--replay <path> [--headless]]" << std::endl;
+            return -1;
+        }
+    }
+    if (headless && replay_path.empty()) {
+        std::cout << "--headless requires --replay" << std::endl;
+        return -1;
+    }
+    if (!replay_path.empty()) {
+        try {
+            input_replayer = std::make_unique<InputReplayer>(replay_path);
+        }
+        catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        if (input_replayer->get_header().timestep_ns != TIMESTEP.count()) {
+            std::cout << replay_path << " was recorded at a different timestep" << std::endl;
+            return -1;
+        }
+    }
+
     GLFWwindow* window;
 
     // Initialize the library
@@ -312,6 +522,13 @@ int main(void)
     int xpos, ypos;
     glfwGetMonitorWorkarea(primary, &xpos, &ypos, &WIDTH, &HEIGHT);
 
+    if (headless) {
+        // still needs a display, e.g. xvfb-run on a machine without one
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        WIDTH = input_replayer->get_header().width;
+        HEIGHT = input_replayer->get_header().height;
+    }
+
     // Create a windowed mode window and its OpenGL context
     window = glfwCreateWindow(WIDTH, HEIGHT, "3D Scene Editor", NULL, NULL);
     if (!window)
@@ -355,22 +572,75 @@ int main(void)
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-    glfwShowWindow(window);
     int pixWidth, pixHeight;
+    if (headless) {
+        // swaps don't wait for vsync
+        glfwSwapInterval(0);
+    }
+    else {
+        glfwShowWindow(window);
+    }
     glfwGetFramebufferSize(window, &pixWidth, &pixHeight);
+    if (input_replayer) {
+        // drawn at the recorded size, whatever the size of the window
+        pixWidth = input_replayer->get_header().width;
+        pixHeight = input_replayer->get_header().height;
+    }
     // framebuffer_size_callback(window, pixWidth, pixHeight);
 
+    // compare a cold start, after clearing the program cache, with a warm one to measure the binary cache
+    auto launch = std::chrono::steady_clock::now();
+    bool first_frame = true;
+
     ctx = std::make_unique<MyContext>(
         pixWidth,
         pixHeight
     );
 
 #ifdef TIMER
-    FrameTimer<std::chrono::seconds> frame_timer(std::chrono::seconds(1));
+    // prints the percentiles of every second
+    ctx->frame_monitor_.print_reports_ = true;
 #endif
 
+    if (!record_path.empty()) {
+        InputLogHeader header;
+        header.timestep_ns = TIMESTEP.count();
+        header.width = pixWidth;
+        header.height = pixHeight;
+        try {
+            input_recorder = std::make_unique<InputRecorder>(record_path, header);
+        }
+        catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+    }
+    if (input_recorder || input_replayer) {
+        ctx->set_blocking_loads(true);
+    }
+    // after blocking loads are set, so that a replay starts from the scene's environment on the same frame as its recording
+    try {
+        if (!scene_path.empty()) {
+            ctx->load_scene(scene_path);
+        }
+        if (recover) {
+            ctx->recover_scene(AUTOSAVE_PATH);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return -1;
+    }
+    if (autosave || recover) {
+        ctx->enable_autosave(AUTOSAVE_PATH);
+    }
+
     auto previous_frame = std::chrono::steady_clock::now();
+    auto previous_present = previous_frame;
     std::chrono::nanoseconds lag(0);
+    auto replay_start = previous_frame;
+    std::chrono::microseconds replay_time(0);
 
     // Loop until the user closes the window
     while (!glfwWindowShouldClose(window))
@@ -384,36 +654,89 @@ int main(void)
         auto current_frame = std::chrono::steady_clock::now();
         auto frame_time = current_frame - previous_frame;
         previous_frame = current_frame;
-        lag += std::chrono::duration_cast<std::chrono::nanoseconds>(frame_time);
 
-        while (lag >= TIMESTEP) {
-            // setting the position happens in main instead of in a callback because the callback didnt update frequently enough which caused drift
-            ctx->mouse_ctx.set_position(get_cursor_pos(window));
+        InputEvent frame;
+        if (input_replayer) {
+            // the ticks of the frame and the callbacks polled after the previous one, up to the frame's draw
+            bool replaying;
+            try {
+                while ((replaying = input_replayer->next(frame)) && frame.type != InputEventType::INPUT_FRAME) {
+                    apply_input(frame);
+                }
+            }
+            catch (const std::exception& e) {
+                // a damaged log is replayed up to the damage
+                std::cout << e.what() << std::endl;
+                replaying = false;
+            }
+            if (!replaying) {
+                if (input_replayer->is_truncated()) {
+                    std::cout << "The log ends with a partial event, it was replayed up to it" << std::endl;
+                }
+                std::cout << "Replayed " << input_replayer->get_frames() << " frames in "
+                    << std::chrono::duration<float, std::milli>(current_frame - replay_start).count() << " ms" << std::endl;
+                FrameMonitor::print(ctx->frame_monitor_.get_total_report());
+                break;
+            }
+            replay_time += std::chrono::microseconds(frame.frame_us);
+        }
+        else {
+            lag += std::chrono::duration_cast<std::chrono::nanoseconds>(frame_time);
 
-            ctx->update(TIMESTEP);
+            while (lag >= TIMESTEP) {
+                glm::vec2 cursor_pos = get_cursor_pos(window);
+                apply_input(InputEvent::tick(cursor_pos.x, cursor_pos.y));
 
-            lag -= TIMESTEP;
+                lag -= TIMESTEP;
+            }
+            frame = InputEvent::frame(std::chrono::duration_cast<std::chrono::microseconds>(frame_time).count());
+        }
+        apply_input(frame);
+        if (input_recorder) {
+            input_recorder->flush();
         }
 
         // // calculate how close or far we are from the next timestep
         // std::chrono::nanoseconds alpha(lag.count() / TIMESTEP.count())
         // std::this_thread::sleep_for(TIMESTEP - lag);
         ctx->draw();
+        auto drawn = std::chrono::steady_clock::now();
 
         // Swap front and back buffers
         glfwSwapBuffers(window);
 
+        auto present = std::chrono::steady_clock::now();
+        FrameSample sample;
+        sample.cpu = std::chrono::duration<float, std::milli>(drawn - current_frame).count();
+        sample.gpu = ctx->gpu_profiler_->take_frame_ms();
+        sample.present = std::chrono::duration<float, std::milli>(present - previous_present).count();
+        previous_present = present;
+        ctx->frame_monitor_.record(sample);
+
+        if (first_frame) {
+            first_frame = false;
+            std::cout << "First frame after " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - launch).count() << " ms ("
+                << program_cache().get_hits() << " programs from the binary cache, " << program_cache().get_misses() << " compiled)" << std::endl;
+        }
+
         // Poll for and process events
         glfwPollEvents();
         
+        if (input_replayer) {
+            // at the pace the frames were recorded at
+            if (!headless) {
+                std::this_thread::sleep_until(replay_start + replay_time);
+            }
+            continue;
+        }
         // fixed max rendering rate
         std::chrono::nanoseconds wait_dur = (current_frame + TIMESTEP) - std::chrono::steady_clock::now() - lag;
         std::this_thread::sleep_for(wait_dur);
-#ifdef TIMER
-        frame_timer.print();
-#endif
     }
 
+    // the files are kept, the next run continues from them with --recover
+    ctx->flush_autosave();
+
     // Deallocate glfw internals
     glfwTerminate();
     return 0;
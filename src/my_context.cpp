@@ -20,10 +20,7 @@ MyContext::MyContext(int width, int height) :
             std::make_shared<PointLight>(glm::vec3(2.5f, 1.f, -2.5f)),
             std::make_shared<PointLight>(glm::vec3(-2.5f, 1.f, -2.5f)),
         },
-        std::make_unique<CubeMapEntity>(
-            "../data/night_env/",
-            true
-        )
+        env_library.load_active(0)
     ));
     cameras = {
         env->camera.get_camera_ptr(),
@@ -40,7 +37,7 @@ MyContext::MyContext(int width, int height) :
 }
 
 void MyContext::switch_cube_map() {
-    env->swap_cube_map(curr_cube_map);
+    env_library.request_next();
 }
 
 void MyContext::switch_shader() {
@@ -59,6 +56,73 @@ void MyContext::switch_draw_mode() {
     }
 }
 
+void MyContext::switch_probe_update() {
+    Optional<MeshEntity> opt_mesh_entity = get_selected();
+    if (opt_mesh_entity.has_value()) {
+        MeshEntity& mesh_entity = opt_mesh_entity.value().get();
+        mesh_entity.set_probe_update(probe_updates.cycle());
+    }
+}
+
+void MyContext::place_reflection_probe() {
+    Optional<MeshEntity> opt_mesh_entity = get_selected();
+    glm::vec3 position{ 0.f };
+    if (opt_mesh_entity.has_value()) {
+        position = opt_mesh_entity.value().get().get_origin();
+    }
+    env->add_reflection_probe(position);
+}
+
+void MyContext::set_blocking_loads(bool blocking) {
+    env_library.blocking_ = blocking;
+}
+
+bool MyContext::save_scene(const std::string& path) {
+    SceneData scene = capture_scene();
+    scene.environment.cube_map = static_cast<uint32_t>(env_library.get_active());
+    return write_scene(path, scene);
+}
+
+void MyContext::load_scene(const std::string& path) {
+    set_scene(read_scene(path));
+}
+
+void MyContext::set_scene(const SceneData& scene) {
+    // checked before anything is replaced, apply_scene checks the entities
+    if (scene.environment.cube_map >= env_library.get_size()) {
+        throw std::runtime_error("Error applying scene, environment " + std::to_string(scene.environment.cube_map) + " is not in the library");
+    }
+    if (scene.camera.kind >= SceneCameraKind::NUM_SCENE_CAMERA_KINDS) {
+        throw std::runtime_error("Error applying scene, unknown camera");
+    }
+    apply_scene(scene);
+    bool trackball = dynamic_cast<TrackballCamera*>(env->camera.get_camera_ptr()) != nullptr;
+    if (trackball != (scene.camera.kind == SceneCameraKind::TRACKBALL_CAMERA)) {
+        switch_camera();
+    }
+    apply_camera(scene.camera);
+    env_library.request_switch(scene.environment.cube_map);
+    // the entities were replaced, the journal can't describe them as edits
+    if (journal_) {
+        journal_->reset(*this, scene.environment.cube_map);
+    }
+}
+
+void MyContext::enable_autosave(const std::string& path) {
+    journal_ = std::make_unique<SceneJournal>(path);
+    journal_->reset(*this, static_cast<uint32_t>(env_library.get_active()));
+}
+
+void MyContext::recover_scene(const std::string& path) {
+    set_scene(SceneJournal::recover(path));
+}
+
+void MyContext::flush_autosave() {
+    if (journal_) {
+        journal_->save(*this, static_cast<uint32_t>(env_library.get_active()));
+    }
+}
+
 void MyContext::set_camera(Camera* new_camera) {
     env->camera.set_camera(std::move(std::unique_ptr<Camera>(new_camera)));
 }
@@ -78,4 +142,12 @@ void MyContext::update(std::chrono::duration<float> delta) {
     }
 
     Context::update(delta);
+    if (journal_) {
+        journal_->update(*this, static_cast<uint32_t>(env_library.get_active()));
+    }
+}
+
+void MyContext::draw() {
+    env_library.update(*env);
+    Context::draw();
 }
\ No newline at end of file
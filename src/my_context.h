@@ -3,19 +3,23 @@
 #include <array>
 #include <memory>
 #include <chrono>
+#include <string>
 
 #include "context.h"
+#include "env_library.h"
 
 class MyContext : public Context {
     ShaderCycler shaders = { ShaderPrograms::PHONG, ShaderPrograms::FLAT, ShaderPrograms::REFLECT, ShaderPrograms::REFRACT };
     DrawModeCycler draw_modes = { DrawMode::DEF_DRAW_MODE, DrawMode::WIREFRAME, DrawMode::WIREFRAME_ONLY, DrawMode::DRAW_NORMALS  };
+    ProbeUpdateCycler probe_updates = { ProbeUpdate::ON_CHANGE, ProbeUpdate::ROUND_ROBIN, ProbeUpdate::EVERY_FRAME, ProbeUpdate::BAKED };
 
     std::array<Camera*, 2> cameras;
     size_t camera_idx = 0;
 
-    // TODO: make list, currently supports two CubeMaps, other set in constructor
-    std::unique_ptr<CubeMapEntity> curr_cube_map = std::make_unique<Def_CubeMapEntity>();
-
+    EnvLibrary env_library = {
+        { "../data/night_env/", true },
+        { DEF_CUBE_MAP_DIR_PATH },
+    };
 
 public:
     bool rotate_light = true;
@@ -25,9 +29,30 @@ public:
     // cycles through the available shader programs enumerated in ProgramList
     void switch_shader();
     void switch_draw_mode();
+    // cycles how often the selected mesh's dynamic env map is captured
+    void switch_probe_update();
+    // places a reflection probe at the selected mesh, or at the origin if none is selected
+    void place_reflection_probe();
+    // switches to the next environment in the library once it has loaded, drawing continues with the current one meanwhile
     void switch_cube_map();
+    // environment switches wait for their decode, so that replays don't depend on disk and decode times
+    void set_blocking_loads(bool blocking);
+    // writes the scene along with the camera's type and the active environment. returns false if it couldn't be written
+    bool save_scene(const std::string& path);
+    // replaces the scene with one written by save_scene, switching to its camera and environment. throws if it can't be read or applied
+    void load_scene(const std::string& path);
+    // replaces the scene, switching to its camera and environment. throws, leaving the scene as it was, if it can't be applied
+    void set_scene(const SceneData& scene);
+    // journals the edits to the files at path from now on, starting over from the current scene
+    void enable_autosave(const std::string& path);
+    // replaces the scene with the autosave at path. throws if there is none
+    void recover_scene(const std::string& path);
+    // writes the edits made since the last autosave right away
+    void flush_autosave();
     void set_camera(Camera* new_camera);
     void switch_camera();
 
     void update(std::chrono::duration<float> delta);
+    // streams in the environment library prior to drawing
+    void draw();
 };
\ No newline at end of file
@@ -0,0 +1,274 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+#include "scene_file.h"
+#include "scene_journal.h"
+
+// checks the scene files and the autosave journal on disk, without a gl context
+//
+//   scene_check [--dir path]
+//
+// writes and reads back a scene, and replays a journal across a compaction and up to a torn final record. the exit code is 1 if a check fails
+
+// an entity of the expected scene, by the hash of its prototype rather than its index
+struct ExpectedEntity {
+    uint64_t prototype;
+    SceneEntity entity;
+};
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& name) {
+    std::cout << (ok ? "ok      " : "FAILED  ") << name << std::endl;
+    if (!ok) {
+        failures++;
+    }
+}
+
+static void check_throws(const std::function<void()>& op, const std::string& name) {
+    bool thrown = false;
+    try {
+        op();
+    }
+    catch (const std::exception&) {
+        thrown = true;
+    }
+    check(thrown, name);
+}
+
+template<typename T>
+static bool same_bytes(const T& a, const T& b) {
+    return std::memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+template<typename T>
+static bool same_records(const std::vector<T>& a, const std::vector<T>& b) {
+    return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+// entities with every field set apart, so that a field that isn't stored shows
+static SceneEntity make_entity(int i, uint32_t prototype) {
+    SceneEntity entity{};
+    entity.trans = glm::mat4{ 1.f };
+    entity.trans[3] = glm::vec4(i * 1.5f, 0.f, -i * 0.5f, 1.f);
+    entity.color = glm::vec3(0.1f * i, 0.5f, 1.f - 0.1f * i);
+    entity.prototype = prototype;
+    entity.shader = ShaderPrograms::DEF_SHADER + i % 4;
+    entity.draw_mode = i % 4;
+    entity.probe_update = i % 3;
+    entity.env_projection = i % 2;
+    entity.dyn_reflections = i % 2;
+    entity.shadows = (i + 1) % 2;
+    entity.pcf_size = 1 + 2 * (i % 4);
+    return entity;
+}
+
+static ScenePointLight make_point_light(int i) {
+    ScenePointLight point_light{};
+    point_light.trans = glm::mat4{ 1.f };
+    point_light.trans[3] = glm::vec4(2.5f, 1.f, 2.5f * i, 1.f);
+    point_light.mesh_color = glm::vec3(1.f);
+    point_light.ambient_color = glm::vec3(1.f, 0.9f, 0.8f);
+    point_light.ambient = 0.1f;
+    point_light.diffuse_color = glm::vec3(1.f);
+    point_light.diffuse = 1.f;
+    point_light.specular_color = glm::vec3(1.f);
+    point_light.specular = 1.f;
+    point_light.shininess = 7.f + i;
+    point_light.constant = 1.f;
+    point_light.linear = 0.09f;
+    point_light.quadratic = 0.032f;
+    point_light.selectable = 1;
+    return point_light;
+}
+
+static SceneData make_scene() {
+    SceneData scene;
+    scene.prototypes = { 0x1111, 0x2222, 0x3333 };
+    for (int i = 0; i < 6; i++) {
+        scene.entities.push_back(make_entity(i, i % 3));
+    }
+    for (int i = 0; i < 3; i++) {
+        scene.point_lights.push_back(make_point_light(i));
+    }
+    scene.probes = { { glm::vec3(1.f, 2.f, 3.f), 4.f }, { glm::vec3(-1.f, 0.5f, 0.f), 2.f } };
+    scene.camera.trans = glm::mat4{ 1.f };
+    scene.camera.orbit = glm::vec3(5.f, 1.f, 1.2f);
+    scene.camera.up = 1.f;
+    scene.camera.fov = 45.f;
+    scene.camera.kind = SceneCameraKind::TRACKBALL_CAMERA;
+    scene.environment.dir_light_trans = glm::mat4{ 2.f };
+    scene.environment.cube_map = 1;
+    return scene;
+}
+
+static std::vector<char> read_bytes(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+}
+
+static void write_bytes(const std::string& path, const char* data, size_t size) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write(data, size);
+}
+
+static void check_scene_file(const std::filesystem::path& dir) {
+    std::string path = (dir / "scene.bin").string();
+    SceneData scene = make_scene();
+    check(write_scene(path, scene), "scene is written");
+
+    SceneData read = read_scene(path);
+    check(read.prototypes == scene.prototypes, "scene prototypes read back");
+    check(same_records(read.entities, scene.entities), "scene entities read back");
+    check(same_records(read.point_lights, scene.point_lights), "scene point lights read back");
+    check(same_records(read.probes, scene.probes), "scene probes read back");
+    check(same_bytes(read.camera, scene.camera) && same_bytes(read.environment, scene.environment), "scene camera and environment read back");
+
+    std::vector<char> bytes = read_bytes(path);
+    std::string damaged = (dir / "damaged.bin").string();
+    write_bytes(damaged, bytes.data(), bytes.size() - 16);
+    check_throws([&] { read_scene(damaged); }, "truncated scene is rejected");
+    write_bytes(damaged, bytes.data(), 0);
+    check_throws([&] { read_scene(damaged); }, "empty scene is rejected");
+    std::vector<char> foreign = bytes;
+    foreign[0] ^= 0xFF;
+    write_bytes(damaged, foreign.data(), foreign.size());
+    check_throws([&] { read_scene(damaged); }, "scene with another magic is rejected");
+    check_throws([&] { read_scene((dir / "missing.bin").string()); }, "missing scene is rejected");
+}
+
+// the recovered scene against the live entities of the expected one, in order
+static bool matches(const SceneData& scene, const std::vector<std::optional<ExpectedEntity>>& entities) {
+    size_t i = 0;
+    for (auto& expected : entities) {
+        if (!expected.has_value()) {
+            continue;
+        }
+        if (i >= scene.entities.size()) {
+            return false;
+        }
+        SceneEntity entity = scene.entities[i++];
+        SceneEntity expected_entity = expected->entity;
+        if (entity.prototype >= scene.prototypes.size() || scene.prototypes[entity.prototype] != expected->prototype) {
+            return false;
+        }
+        entity.prototype = expected_entity.prototype = 0;
+        if (!same_bytes(entity, expected_entity)) {
+            return false;
+        }
+    }
+    return i == scene.entities.size();
+}
+
+static void compact(std::vector<std::optional<ExpectedEntity>>& entities) {
+    std::vector<std::optional<ExpectedEntity>> live;
+    for (auto& entity : entities) {
+        if (entity.has_value()) {
+            live.push_back(entity);
+        }
+    }
+    entities = std::move(live);
+}
+
+static void check_journal(const std::filesystem::path& dir) {
+    std::string path = (dir / "autosave").string();
+    SceneData scene = make_scene();
+    std::vector<std::optional<ExpectedEntity>> expected;
+    for (const SceneEntity& entity : scene.entities) {
+        expected.push_back(ExpectedEntity{ scene.prototypes[entity.prototype], entity });
+    }
+    std::vector<ScenePointLight> expected_lights = scene.point_lights;
+    SceneCamera expected_camera = scene.camera;
+
+    uint64_t first_generation;
+    uint64_t last_generation;
+    {
+        SceneJournal journal(path);
+        // every write compacts until this is raised below
+        journal.compact_bytes_ = 1;
+        journal.reset(scene);
+        first_generation = journal.get_generation();
+
+        // edits of the first generation: a move, a recolor, the shading keys, a removal, a spawn of a new prototype and a removed light
+        expected[1]->entity.trans[3].x += 10.f;
+        journal.record_entity(1, expected[1]->prototype, expected[1]->entity);
+        expected[2]->entity.color = glm::vec3(0.f, 1.f, 0.f);
+        journal.record_entity(2, expected[2]->prototype, expected[2]->entity);
+        expected[3]->entity.shadows = !expected[3]->entity.shadows;
+        expected[3]->entity.pcf_size = 7;
+        journal.record_entity(3, expected[3]->prototype, expected[3]->entity);
+        journal.remove_entity(0);
+        expected[0].reset();
+        expected.push_back(ExpectedEntity{ 0x4444, make_entity(9, 0) });
+        journal.record_entity(static_cast<uint32_t>(expected.size() - 1), expected.back()->prototype, expected.back()->entity);
+        journal.remove_point_light(1);
+        expected_lights.erase(expected_lights.begin() + 1);
+        journal.write();
+        check(journal.get_generation() == first_generation + 1, "journal past compact_bytes_ starts the next generation");
+
+        // the compaction handed the ids out again without the removed entity and light
+        compact(expected);
+        journal.compact_bytes_ = 4 << 20;
+        expected[0]->entity.trans[3].y = 3.f;
+        journal.record_entity(0, expected[0]->prototype, expected[0]->entity);
+        expected_lights[1].shininess = 64.f;
+        journal.record_point_light(1, expected_lights[1]);
+        expected_camera.orbit.y += 0.5f;
+        journal.record_camera(expected_camera);
+        journal.write();
+
+        // the last edit is cut off below, as by a crash in the middle of writing it
+        SceneEntity torn = expected[2]->entity;
+        torn.trans[3].z = 100.f;
+        journal.record_entity(2, expected[2]->prototype, torn);
+        journal.write();
+        last_generation = journal.get_generation();
+    }
+    std::string journal_file = path + "." + std::to_string(last_generation) + ".journal";
+    std::filesystem::resize_file(journal_file, std::filesystem::file_size(journal_file) - 5);
+
+    check(!std::filesystem::exists(path + "." + std::to_string(first_generation) + ".bin"), "compaction removes the previous generation");
+    SceneData recovered = SceneJournal::recover(path);
+    check(matches(recovered, expected), "recovered entities match the edits up to the torn record");
+    check(same_records(recovered.point_lights, expected_lights), "recovered point lights match");
+    check(same_bytes(recovered.camera, expected_camera), "recovered camera matches");
+    check(same_records(recovered.probes, scene.probes) && same_bytes(recovered.environment, scene.environment), "unedited probes and environment are kept");
+}
+
+int main(int argc, char** argv)
+{
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "scene_check";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--dir" && i + 1 < argc) {
+            dir = argv[++i];
+        }
+        else {
+            std::cout << "usage: " << argv[0] << " [--dir path]" << std::endl;
+            return -1;
+        }
+    }
+
+    try {
+        // the files of an earlier run would be recovered as well
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        check_scene_file(dir);
+        check_journal(dir);
+    }
+    catch (const std::exception& e) {
+        std::cout << "FAILED  " << e.what() << std::endl;
+        failures++;
+    }
+
+    std::cout << (failures == 0 ? "all checks passed" : std::to_string(failures) + " checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}